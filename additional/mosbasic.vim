@@ -3,15 +3,15 @@ syntax case ignore
 
 " Keywords
 syn keyword basicStmtKeywords ALERT AND ASKFILE BREAK CALL
-syn keyword basicStmtKeywords CASE CHR CLS CURSOR CURSCHAR
+syn keyword basicStmtKeywords CASE CHR CLS COPY CURSOR CURSCHAR
 syn keyword basicStmtKeywords CURSCOL CURSPOS DELETE DO ELSE
-syn keyword basicStmtKeywords END ENDLESS FILES FOR GET GOSUB
+syn keyword basicStmtKeywords END ENDLESS FILES FILL FOR GET GOSUB
 syn keyword basicStmtKeywords GOTO GETKEY HEX IF IN INCLUDE
 syn keyword basicStmtKeywords INK INPUT LEN LISTBOX LOAD
 syn keyword basicStmtKeywords LOOP LOWER MOVE NEXT NUMBER
 syn keyword basicStmtKeywords OFF ON OUT PAGE PAUSE PEEK
 syn keyword basicStmtKeywords PEEKINT POKE POKEINT PORT PRINT
-syn keyword basicStmtKeywords RAND READ REC RENAME RETURN SAVE
+syn keyword basicStmtKeywords RAND RANDOMIZE READ REC RENAME RETURN SAVE
 syn keyword basicStmtKeywords SEND SERIAL SET SIZE SOUND STRING
 syn keyword basicStmtKeywords THEN TO UNTIL UPPER WAITKEY WHILE
 
@@ -95,6 +95,21 @@ print "hi"
 cont:
 print "hi continued"
 
+rem LABELLED GOSUB TEST
+print "LABELLED GOSUB TEST: ";
+x = 0
+goto lgstart
+lgsub:
+print "B" ;
+return
+lgstart:
+print "A" ;
+lgagain:
+gosub lgsub
+x = x + 1
+if x < 3 then goto lgagain
+print ""
+
 rem INK TEST
 print "INK TEST: ";
 ink 8
@@ -199,6 +214,16 @@ b = 121
 string set $1 5 b
 print " " + $1
 
+rem STRING COMPARE TEST
+print "STRING COMPARE TEST: ";
+$4 = "x"
+$2 = ""
+if $4 = $2 + $4 then print "eq " ;
+$2 = "y"
+if $4 != $2 + $4 then print "ne " ;
+$4 = $4 + "" + $2
+if $4 = "x" + $2 then print "eq"
+
 rem WAITKEY TEST
 print "WAITKEY TEST: ";
 waitkey x
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Benchmark driver (make bench): compiles and runs every program of the corpus
+ * with the built-in emulator, compares results with the baseline and fails if
+ * anything got bigger or slower by more than the threshold.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <dirent.h>
+
+#ifdef _WIN32
+#define NO_INPUT "< NUL"
+#else
+#define NO_INPUT "< /dev/null"
+#endif
+
+#define COMPILER "bin/mosbc.exe"
+#define PROGRAMS "bench/programs"
+#define KEYWORDS "bench/keywords"
+#define BASELINE "bench/baseline.json"
+#define RESULTS "obj/bench.json"
+#define OUTPUT "obj/bench.bin"
+#define EMPTY "empty"		/* Keyword benchmark with nothing in the loop */
+#define ITERATIONS 100		/* Times keyword benchmarks run a statement */
+#define NAME_LEN 64
+
+typedef struct {
+	char name[NAME_LEN];	/* "programs/name" or "keywords/name" */
+	long size;		/* Bytes of compiled program */
+	long instructions;	/* Executed instructions */
+	long cycles[2];		/* Estimated cycles on 8086 and 286 */
+} Result;
+
+typedef struct {
+	Result* table;
+	int len;
+	int capacity;
+} ResultTable;
+
+/* Settings from the command line */
+static double threshold = 2.0;	/* Percent, how much worse is a regression */
+static bool update = false;	/* Write new baseline */
+static char flags[256] = "";	/* Passed to compiler */
+
+/* ================================= RESULTS ================================ */
+static Result* add_result(ResultTable* t, const char* name)
+{
+	if (t->capacity < t->len + 1) {
+		t->capacity = t->capacity ? t->capacity * 2 : 16;
+		t->table = realloc(t->table, t->capacity * sizeof(Result));
+	}
+
+	Result* r = &t->table[t->len++];
+	memset(r, 0, sizeof(Result));
+	snprintf(r->name, NAME_LEN, "%s", name);
+	return r;
+}
+
+static Result* find_result(ResultTable* t, const char* name)
+{
+	for (int i = 0; i < t->len; i++)
+		if (!strcmp(t->table[i].name, name))
+			return &t->table[i];
+
+	return NULL;
+}
+
+/* Read file written by write_results(), one result per line */
+static void read_results(ResultTable* t, const char* filename)
+{
+	FILE* f = fopen(filename, "r");
+	if (f == NULL)
+		return;
+
+	char line[256], name[NAME_LEN];
+	Result r;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		int n = sscanf(line, " \"%63[^\"]\": { \"size\": %ld, "
+			"\"instructions\": %ld, \"cycles_8086\": %ld, "
+			"\"cycles_286\": %ld }", name, &r.size,
+			&r.instructions, &r.cycles[0], &r.cycles[1]);
+		if (n != 5)
+			continue;
+
+		Result* dst = add_result(t, name);
+		dst->size = r.size;
+		dst->instructions = r.instructions;
+		dst->cycles[0] = r.cycles[0];
+		dst->cycles[1] = r.cycles[1];
+	}
+
+	fclose(f);
+}
+
+static bool write_results(ResultTable* t, const char* filename)
+{
+	FILE* f = fopen(filename, "w");
+	if (f == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not write %s.\n", filename);
+		return false;
+	}
+
+	fprintf(f, "{\n");
+	for (int i = 0; i < t->len; i++) {
+		Result* r = &t->table[i];
+		fprintf(f, "  \"%s\": { \"size\": %ld, \"instructions\": %ld, "
+			"\"cycles_8086\": %ld, \"cycles_286\": %ld }%s\n",
+			r->name, r->size, r->instructions, r->cycles[0],
+			r->cycles[1], i + 1 < t->len ? "," : "");
+	}
+	fprintf(f, "}\n");
+
+	fclose(f);
+	return true;
+}
+
+/* ================================= RUNNING ================================ */
+/* Compile and run one program, false if it didn't work */
+static bool run(const char* path, Result* r)
+{
+	char cmd[512];
+	snprintf(cmd, sizeof(cmd), "%s %s %s -run %s " NO_INPUT, COMPILER,
+		path, OUTPUT, flags);
+
+	FILE* p = popen(cmd, "r");
+	if (p == NULL)
+		return false;
+
+	/* Pick numbers from what compiler says */
+	char line[512];
+	bool compiled = false, exited = false;
+	while (fgets(line, sizeof(line), p) != NULL) {
+		char* s;
+		if ((s = strstr(line, "written file ")) != NULL)
+			compiled = sscanf(s, "written file %*s (%ld bytes long)",
+				&r->size) == 1;
+		if ((s = strstr(line, "program exited after ")) != NULL)
+			exited = sscanf(s, "program exited after %ld "
+				"instructions (%ld cycles on 8086, %ld on 286)",
+				&r->instructions, &r->cycles[0],
+				&r->cycles[1]) == 3;
+	}
+
+	pclose(p);
+	return compiled && exited;
+}
+
+static int compare_names(const void* a, const void* b)
+{
+	return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/* Run all .bas files of a directory, in alphabetical order */
+static bool run_dir(ResultTable* t, const char* dir, const char* group)
+{
+	DIR* d = opendir(dir);
+	if (d == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not open %s.\n", dir);
+		return false;
+	}
+
+	char* names[256];
+	int len = 0;
+	struct dirent* e;
+	while ((e = readdir(d)) != NULL && len < 256) {
+		int n = strlen(e->d_name);
+		if (n > 4 && n < NAME_LEN - 16 &&
+		    !strcmp(e->d_name + n - 4, ".bas"))
+			names[len++] = strdup(e->d_name);
+	}
+	closedir(d);
+	qsort(names, len, sizeof(char*), compare_names);
+
+	bool ok = true;
+	for (int i = 0; i < len; i++) {
+		char path[256], name[NAME_LEN];
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		snprintf(name, NAME_LEN, "%s/%.*s", group,
+			(int) strlen(names[i]) - 4, names[i]);
+
+		Result* r = add_result(t, name);
+		if (!run(path, r)) {
+			printf("\x1B[31mError\x1B[0m: %s failed to compile or "
+				"run.\n", path);
+			ok = false;
+		}
+		free(names[i]);
+	}
+
+	return ok;
+}
+
+/* ================================ REPORTING =============================== */
+static double change(long now, long before)
+{
+	return before ? 100.0 * (now - before) / before : 0.0;
+}
+
+/* Print one result, returns true if it regressed */
+static bool report(Result* r, Result* base)
+{
+	printf("%-26s %7ld %10ld %12ld %11ld", r->name, r->size,
+		r->instructions, r->cycles[0], r->cycles[1]);
+
+	if (base == NULL) {
+		printf("   (new)\n");
+		return false;
+	}
+
+	double size = change(r->size, base->size);
+	double c86 = change(r->cycles[0], base->cycles[0]);
+	double c286 = change(r->cycles[1], base->cycles[1]);
+	bool worse = size > threshold || c86 > threshold || c286 > threshold;
+
+	printf("   %s%+6.1f%% %+6.1f%% %+6.1f%%\x1B[0m\n",
+		worse ? "\x1B[31m" : size < 0 || c86 < 0 ? "\x1B[32m" : "",
+		size, c86, c286);
+	return worse;
+}
+
+/* Keyword benchmarks are shown as cost of one statement */
+static void report_keywords(ResultTable* t)
+{
+	Result* empty = find_result(t, "keywords/" EMPTY);
+	if (empty == NULL)
+		return;
+
+	printf("\n\x1B[36mCost of one statement\x1B[0m (over empty loop, "
+		"%d iterations):\n", ITERATIONS);
+	printf("%-26s %7s %10s %12s %11s\n", "Keyword", "Bytes",
+		"Instr.", "8086 cycles", "286 cycles");
+	for (int i = 0; i < t->len; i++) {
+		Result* r = &t->table[i];
+		if (strncmp(r->name, "keywords/", 9) || r == empty)
+			continue;
+
+		printf("%-26s %7ld %10.1f %12.1f %11.1f\n", r->name + 9,
+			r->size - empty->size,
+			(double) (r->instructions - empty->instructions) /
+			ITERATIONS,
+			(double) (r->cycles[0] - empty->cycles[0]) / ITERATIONS,
+			(double) (r->cycles[1] - empty->cycles[1]) / ITERATIONS);
+	}
+}
+
+static bool parse_args(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-update"))
+			update = true;
+		else if (!strncmp(argv[i], "-threshold=", 11))
+			threshold = atof(argv[i] + 11);
+		else if (!strcmp(argv[i], "--")) {
+			/* Everything after it goes to the compiler */
+			for (i++; i < argc; i++) {
+				strncat(flags, argv[i], sizeof(flags) -
+					strlen(flags) - 2);
+				strcat(flags, " ");
+			}
+		}
+		else {
+			printf("Usage: bench [-update] [-threshold=N] "
+				"[-- compiler options]\n");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (!parse_args(argc, argv))
+		return -1;
+
+	ResultTable results = { NULL, 0, 0 }, baseline = { NULL, 0, 0 };
+	bool ok = run_dir(&results, PROGRAMS, "programs");
+	ok = run_dir(&results, KEYWORDS, "keywords") && ok;
+	read_results(&baseline, BASELINE);
+
+	printf("%-26s %7s %10s %12s %11s   %7s %7s %7s\n", "Benchmark",
+		"Bytes", "Instr.", "8086 cycles", "286 cycles", "Size", "8086",
+		"286");
+
+	int regressions = 0;
+	for (int i = 0; i < results.len; i++) {
+		Result* r = &results.table[i];
+		regressions += report(r, find_result(&baseline, r->name));
+	}
+	report_keywords(&results);
+
+	ok = write_results(&results, update ? BASELINE : RESULTS) && ok;
+	if (update)
+		printf("\n\x1B[32mBaseline updated\x1B[0m: %s\n", BASELINE);
+	else if (regressions > 0) {
+		printf("\n\x1B[31m%d benchmark(s) regressed\x1B[0m by more "
+			"than %.1f%%.\n", regressions, threshold);
+		ok = false;
+	}
+
+	free(results.table);
+	free(baseline.table);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Synthetic program generator for compiler throughput benchmark. Programs only
+ * have to compile, nobody runs them, so jumps go to random labels.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <stdarg.h>
+
+/* Custom includes */
+#include "generator.h"
+
+#define MAX_DEPTH 8		/* Loop variables are I to P */
+#define MAX_BODY 6		/* Statements in body of a loop */
+
+static GenConfig* config;
+static FILE* out;
+static unsigned state;		/* Xorshift state */
+static int written;		/* Lines written so far (in all files) */
+static int labels;		/* Labels that program will have */
+static int defined;		/* Labels written so far */
+
+/* Same on every platform, unlike rand() */
+static int random_below(int n)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return (int) (state % (unsigned) n);
+}
+
+static char numeric_var()
+{
+	return 'a' + random_below(8);
+}
+
+/* Write one line, indented by nesting level */
+static void line(int level, const char* fmt, ...)
+{
+	fprintf(out, "%*s", level * 2, "");
+
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(out, fmt, args);
+	va_end(args);
+
+	fputc('\n', out);
+	written++;
+}
+
+/* Label is placed when its share of lines has passed */
+static void maybe_label(int level)
+{
+	if (defined < labels && written >= (defined + 1) * config->label_every)
+		line(level, "l%06d:", defined++);
+}
+
+/* One statement that fits on one line */
+static void simple(int level)
+{
+	/* Comments are skipped by parser, label can't stand before one */
+	int kind = random_below(8);
+	if (kind != 7)
+		maybe_label(level);
+
+	switch (kind) {
+		case 0:
+			line(level, "%c = %c + %d", numeric_var(),
+				numeric_var(), random_below(1000));
+			break;
+		case 1:
+			line(level, "%c = %c * %d - %c", numeric_var(),
+				numeric_var(), 1 + random_below(9),
+				numeric_var());
+			break;
+		case 2:
+			if (config->strings > 0)
+				line(level, "PRINT \"string literal %d\"",
+					random_below(config->strings));
+			else
+				line(level, "PRINT %c", numeric_var());
+			break;
+		case 3:
+			line(level, "IF %c > %d THEN %c = %c + 1",
+				numeric_var(), random_below(100), numeric_var(),
+				numeric_var());
+			break;
+		case 4:
+			if (labels > 0)
+				line(level, "IF %c = %d THEN GOSUB l%06d",
+					numeric_var(), random_below(100),
+					random_below(labels));
+			else
+				line(level, "%c = %d", numeric_var(),
+					random_below(100));
+			break;
+		case 5:
+			if (labels > 0)
+				line(level, "IF %c < %d THEN GOTO l%06d",
+					numeric_var(), random_below(100),
+					random_below(labels));
+			else
+				line(level, "%c = %d", numeric_var(),
+					random_below(100));
+			break;
+		case 6:
+			if (config->strings > 0)
+				line(level, "$%d = \"string literal %d\"",
+					1 + random_below(8),
+					random_below(config->strings));
+			else
+				line(level, "$%d = \"\"", 1 + random_below(8));
+			break;
+		default:
+			line(level, "REM generated line %d", written);
+			break;
+	}
+}
+
+/* Write statements until there are at most end lines */
+static void block(int level, int end)
+{
+	while (written < end) {
+		/* Loop needs at least 3 lines (opening, body, closing) */
+		if (level < config->depth && level < MAX_DEPTH &&
+		    end - written >= 3 && random_below(6) == 0) {
+			int body = written + 2 + random_below(MAX_BODY);
+			if (body > end - 1)
+				body = end - 1;
+
+			char var = 'i' + level;
+			if (random_below(2)) {
+				line(level, "FOR %c = 1 TO %d", var,
+					2 + random_below(20));
+				block(level + 1, body);
+				line(level, "NEXT %c", var);
+			}
+			else {
+				line(level, "DO");
+				block(level + 1, body);
+				line(level, "LOOP UNTIL %c > %d", numeric_var(),
+					random_below(100));
+			}
+		}
+		else
+			simple(level);
+	}
+}
+
+static bool open_file(const char* path)
+{
+	out = fopen(path, "w");
+	if (out == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not write %s.\n", path);
+		return false;
+	}
+	return true;
+}
+
+bool generate(const char* path, GenConfig* c)
+{
+	config = c;
+	state = c->seed ? c->seed : 1;
+	written = 0;
+	defined = 0;
+	labels = c->label_every > 0 ? c->lines / c->label_every : 0;
+
+	/* Included files get equal share of lines, main one the rest */
+	int share = c->lines / (c->includes + 1);
+	if (!open_file(path))
+		return false;
+	for (int i = 1; i <= c->includes; i++)
+		line(0, "INCLUDE \"%s.%d\"", path, i);
+	block(0, c->lines - share * c->includes - 1);
+	line(0, "END");
+
+	char name[256];
+	for (int i = 1; i <= c->includes; i++) {
+		fclose(out);
+		snprintf(name, sizeof(name), "%s.%d", path, i);
+		if (!open_file(name))
+			return false;
+		block(0, written + share - 1);
+		line(0, "RETURN");
+	}
+
+	/* All labels must exist, even if the program ran short of lines */
+	while (defined < labels) {
+		line(0, "l%06d:", defined++);
+		line(0, "RETURN");
+	}
+
+	fclose(out);
+	return true;
+}
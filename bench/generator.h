@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+/* Standard library includes */
+#include <stdbool.h>
+
+/* Shape of generated program */
+typedef struct {
+	int lines;		/* Lines of whole program (with included files) */
+	int label_every;	/* One label per that many lines (0 - none) */
+	int includes;		/* Included files, every one gets its share */
+	int strings;		/* Different string literals (0 - none) */
+	int depth;		/* Deepest nesting of FOR and DO loops */
+	unsigned seed;		/* Same seed gives the same program */
+} GenConfig;
+
+/* Write syntactically valid BASIC program to path, included files are written
+ * next to it (path with .1, .2, ... appended). False if files can't be written.
+ */
+bool generate(const char* path, GenConfig* c);
+
+#endif
@@ -0,0 +1,8 @@
+rem Microbenchmark: case
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  CASE UPPER $1
+NEXT i
+END
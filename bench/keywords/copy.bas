@@ -0,0 +1,8 @@
+rem Microbenchmark: copy
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  COPY b 41000 64
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: curschar
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  CURSCHAR c
+NEXT i
+END
@@ -0,0 +1,7 @@
+rem Microbenchmark: empty
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: fill
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  FILL b 64 a
+NEXT i
+END
@@ -0,0 +1,11 @@
+rem Microbenchmark: gosub
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  GOSUB sub
+NEXT i
+END
+
+sub:
+RETURN
@@ -0,0 +1,10 @@
+rem Microbenchmark: goto (jumps to an assignment, compare with assign)
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  GOTO skip
+  skip:
+  c = a
+NEXT i
+END
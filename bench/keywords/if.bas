@@ -0,0 +1,8 @@
+rem Microbenchmark: if
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  IF a = 7 THEN c = 1
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: ink
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  INK 7
+NEXT i
+END
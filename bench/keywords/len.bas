@@ -0,0 +1,8 @@
+rem Microbenchmark: len
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  LEN $1 c
+NEXT i
+END
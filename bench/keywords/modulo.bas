@@ -0,0 +1,8 @@
+rem Microbenchmark: modulo
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  c = a % 3
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: move
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  MOVE 5 5
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: number
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  NUMBER a $2
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: peekint
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  PEEKINT c b
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: poke
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  POKE 65 b
+NEXT i
+END
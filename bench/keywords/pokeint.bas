@@ -0,0 +1,8 @@
+rem Microbenchmark: pokeint
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  POKEINT a b
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: print_chr
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  PRINT CHR 65 ;
+NEXT i
+END
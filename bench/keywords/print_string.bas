@@ -0,0 +1,8 @@
+rem Microbenchmark: print_string
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  PRINT "text"
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: rand
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  RAND c 1 100
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: string_compare
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  IF $1 = "hello" THEN c = 1
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: string_concat
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  $2 = $1 + "world"
+NEXT i
+END
@@ -0,0 +1,8 @@
+rem Microbenchmark: string_get
+a = 7
+b = 40000
+$1 = "hello"
+FOR i = 1 TO 100
+  STRING GET $1 2 c
+NEXT i
+END
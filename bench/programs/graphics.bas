@@ -0,0 +1,47 @@
+rem PEEK/POKE graphics in a 40x25 buffer
+b = 40000
+
+rem Clear the buffer
+FOR i = 0 TO 999
+  a = b + i
+  POKE 32 a
+NEXT i
+
+rem Border
+FOR x = 0 TO 39
+  a = b + x
+  POKE 35 a
+  a = a + 960
+  POKE 35 a
+NEXT x
+FOR y = 0 TO 24
+  a = y * 40 + b
+  POKE 35 a
+  a = a + 39
+  POKE 35 a
+NEXT y
+
+rem Diagonal line
+FOR i = 1 TO 23
+  a = i * 41 + b
+  POKE 42 a
+NEXT i
+
+rem Count set cells by reading them back
+n = 0
+FOR i = 0 TO 999
+  a = b + i
+  PEEK c a
+  IF c != 32 THEN n = n + 1
+NEXT i
+PRINT n
+
+rem Word-sized stores
+FOR i = 0 TO 499
+  a = i * 2 + b
+  POKEINT i a
+NEXT i
+a = b + 998
+PEEKINT w a
+PRINT w
+END
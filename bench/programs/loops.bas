@@ -0,0 +1,19 @@
+rem Tight numeric FOR loops
+s = 0
+FOR i = 1 TO 100
+  FOR j = 1 TO 50
+    s = s + j
+    t = i * j % 7
+    IF t = 3 THEN s = s - 1
+  NEXT j
+NEXT i
+PRINT s
+
+rem Countdown with DO loop
+c = 5000
+DO
+  c = c - 1
+  d = c / 3
+LOOP UNTIL c = 0
+PRINT d
+END
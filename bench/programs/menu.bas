@@ -0,0 +1,50 @@
+rem GOSUB-heavy menu drawing
+FOR r = 1 TO 20
+  FOR k = 1 TO 4
+    s = k
+    GOSUB draw_k
+  NEXT k
+  c = r % 4 + 1
+  IF c = 1 THEN GOSUB action_one
+  IF c = 2 THEN GOSUB action_two
+  IF c = 3 THEN GOSUB action_three
+  IF c = 4 THEN GOSUB action_four
+NEXT r
+MOVE 0 20
+PRINT "total: " ;
+PRINT t
+END
+
+draw_k:
+  MOVE 10 s
+  IF s = c THEN PRINT "> " ;
+  IF s != c THEN PRINT "  " ;
+  PRINT "Menu entry " ;
+  PRINT s
+RETURN
+
+action_one:
+  t = t + 1
+  GOSUB status
+RETURN
+
+action_two:
+  t = t + 2
+  GOSUB status
+RETURN
+
+action_three:
+  t = t + 3
+  GOSUB status
+RETURN
+
+action_four:
+  t = t + 4
+  GOSUB status
+RETURN
+
+status:
+  MOVE 0 10
+  PRINT "Last action: " ;
+  PRINT c
+RETURN
@@ -0,0 +1,29 @@
+rem Sieve of Eratosthenes in a PEEK/POKE table
+b = 40000
+m = 2000
+FOR i = 0 TO m
+  a = b + i
+  POKE 1 a
+NEXT i
+FOR i = 2 TO 44
+  a = b + i
+  PEEK f a
+  IF f = 1 THEN GOSUB strike
+NEXT i
+n = 0
+FOR i = 2 TO m
+  a = b + i
+  PEEK f a
+  IF f = 1 THEN n = n + 1
+NEXT i
+PRINT n
+END
+
+strike:
+  j = i * i
+  DO
+    a = b + j
+    POKE 0 a
+    j = j + i
+  LOOP UNTIL j > m
+RETURN
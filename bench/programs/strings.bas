@@ -0,0 +1,25 @@
+rem String-heavy PRINT
+$1 = "Line "
+$2 = " of output"
+FOR i = 1 TO 60
+  PRINT $1 ;
+  PRINT i ;
+  PRINT $2
+NEXT i
+
+FOR i = 1 TO 30
+  $3 = $1 + "number " + $2
+  PRINT $3
+  PRINT "value: " ;
+  PRINT HEX i ;
+  PRINT " char: " ;
+  PRINT CHR 65
+NEXT i
+
+$4 = "compare"
+n = 0
+FOR i = 1 TO 200
+  IF $4 = "compare" THEN n = n + 1
+NEXT i
+PRINT n
+END
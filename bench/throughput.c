@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Compiler throughput benchmark (make bench-throughput): generates programs of
+ * growing size and times every phase of the compiler on them. Unlike make bench
+ * it measures the compiler itself, so it is linked with its objects.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Custom includes */
+#include <lexer.h>
+#include <parser.h>
+#include <table.h>
+#include <codegen.h>
+#include <options.h>
+#include <util.h>
+#include "generator.h"
+
+#define SOURCE "obj/gen.bas"
+#define OUTPUT "obj/gen.bin"
+#define MAX_FLAGS 32
+
+extern Lexer lexer;
+
+/* Wall time of compiler phases, in seconds */
+typedef enum {
+	PHASE_READ = 0,		/* read_file() and init_lexer() (INCLUDE pass) */
+	PHASE_LEX,		/* Going through all tokens once more */
+	PHASE_PARSE,
+	PHASE_COMPILE,
+	PHASE_WRITE,
+	PHASE_COUNT
+} Phase;
+
+static const char* phase_name[] = {
+	[PHASE_READ] = "Read",
+	[PHASE_LEX] = "Lex",
+	[PHASE_PARSE] = "Parse",
+	[PHASE_COMPILE] = "Compile",
+	[PHASE_WRITE] = "Write"
+};
+
+/* Settings from the command line */
+static GenConfig config = { 0, 20, 0, 100, 3, 1 };
+static int min_lines = 1000;
+static int max_lines = 1000000;
+static double timeout = 60.0;	/* Seconds, larger sizes are skipped after */
+static const char* generate_only = NULL;
+
+/* =============================== MEASURING ================================ */
+static double rate(double count, double time)
+{
+	return time > 0 ? count / time : 0;
+}
+
+/* Compile generated program of given size, false if it took too long */
+static bool measure(int lines)
+{
+	config.lines = lines;
+	if (!generate(SOURCE, &config))
+		return false;
+
+	double t[PHASE_COUNT], start = wall_time();
+	SymbolTable sym;
+	StringTable str;
+	CompileTarget ct;
+	init_sym_table(&sym);
+	init_str_table(&str);
+	init_code(&ct);
+
+	init_lexer(read_file(SOURCE));
+	check_for_error();
+	t[PHASE_READ] = wall_time() - start;
+
+	start = wall_time();
+	long tokens = 0;
+	while (get_token().type != TOKEN_EOF)
+		tokens++;
+	reset_lexer();
+	t[PHASE_LEX] = wall_time() - start;
+
+	start = wall_time();
+	Node* ast = parse(&sym, &str);
+	check_for_error();
+	t[PHASE_PARSE] = wall_time() - start;
+	long nodes = count_nodes(ast);
+
+	start = wall_time();
+	compile(ast, &ct, &str, &sym);
+	check_for_error();
+	t[PHASE_COMPILE] = wall_time() - start;
+
+	start = wall_time();
+	write_file(OUTPUT, &ct);
+	check_for_error();
+	t[PHASE_WRITE] = wall_time() - start;
+
+	double total = 0;
+	for (int i = 0; i < PHASE_COUNT; i++)
+		total += t[i];
+
+	printf("%8d %9ld %9ld %8d %4d %5d", lines, tokens, nodes, ct.length,
+		sym.len, str.len);
+	for (int i = 0; i < PHASE_COUNT; i++)
+		printf(" %8.3f", t[i]);
+	printf(" %11.0f %11.0f %11.0f\n", rate(tokens, t[PHASE_LEX]),
+		rate(nodes, t[PHASE_PARSE]), rate(ct.length, t[PHASE_COMPILE]));
+
+	free_node(ast);
+	free_code(&ct);
+	free_sym_table(&sym);
+	free_str_table(&str);
+	mem_free((char*) lexer.source);
+	return total < timeout;
+}
+
+/* ================================ OPTIONS ================================= */
+static bool number(const char* arg, const char* name, int* dst)
+{
+	int len = strlen(name);
+	if (strncmp(arg, name, len) || arg[len] != '=')
+		return false;
+
+	*dst = atoi(arg + len + 1);
+	return true;
+}
+
+static bool parse_args(int argc, char** argv)
+{
+	/* Compiler options go after "--", first two are its positionals */
+	static char* flags[MAX_FLAGS] = { "throughput", SOURCE, OUTPUT };
+	int nflags = 3, seed = config.seed;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		if (number(arg, "-lines", &min_lines) ||
+		    number(arg, "-max-lines", &max_lines) ||
+		    number(arg, "-label-every", &config.label_every) ||
+		    number(arg, "-includes", &config.includes) ||
+		    number(arg, "-strings", &config.strings) ||
+		    number(arg, "-depth", &config.depth) ||
+		    number(arg, "-seed", &seed))
+			continue;
+		else if (!strncmp(arg, "-timeout=", 9))
+			timeout = atof(arg + 9);
+		else if (!strcmp(arg, "-generate") && i + 1 < argc)
+			generate_only = argv[++i];
+		else if (!strcmp(arg, "--")) {
+			for (i++; i < argc && nflags < MAX_FLAGS; i++)
+				flags[nflags++] = argv[i];
+		}
+		else {
+			printf("Usage: throughput [-lines=N] [-max-lines=N] "
+				"[-label-every=N] [-includes=N]\n"
+				"       [-strings=N] [-depth=N] [-seed=N] "
+				"[-timeout=S] [-generate file]\n"
+				"       [-- compiler options]\n");
+			return false;
+		}
+	}
+
+	config.seed = seed;
+	return parse_options(nflags, flags);
+}
+
+int main(int argc, char** argv)
+{
+	if (!parse_args(argc, argv))
+		return -1;
+
+	/* Just write the program (with -lines=N lines) */
+	if (generate_only != NULL) {
+		config.lines = min_lines;
+		return generate(generate_only, &config) ? 0 : -1;
+	}
+
+	printf("%8s %9s %9s %8s %4s %5s", "Lines", "Tokens", "Nodes", "Bytes",
+		"Lbls", "Strs");
+	for (int i = 0; i < PHASE_COUNT; i++)
+		printf(" %8s", phase_name[i]);
+	printf(" %11s %11s %11s\n", "Tokens/s", "Nodes/s", "Bytes/s");
+
+	/* Sizes grow ten times, from 1K to 1M lines by default */
+	for (long lines = min_lines; lines <= max_lines; lines *= 10) {
+		if (!measure(lines)) {
+			if (lines * 10 <= max_lines)
+				printf("\x1B[33mStopped\x1B[0m: took more than "
+					"%.0f s, larger sizes skipped.\n",
+					timeout);
+			break;
+		}
+	}
+
+	return 0;
+}
@@ -22,7 +22,8 @@ typedef enum {
 	NODE_IF = 6,		/* Left op is condition, right then-else */
 	NODE_DO = 7,		/* Same as above, right is body and modifiers */
 	NODE_FOR = 8,		/* Left - initializer, right - "to" and body */
-	NODE_KEYWORD_CALL = 9	/* Synthetic token, keyword is in attribute */
+	NODE_KEYWORD_CALL = 9,	/* Synthetic token, keyword is in attribute */
+	NODE_TEMP = 10		/* Temporary (op1 is value to save, if any) */
 } NodeType;
 
 typedef struct _Node {
@@ -19,24 +19,31 @@
  * RAMSTART - Address of RAMSTART value in runtime (not the value itself!)
  * WORKPAGE - Address of working page's number
  * ACTIVEPAGE - Address of active page's number
- * VARS - Address of beginning of variables - THIS MAY CHANGE!!!
- * STRVARS - Address of beginning of string variables - THIS MAY CHANGE!!!
+ * RANDSTATE - Address of RAND generator's state
+ * MIKEOSVARS - Where MikeOS keeps numeric variables (with -compat-vars)
+ * MIKEOSSTRVARS - Where MikeOS keeps string variables (with -compat-vars)
+ * VARSLEN - Size of numeric variables area
+ * STRVARSLEN - Size of string variables area
+ * STRLENSLEN - Size of string lengths area (with -string-lengths)
  * STRBUF - Temporary buffer for string operations
  * RUNTIMELEN - Length of the runtime (together with jump at the beginning)
  * VERSION - API version. Update accordingly
  */
 #define LOAD 0x8000
-#define STRADD 0x8003
-#define ZERODIV 0x8018
-#define PRINTSTR 0x8048
-#define INKADDR 0x8098
-#define RAMSTART 0x809A
-#define WORKPAGE 0x809C
-#define ACTIVEPAGE 0x809E
-#define VARS 0x4941
-#define STRVARS 0x4B76
+#define ZERODIV 0x8004
+#define PRINTSTR 0x8034
+#define INKADDR 0x8084
+#define RAMSTART 0x8086
+#define WORKPAGE 0x8088
+#define ACTIVEPAGE 0x808A
+#define RANDSTATE 0x808C
+#define MIKEOSVARS 0x4941
+#define MIKEOSSTRVARS 0x4B76
+#define VARSLEN 0x34
+#define STRVARSLEN 0x400
+#define STRLENSLEN 0x10
 #define STRBUF 0x7C00
-#define RUNTIMELEN 0xA0
+#define RUNTIMELEN 0x8E
 #define VERSION 18
 
 /* ============================== PATCH TABLE =============================== */
@@ -58,17 +65,98 @@ void free_patch(PatchTable* p);
 /* Add one entry */
 void add_patch(PatchTable* p, int id, uint16_t addr);
 
+/* ============================ RELOCATION TABLE ============================ */
+/* Data areas are placed after the code is generated, so their addresses are
+ * emitted as offsets and fixed up at the end of compilation */
+typedef enum {
+	AREA_VARS = 0,		/* Numeric variables (26 words) */
+	AREA_STRVARS = 1,	/* String variables (8 slots, 128 bytes each) */
+	AREA_TEMPS = 2,		/* Temporaries of common subexpressions */
+	AREA_STRLENS = 3,	/* Lengths of string variables (8 words) */
+	AREA_COUNTERS = 4,	/* Statement counters of -instrument */
+	AREA_COUNT = 5
+} DataArea;
+
+typedef struct {
+	DataArea area;		/* Area referred to */
+	uint16_t addr;		/* Address of the word to relocate */
+} RelocTableEntry;
+
+typedef struct {
+	RelocTableEntry* table;	/* Table */
+	int length;		/* Its length */
+	int capacity;		/* And its capacity */
+} RelocTable;
+
+/* ================================ CODE MAP ================================ */
+/* Where code of a source line starts, entries are in order of addresses */
+typedef struct {
+	uint16_t addr;		/* Offset of the first byte */
+	int line;		/* Source line */
+	const char* kind;	/* Statement which emitted it (keyword, IF, ...) */
+} LineTableEntry;
+
+typedef struct {
+	LineTableEntry* table;	/* Table */
+	int length;		/* Its length */
+	int capacity;		/* And its capacity */
+} LineTable;
+
+/* Named piece of code which doesn't belong to any line (runtime, helpers) */
+typedef struct {
+	const char* name;	/* Name of routine or data */
+	uint16_t start;		/* Offset of the first byte */
+	uint16_t end;		/* Offset after the last byte */
+} RangeTableEntry;
+
+typedef struct {
+	RangeTableEntry* table;	/* Table */
+	int length;		/* Its length */
+	int capacity;		/* And its capacity */
+} RangeTable;
+
 /* ======================== COMPILED CODE CONTAINER ========================= */
 typedef struct {
 	char* code;		/* Bytes of compiled code */
 	int length;		/* Length of code */
 	int capacity;		/* Boy I love them dynamic arrays */
+	RelocTable relocs;	/* References to data areas */
+	uint16_t areas[AREA_COUNT];	/* Addresses of data areas */
+	uint16_t area_sizes[AREA_COUNT];	/* And their sizes in bytes */
+	uint16_t ramstart;	/* First address free for the program */
+	int helpers_at;		/* Offset of runtime helpers (end of program) */
+	PatchTable helpers;	/* Calls to runtime helpers (id = HelperId) */
+	LineTable lines;	/* Source lines of the program's code */
+	RangeTable ranges;	/* Runtime, string table and helpers */
+	LineTable counters;	/* Lines of -instrument counters (addr of INC) */
+	bool printed;		/* Is print_string called at all */
 } CompileTarget;
 
 /* Initialize and free */
 void init_code(CompileTarget* c);
 void free_code(CompileTarget* c);
 
+/* Emit address inside of data area (and remember to relocate it) */
+void emit_data(CompileTarget* c, DataArea area, uint16_t offset);
+void emit_var(CompileTarget* c, int var);
+void emit_strvar(CompileTarget* c, int var);
+void emit_strlen(CompileTarget* c, int var);
+
+/* Count executions of a statement on line (-instrument) */
+void emit_counter(CompileTarget* c, int line);
+
+/* Fix all references to data areas (c->areas has to be set) */
+void relocate(CompileTarget* c);
+
+/* Code emitted from now on belongs to line (or to range which started at
+ * start and ends here). Lookups give 0 or NULL for code which belongs nowhere.
+ */
+void add_line(CompileTarget* c, int line, const char* kind);
+void add_range(CompileTarget* c, const char* name, uint16_t start);
+int find_line(CompileTarget* c, uint16_t offset);
+uint16_t line_end(CompileTarget* c, int i);	/* Of i-th line table entry */
+RangeTableEntry* find_range(CompileTarget* c, uint16_t offset);
+
 /* Emit pieces of machine code (takes care of endianness) */
 void emit_byte(CompileTarget* c, uint8_t byte);
 void emit_word(CompileTarget* c, uint16_t word);
@@ -76,26 +164,48 @@ void emit_call(CompileTarget* c, uint16_t target);
 void emit_jump(CompileTarget* c, uint16_t target);
 void emit_string(CompileTarget* c, const char* str);
 
+/* Call runtime helper, it is emitted after the program (see runtime.h) */
+void emit_helper_call(CompileTarget* c, int helper);
+
 /* Patch all jumps when compiling Node n */
 void patch_jumps(CompileTarget* c, PatchTable* p, SymbolTable* sym, Node* n);
 
-/* Convenience function to dump compiled code as ASM */
-void disassemble(CompileTarget* c);
+/* Convenience function to dump compiled code as ASM, grouped by source lines
+ * (sym can be NULL, then labels aren't shown) */
+int disassemble_instruction(CompileTarget* c, int offset);
+void disassemble(CompileTarget* c, SymbolTable* sym);
+
+/* Write compiled program out */
+void write_file(const char* filename, CompileTarget* ct);
+
+/* Write which counter belongs to which line (-instrument-map) */
+void write_counter_map(const char* filename, CompileTarget* ct);
+
+/* Write addresses of labels, routines, data and lines (-map) */
+void write_map(const char* filename, CompileTarget* ct, SymbolTable* sym);
 
 /* Different helpers for the compiler:
  * compile_error() - Emit error message
  * init_expr_compiler() - Initialize expression compiler
  * init_kword_compiler() - Initialize keyword compiler
  * compile_expression() - Returns true if expr was numeric, false if string
+ * compile_sized() - Same, but string's length goes to CX (-string-lengths)
+ * emit_copy() - Copy string compiled from src (NULL if unknown) from SI to DI
+ * emit_concat() - Join strings right into variable (-1 for STRBUF and SI)
  * compile_keyword() - Compile keyword statement
  * compile_ast() - Compile one AST node
+ * measure_ast() - Bytes AST compiles to, compilation's state stays untouched
  */
 void compile_error(const char* msg, Node* ast);
 void init_expr_compiler(StringTable* str);
 void init_kword_compiler(StringTable* str, SymbolTable* sym, PatchTable* p);
 bool compile_expression(Node* ast, CompileTarget* code);
+bool compile_sized(Node* ast, CompileTarget* code);
+void emit_copy(Node* src, CompileTarget* code);
+bool emit_concat(Node* ast, int var, CompileTarget* code);
 void compile_keyword(Node* ast, CompileTarget* code);
 void compile_ast(Node* ast, CompileTarget* code);
+int measure_ast(Node* ast);
 
 /* Main function of code generation: compiler */
 void compile(Node* ast, CompileTarget* code, StringTable* str, SymbolTable* t);
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+#ifndef EMU_H
+#define EMU_H
+
+/* Standard library includes */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Custom includes */
+#include <codegen.h>
+
+/* Some constants describing emulated machine:
+ * EMU_MEMSIZE - Size of whole memory (1 MB, real mode)
+ * EMU_SEGMENT - Segment MikeOS runs programs in (CS = DS = ES)
+ * EMU_STACK - Segment of the stack (SS, SP starts at 0xFFFE)
+ * EMU_EXIT - Return address of the program, reaching it ends the run
+ * EMU_APIEND - Calls below this offset are MikeOS API vectors
+ * EMU_HLEBUF - Buffer in kernel's memory for results of API calls
+ * EMU_VRAM - Linear address of text mode video memory
+ */
+#define EMU_MEMSIZE 0x100000
+#define EMU_SEGMENT 0x2000
+#define EMU_STACK 0x0000
+#define EMU_EXIT 0x0000
+#define EMU_APIEND 0x0100
+#define EMU_HLEBUF 0x0100
+#define EMU_VRAM 0xB8000
+
+/* Indices of registers (same as their encoding in ModRM) */
+enum { AX = 0, CX, DX, BX, SP, BP, SI, DI };
+enum { ES = 0, CS, SS, DS };
+
+/* Flags */
+#define FLAG_CF 0x0001
+#define FLAG_PF 0x0004
+#define FLAG_AF 0x0010
+#define FLAG_ZF 0x0040
+#define FLAG_SF 0x0080
+#define FLAG_TF 0x0100
+#define FLAG_IF 0x0200
+#define FLAG_DF 0x0400
+#define FLAG_OF 0x0800
+
+/* Processors emulator estimates time for */
+typedef enum {
+	CPU_8086 = 0,
+	CPU_286 = 1,
+	CPU_COUNT = 2
+} CpuModel;
+
+typedef enum {
+	RUN_RUNNING = 0,	/* Still executing */
+	RUN_EXITED = 1,		/* Program returned to MikeOS */
+	RUN_LIMIT = 2,		/* Instruction limit was reached */
+	RUN_HALTED = 3,		/* HLT with nothing to wake it up */
+	RUN_ERROR = 4		/* Unsupported instruction or call */
+} RunState;
+
+/* What executed instruction did, for timing */
+typedef struct {
+	uint8_t op;		/* Opcode (after prefixes) */
+	uint8_t ext;		/* ModRM reg field, or byte after 0x0F */
+	bool mem;		/* It has memory operand */
+	uint8_t ea;		/* Cycles for calculating its address on 8086 */
+	bool ea_long;		/* Base + index + displacement (286 pays too) */
+	uint8_t prefixes;	/* Segment override and LOCK prefixes */
+	uint8_t len;		/* Length in bytes (with prefixes) */
+	bool rep;		/* It had REP prefix */
+	uint16_t count;		/* Iterations of REP or bits shifted */
+	bool jumped;		/* It transferred control */
+} Insn;
+
+typedef struct {
+	uint16_t regs[8];	/* General registers (AX, CX, DX, BX, ...) */
+	uint16_t sregs[4];	/* Segment registers (ES, CS, SS, DS) */
+	uint16_t ip;		/* Instruction pointer */
+	uint16_t flags;		/* Flags register */
+	uint8_t* mem;		/* Whole 1 MB of memory */
+	uint64_t instructions;	/* Instructions executed so far */
+	RunState state;		/* Why did it stop (if it did) */
+	uint64_t cycles[CPU_COUNT];	/* Estimated clock cycles so far */
+	int queue[CPU_COUNT];	/* Bytes in prefetch queue */
+	int bus;		/* Memory accesses of current instruction */
+	int odd;		/* How many of them were words at odd address */
+} Cpu;
+
+/* ================================== CPU =================================== */
+void init_cpu(Cpu* cpu);
+void free_cpu(Cpu* cpu);
+
+/* Execute one instruction */
+void step(Cpu* cpu);
+
+/* Memory and stack access (segment:offset) */
+uint8_t read8(Cpu* cpu, uint16_t seg, uint16_t off);
+uint16_t read16(Cpu* cpu, uint16_t seg, uint16_t off);
+void write8(Cpu* cpu, uint16_t seg, uint16_t off, uint8_t val);
+void write16(Cpu* cpu, uint16_t seg, uint16_t off, uint16_t val);
+void push(Cpu* cpu, uint16_t val);
+uint16_t pop(Cpu* cpu);
+
+/* Stop emulation with an error */
+void emu_error(Cpu* cpu, const char* msg, int val);
+
+/* ================================= TIMING ================================= */
+/* Add cycles of executed instruction on every processor */
+void count_cycles(Cpu* cpu, Insn* in);
+
+/* Cycles of instruction alone (operands aligned, prefetch queue not counted),
+ * disassembler uses it too */
+int insn_cycles(Insn* in, CpuModel model);
+
+/* ============================ MACHINE (HLE) =============================== */
+/* Set up screen, keyboard and timer */
+void init_machine(Cpu* cpu);
+
+/* Perform MikeOS API call at given vector (false if it is unknown) */
+bool call_api(Cpu* cpu, uint16_t vector);
+
+/* Perform BIOS interrupt (false if it is unknown) */
+bool interrupt(Cpu* cpu, uint8_t n);
+
+/* Print what is left on the screen */
+void dump_screen(Cpu* cpu);
+
+/* =============================== PROFILER ================================= */
+/* Prepare for a run of compiled program with its labels */
+void init_profile(CompileTarget* code, SymbolTable* sym);
+
+/* Count instruction which started at ip with opcode op, cycles are counters
+ * of the CPU before it was executed */
+void profile_step(Cpu* cpu, uint16_t ip, uint8_t op, uint64_t* cycles);
+
+/* Print hottest lines, labels, subroutines and runtime routines */
+void print_profile();
+void free_profile();
+
+/* ================================ RUNNING ================================= */
+/* Load compiled program at LOAD and run it (-run, -profile) */
+bool run_program(CompileTarget* code, SymbolTable* sym);
+
+#endif
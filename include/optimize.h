@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+/* Standard library includes */
+#include <stdbool.h>
+
+/* Custom includes */
+#include <ast.h>
+#include <table.h>
+
+/* ============================== PASS MANAGER ============================== */
+typedef enum {
+	PASS_INLINE = 0,	/* Inline expansion of small subroutines */
+	PASS_FOLD_STRINGS = 1,	/* Constant strings and PRINTs joined */
+	PASS_ELIDE_COPIES = 2,	/* String variables set once to a literal */
+	PASS_CSE = 3,		/* Common subexpression elimination */
+	PASS_OUTLINE = 4,	/* Move repeated keyword code to helpers */
+	PASS_COUNT
+} PassId;
+
+typedef enum {
+	OPT_O0 = 0,		/* No optimizations, fastest compile */
+	OPT_O1 = 1,		/* Cheap optimizations (default) */
+	OPT_O2 = 2,		/* Everything making code faster */
+	OPT_OS = 3		/* Everything making code smaller */
+} OptLevel;
+
+/* What AST passes can read and set */
+typedef struct {
+	Node* ast;		/* Whole program */
+	SymbolTable* sym;	/* Its labels */
+	StringTable* str;	/* Its string literals */
+	int temps;		/* Temporaries needed by the code */
+} PassContext;
+
+/* Enable passes of given level, then toggle them by name ("-fno-cse") */
+void set_opt_level(OptLevel level);
+bool set_pass(const char* name, bool enabled);
+bool pass_enabled(PassId id);
+
+/* Passes running inside of codegen time themselves with begin/end */
+void pass_begin(PassId id);
+void pass_end(PassId id);
+void pass_saved(PassId id, int bytes);
+
+/* Run enabled AST passes in order, print -time-passes table */
+void run_passes(PassContext* ctx);
+void print_pass_times();
+
+/* ================================= PASSES ================================= */
+/* Replace GOSUBs of short subroutines by their bodies */
+void inline_subroutines(Node* ast, SymbolTable* sym);
+
+/* Join constant concatenations and consecutive constant PRINTs (newlines
+ * included) into single literals, then drop strings nothing uses */
+void fold_strings(Node* ast, SymbolTable* sym, StringTable* str);
+
+/* String variable set once to a literal before it is used, and never changed
+ * afterwards, is replaced by the literal (its copy is never made) */
+void elide_copies(Node* ast, SymbolTable* sym, StringTable* str);
+
+/* Common subexpression elimination within basic blocks. Repeated expressions
+ * are replaced by NODE_TEMP loads, returns number of temporaries needed */
+int eliminate_subexpressions(Node* ast, SymbolTable* sym);
+
+/* Call runtime helpers instead of repeating keyword code (-outline-min) */
+void outline_sequences(Node* ast);
+
+#endif
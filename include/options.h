@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+/* Standard library includes */
+#include <stdbool.h>
+
+/* Format of -stats */
+typedef enum {
+	STATS_OFF = 0,
+	STATS_TEXT = 1,		/* -stats */
+	STATS_JSON = 2		/* -stats=json */
+} StatsFormat;
+
+/* What -profile sorts by */
+typedef enum {
+	PROFILE_OFF = 0,
+	PROFILE_CYCLES = 1,		/* -profile, -profile=cycles (on 8086) */
+	PROFILE_INSTRUCTIONS = 2	/* -profile=instructions */
+} ProfileMode;
+
+typedef struct {
+	const char* src;	/* Name of the source file */
+	const char* out;	/* Name of the output file */
+	bool debug;		/* Print compiler data structures */
+	bool compat_vars;	/* Keep variables where MikeOS keeps them */
+	bool compat_print;	/* Print strings through BIOS */
+	bool string_lengths;	/* Keep lengths of string variables */
+	int var_align;		/* Alignment of the variable area */
+	int opt_level;		/* One of OptLevel (-O0, -O1, -O2, -Os) */
+	bool time_passes;	/* Print time spent in optimization passes */
+	int outline_min;	/* Keyword code used more often is outlined */
+	bool run;		/* Run compiled program in the emulator */
+	int run_limit;		/* Instructions emulator executes at most */
+	StatsFormat stats;	/* Print timing and counters of compilation */
+	ProfileMode profile;	/* Run and print where the time went */
+	const char* folded;	/* File for folded GOSUB stacks of -profile */
+	bool instrument;	/* Count executions of every statement */
+	const char* counter_map;	/* File mapping counters to lines */
+	const char* counter_dump;	/* File for counters after -run */
+	const char* map;	/* File for addresses of labels and lines */
+	bool size_report;	/* Print where bytes of the output went */
+	int max_size;		/* Fail if output is bigger (0 - no limit) */
+} Options;
+
+/* Options of current compilation (set by parse_options()) */
+extern Options options;
+
+/* Parse command line, returns false if it was invalid */
+bool parse_options(int argc, char** argv);
+void print_usage();
+
+#endif
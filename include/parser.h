@@ -35,9 +35,11 @@ Node* for_stmt();
 Node* parse_keyword();
 Node* statement();
 
-/* Here are proper functions: one for parsing, two for node managment */
+/* Here are proper functions: one for parsing, three for node managment */
 Node* parse(SymbolTable* t, StringTable* s);
 void print_node(Node* n, int lvl);
 void free_node(Node* n);
+Node* copy_node(Node* n);	/* Deep copy */
+long count_nodes(Node* n);
 
 #endif
@@ -19,10 +19,45 @@ void make_exit(CompileTarget* code);
 /* Handle division by zero */
 void zero_divide_handler(CompileTarget* code);
 
-/* SI = SI + DI (original strings are left unmodified) */
-void add_strings(CompileTarget* code);
-
-/* Print SI, using WORKPAGE and INK */
+/* Print SI, using WORKPAGE and INK (through BIOS with -compat-print) */
 void print_string(CompileTarget* code);
 
+/* ============================ SHARED SEQUENCES ============================ */
+/* Those are emitted inline, or once as a helper when outlined */
+void emit_print(CompileTarget* code);		/* CALL print_string */
+void emit_newline(CompileTarget* code);		/* Print newline */
+void emit_file_list(CompileTarget* code);	/* FILES */
+void emit_delete_file(CompileTarget* code);	/* DELETE SI, sets R */
+void emit_input_number(CompileTarget* code);	/* AX = number from user */
+void emit_random(CompileTarget* code);		/* AX = next random number */
+
+/* ============================ RUNTIME HELPERS ============================= */
+/* Helpers are emitted after the program, only if something calls them */
+typedef enum {
+	HELPER_NEWLINE = 0,	/* Print newline */
+	HELPER_GETKEY = 1,	/* AX = key (GETKEY translation) */
+	HELPER_WAITKEY = 2,	/* AX = key (WAITKEY translation) */
+	HELPER_FILES = 3,	/* Print list of files */
+	HELPER_DELETE = 4,	/* Delete file named SI, set R */
+	HELPER_INPUT = 5,	/* AX = number from user, print newline */
+	HELPER_SCROLL = 6,	/* Scroll working page (for print_string) */
+	HELPER_JOIN = 7,	/* SI = DI + SI with lengths (-string-lengths) */
+	HELPER_COPY = 8,	/* Copy string SI to DI */
+	HELPER_COMPARE = 9,	/* ZF = 1 if strings SI and DI are equal */
+	HELPER_RANDOM = 10,	/* AX = next random number */
+	HELPER_DECIMAL = 11,	/* SI = AX in decimal, written at DI */
+	HELPER_HEX = 12,	/* SI = AX in hexadecimal, written at DI */
+	HELPER_COUNT
+} HelperId;
+
+/* Forget which helpers were outlined (once per compilation) */
+void init_helpers();
+
+/* Keyword sequence used uses times should be called instead of inlined */
+void outline_helper(HelperId id, int uses);
+bool is_outlined(HelperId id);
+
+/* Emit all called helpers and patch calls to them */
+void emit_helpers(CompileTarget* code);
+
 #endif
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+/* Standard library includes */
+#include <stddef.h>
+
+/* Custom includes */
+#include <table.h>
+#include <codegen.h>
+
+/* Phases of compilation timed by -stats */
+typedef enum {
+	STAT_READ = 0,		/* Reading source file */
+	STAT_INCLUDE = 1,	/* init_lexer(), reads included files */
+	STAT_LEX = 2,		/* Pass through all tokens (only with -stats) */
+	STAT_PARSE = 3,		/* parse(), lexes the source again as it goes */
+	STAT_CODEGEN = 4,	/* compile(), optimization passes included */
+	STAT_WRITE = 5,		/* Writing output file */
+	STAT_COUNT
+} StatPhase;
+
+typedef struct {
+	double time[STAT_COUNT];	/* Wall time of phases (seconds) */
+	long tokens;		/* Tokens in source (with included files) */
+	long nodes;		/* Nodes of AST */
+	int symbols;		/* Entries of symbol table (labels) */
+	int strings;		/* Entries of string table */
+	int string_bytes;	/* Bytes of string table */
+	int patches;		/* Jumps to labels patched by codegen */
+	int relocs;		/* References to data areas */
+	size_t heap_peak;	/* Most bytes compiler had allocated at once */
+	long allocs;		/* Allocations (and reallocations) */
+	int runtime;		/* Bytes of fixed runtime (with JMP over it) */
+	int program;		/* Bytes of compiled statements */
+	int helpers;		/* Bytes of runtime helpers */
+	int total;		/* Bytes of whole output file */
+	int data;		/* Bytes of variables after the program */
+} Stats;
+
+/* Counters of current compilation, printed by -stats */
+extern Stats stats;
+
+/* Time a phase, like pass_begin() and pass_end() */
+void stat_begin(StatPhase phase);
+void stat_end(StatPhase phase);
+
+/* Take sizes of tables and code regions after compilation */
+void collect_stats(SymbolTable* sym, StringTable* str, CompileTarget* code);
+
+/* Print as a table (-stats) or as one line of JSON (-stats=json) */
+void print_stats(bool json);
+
+/* Print where bytes of the output went (-size-report, -max-size) */
+void print_size_report(CompileTarget* code);
+
+#endif
@@ -6,9 +6,19 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+/* Standard library includes */
+#include <stddef.h>
+
 void string_uppercase(char* str);
 void raise_error();
 void check_for_error();		/* This will exit whole program */
 char* read_file(const char* filename);
+double wall_time();		/* In seconds, for measurements */
+
+/* Compiler allocates through these, so -stats can tell how much it needs */
+void* mem_alloc(size_t size);
+void* mem_realloc(void* ptr, size_t size);
+void mem_free(void* ptr);
+void mem_usage(size_t* peak, long* allocs);
 
 #endif
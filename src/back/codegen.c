@@ -13,13 +13,23 @@
 #include <table.h>
 #include <codegen.h>
 #include <runtime.h>
+#include <options.h>
+#include <optimize.h>
 #include <util.h>
+#include <stats.h>
 
 static PatchTable* patches;
 static SymbolTable* symbols;
+static bool measuring;		/* Compiling aside only to get size */
+
+extern const char* keywords_names[];
 
 void compile_error(const char* msg, Node* current)
 {
+	/* Error is reported when statement is compiled for real */
+	if (measuring)
+		return;
+
 	printf("\x1B[31mError (codegen)\x1B[0m: %s at line: %d.\n", msg,
 		current->line);
 	raise_error();
@@ -28,7 +38,12 @@ void compile_error(const char* msg, Node* current)
 /* =========================== COMPILER FUNCTIONS =========================== */
 void compile_assign(Node* ast, CompileTarget* code)
 {
-	bool expr = compile_expression(ast->op2, code);
+	/* Concatenation is built right in the variable */
+	if (ast->op1->attribute == TOKEN_STRING_VARIABLE &&
+	    emit_concat(ast->op2, ast->op1->val, code))
+		return;
+
+	bool expr = compile_sized(ast->op2, code);
 	bool type = (ast->op1->attribute == TOKEN_NUMERIC_VARIABLE) ?
 			true : false;
 
@@ -40,19 +55,28 @@ void compile_assign(Node* ast, CompileTarget* code)
 
 	/* It is a numeric assignment */
 	if (expr) {
-		uint16_t addr = VARS + ast->op1->val * 2;
 		emit_byte(code, 0x89);	/* MOV */
 		emit_byte(code, 0x06);	/* [addr], AX */
-		emit_word(code, addr);
+		emit_var(code, ast->op1->val);
 	}
 	else {
-		uint16_t addr = STRVARS + ast->op1->val * 128;
 		emit_byte(code, 0xC7);	/* MOV */
 		emit_byte(code, 0xC7);	/* DI, */
-		emit_word(code, addr);	/* addr */
+		emit_strvar(code, ast->op1->val);	/* addr */
+
+		/* Length is known, copy it with terminator by REP MOVSB */
+		if (options.string_lengths) {
+			emit_byte(code, 0x89);	/* MOV */
+			emit_byte(code, 0x0E);	/* [addr], CX */
+			emit_strlen(code, ast->op1->val);
+			emit_byte(code, 0x41);	/* INC CX */
+			emit_byte(code, 0xF3);	/* REP */
+			emit_byte(code, 0xA4);	/* MOVSB */
+			return;
+		}
 
 		/* Copy string into variable */
-		emit_call(code, 0x0039);
+		emit_copy(ast->op2, code);
 	}
 }
 
@@ -72,6 +96,7 @@ void compile_if(Node* ast, CompileTarget* code)
 
 	/* Compile THEN branch */
 	compile_ast(ast->op2->op1, code);
+	add_line(code, ast->line, "IF");
 
 	/* Jump over ELSE branch (and patch the jump) */
 	emit_byte(code, 0xE9);		/* JMP NEAR */
@@ -95,6 +120,7 @@ void compile_do(Node* ast, CompileTarget* code)
 	/* Compile the body first */
 	uint16_t start = code->length;
 	compile_ast(ast->op2->op1, code);
+	add_line(code, ast->op1 != NULL ? ast->op1->line : ast->line, "DO");
 
 	/* Now we need to check if there is a condition */
 	if (ast->op1 == NULL)
@@ -127,8 +153,7 @@ void compile_do(Node* ast, CompileTarget* code)
 
 void compile_for(Node* ast, CompileTarget* code)
 {
-	int var_num = ast->op1->op1->val;
-	uint16_t var = VARS + var_num * 2;
+	int var = ast->op1->op1->val;
 
 	/* Compile initializer */
 	compile_assign(ast->op1, code);
@@ -138,9 +163,10 @@ void compile_for(Node* ast, CompileTarget* code)
 
 	/* Compile the body and NEXT */
 	compile_ast(ast->op2->op2, code);
+	add_line(code, ast->line, "FOR");
 	emit_byte(code, 0xFF);				/* INC */
 	emit_byte(code, 0x06);				/* [imm16] */
-	emit_word(code, var);
+	emit_var(code, var);
 
 	/* Compile "TO" field */
 	bool to = compile_expression(ast->op2->op1, code);
@@ -154,7 +180,7 @@ void compile_for(Node* ast, CompileTarget* code)
 	/* Perform bound check */
 	emit_byte(code, 0x8B);				/* MOV */
 	emit_byte(code, 0x06);				/* AX, */
-	emit_word(code, var);				/* [imm16] */
+	emit_var(code, var);				/* [imm16] */
 	emit_byte(code, 0x3B);				/* CMP */
 	emit_byte(code, 0xD8);				/* BX, AX */
 	emit_byte(code, 0x0F);				/* JGE NEAR */
@@ -164,6 +190,90 @@ void compile_for(Node* ast, CompileTarget* code)
 	emit_word(code, rel);
 }
 
+/* ============================= DATA PLACEMENT ============================= */
+static uint16_t align_up(uint32_t addr, int align)
+{
+	return (addr + align - 1) & ~(uint32_t) (align - 1);
+}
+
+/* Place data areas (MikeOS' addresses or aligned after the program) */
+static void place_data(CompileTarget* code, int temps)
+{
+	uint32_t end = LOAD + code->length;
+	int align = options.var_align;
+	code->area_sizes[AREA_VARS] = VARSLEN;
+	code->area_sizes[AREA_STRVARS] = STRVARSLEN;
+
+	if (options.compat_vars) {
+		code->areas[AREA_VARS] = MIKEOSVARS;
+		code->areas[AREA_STRVARS] = MIKEOSSTRVARS;
+	}
+	else {
+		uint32_t vars = align_up(end, align);
+		uint32_t strvars = align_up(vars + VARSLEN, align);
+		end = align_up(strvars + STRVARSLEN, align);
+
+		code->areas[AREA_VARS] = vars;
+		code->areas[AREA_STRVARS] = strvars;
+	}
+
+	/* Temporaries always follow everything else */
+	if (temps > 0) {
+		uint32_t tmp = align_up(end, align);
+		end = align_up(tmp + temps * 2, align);
+		code->areas[AREA_TEMPS] = tmp;
+		code->area_sizes[AREA_TEMPS] = temps * 2;
+	}
+
+	/* Lengths of -string-lengths are the program's own even with
+	 * -compat-vars, MikeOS doesn't know about them */
+	if (options.string_lengths) {
+		uint32_t lens = align_up(end, align);
+		end = align_up(lens + STRLENSLEN, align);
+		code->areas[AREA_STRLENS] = lens;
+		code->area_sizes[AREA_STRLENS] = STRLENSLEN;
+	}
+
+	/* Counters of -instrument go last, so that dump of them is easy */
+	int counters = code->counters.length;
+	if (counters > 0) {
+		uint32_t cnt = align_up(end, align);
+		end = align_up(cnt + counters * 2, align);
+		code->areas[AREA_COUNTERS] = cnt;
+		code->area_sizes[AREA_COUNTERS] = counters * 2;
+	}
+
+	if (end > 0xFFFF) {
+		printf("\x1B[31mError (codegen)\x1B[0m: Program and its "
+			"variables don't fit in memory.\n");
+		raise_error();
+		return;
+	}
+
+	code->ramstart = end;
+	relocate(code);
+}
+
+/* Zero the counter table, returns offset of the count to fill in later */
+static uint16_t clear_counters(CompileTarget* code)
+{
+	uint16_t start = code->length;
+
+	/* AX is still zero after the prologue */
+	emit_byte(code, 0xC7);		/* MOV */
+	emit_byte(code, 0xC7);		/* DI, */
+	emit_data(code, AREA_COUNTERS, 0);	/* COUNTERS */
+	emit_byte(code, 0xC7);		/* MOV */
+	emit_byte(code, 0xC1);		/* CX, */
+	uint16_t count_at = code->length;
+	emit_word(code, 0x0000);	/* Number of counters */
+	emit_byte(code, 0xF3);		/* REP */
+	emit_byte(code, 0xAB);		/* STOSW */
+
+	add_range(code, "counters", start);
+	return count_at;
+}
+
 /* =========================== MAIN CODE GENERATOR ========================== */
 typedef void (*CompileFuncPtr)(Node*, CompileTarget*);
 static CompileFuncPtr node_compiler[] = {
@@ -175,27 +285,64 @@ static CompileFuncPtr node_compiler[] = {
 	[NODE_IF] = compile_if,
 	[NODE_DO] = compile_do,
 	[NODE_FOR] = compile_for,
-	[NODE_KEYWORD_CALL] = compile_keyword
+	[NODE_KEYWORD_CALL] = compile_keyword,
+	[NODE_TEMP] = NULL	/* Only valid inside of expressions */
 };
 
+/* What code of a statement is attributed to (-size-report) */
+static const char* statement_kind(Node* ast)
+{
+	switch (ast->type) {
+		case NODE_ASSIGN: return "ASSIGN";
+		case NODE_IF: return "IF";
+		case NODE_DO: return "DO";
+		case NODE_FOR: return "FOR";
+		case NODE_KEYWORD_CALL: return keywords_names[ast->attribute];
+		default: return NULL;
+	}
+}
+
 /* Generate code proper, with no prologue */
 void compile_ast(Node* ast, CompileTarget* code)
 {
+	/* Sequences are compiled in a loop, programs can be long */
+	while (ast != NULL && ast->type == NODE_SEQUENCE) {
+		patch_jumps(code, patches, symbols, ast);
+		compile_ast(ast->op1, code);
+		ast = ast->op2;
+	}
+
 	/* When you hit empty node, just return */
 	if (ast == NULL)
 		return;
 
 	patch_jumps(code, patches, symbols, ast);
+	add_line(code, ast->line, statement_kind(ast));
+	if (options.instrument)
+		emit_counter(code, ast->line);
 
-	/* Now select what to do */
-	if (ast->type == NODE_SEQUENCE) {
-		compile_ast(ast->op1, code);
-		compile_ast(ast->op2, code);
-	}
-	else {
-		CompileFuncPtr rule = node_compiler[ast->type];
-		rule(ast, code);
-	}
+	CompileFuncPtr rule = node_compiler[ast->type];
+	rule(ast, code);
+}
+
+int measure_ast(Node* ast)
+{
+	/* Jumps of the real program must not be patched into scratch code */
+	PatchTable saved = *patches;
+	init_patch(patches);
+	measuring = true;
+
+	CompileTarget scratch;
+	init_code(&scratch);
+	compile_ast(ast, &scratch);
+	int len = scratch.length;
+	free_code(&scratch);
+
+	measuring = false;
+	free_patch(patches);
+	*patches = saved;
+
+	return len;
 }
 
 void compile(Node* ast, CompileTarget* code, StringTable* str, SymbolTable* t)
@@ -207,18 +354,43 @@ void compile(Node* ast, CompileTarget* code, StringTable* str, SymbolTable* t)
 
 	init_expr_compiler(str);
 	init_kword_compiler(str, t, &p);
+
+	/* Run optimizations on the AST */
+	init_helpers();
+	PassContext ctx = { .ast = ast, .sym = t, .str = str };
+	run_passes(&ctx);
+
 	make_entry(code, str);
+	uint16_t count_at = 0;
+	if (options.instrument)
+		count_at = clear_counters(code);
 	compile_ast(ast, code);
 
 	/* If program doesn't have END, add one */
-	if ((uint8_t) code->code[code->length - 1] != 0xC3)
+	if ((uint8_t) code->code[code->length - 1] != 0xC3) {
+		uint16_t start = code->length;
 		make_exit(code);
+		add_range(code, "exit", start);
+	}
+
+	/* Runtime helpers go after the program */
+	code->helpers_at = code->length;
+	emit_helpers(code);
+
+	/* Number of counters is known only now */
+	if (options.instrument) {
+		int n = code->counters.length;
+		code->code[count_at] = (uint8_t) n & 0xFF;
+		code->code[count_at + 1] = (uint8_t) (n >> 8) & 0xFF;
+	}
 
-	/* Fix RAMSTART */
-	uint16_t ramstart = LOAD + code->length;
+	/* Place variables and fix RAMSTART */
+	place_data(code, ctx.temps);
+	uint16_t ramstart = code->ramstart;
 	code->code[RAMSTART - LOAD] = (uint8_t) ramstart & 0xFF;
 	code->code[RAMSTART + 1 - LOAD] = (uint8_t) (ramstart >> 8) & 0xFF;
 
+	stats.patches = p.length;
 	free_patch(&p);
 	patches = NULL;
 }
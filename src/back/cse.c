@@ -0,0 +1,452 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Custom includes */
+#include <ast.h>
+#include <parser.h>
+#include <table.h>
+#include <codegen.h>
+#include <options.h>
+#include <optimize.h>
+#include <util.h>
+
+extern const char* keywords_names[];
+
+/* Every value computed in current basic block gets an entry. Value number of
+ * an expression is an index into this table */
+typedef struct {
+	int op;			/* Operator (or type of leaf) */
+	int a;			/* Value numbers of operands (or leaf data) */
+	int b;
+	Node* def;		/* First computation (NULL for leaves) */
+	int temp;		/* Temporary holding it (-1 if none yet) */
+} ValueTableEntry;
+
+typedef struct {
+	ValueTableEntry* table;	/* Array of values */
+	int len;		/* Its length */
+	int capacity;		/* Dynamic array once again */
+} ValueTable;
+
+static ValueTable values;
+static SymbolTable* symbols;
+
+/* Variables get new version on every write (INK is pseudo-variable 26) */
+#define INKVAR 26
+static int versions[INKVAR + 1];
+static int next_version;
+
+static int temps;		/* Temporaries used in current block */
+static int max_temps;		/* Temporaries used in whole program */
+
+/* ================================ UTILITY ================================= */
+static bool is_operator(Node* n)
+{
+	return n->type == NODE_EXPR && (n->attribute == TOKEN_PLUS ||
+		n->attribute == TOKEN_MINUS || n->attribute == TOKEN_STAR ||
+		n->attribute == TOKEN_SLASH || n->attribute == TOKEN_PERCENT);
+}
+
+static int count_operators(Node* n)
+{
+	if (n == NULL || n->type == NODE_TEMP || !is_operator(n))
+		return 0;
+
+	return 1 + count_operators(n->op1) + count_operators(n->op2);
+}
+
+/* Bytes of code the expression compiles to */
+static int expression_size(Node* n)
+{
+	CompileTarget scratch;
+	init_code(&scratch);
+	compile_expression(n, &scratch);
+	int len = scratch.length;
+	free_code(&scratch);
+
+	return len;
+}
+
+/* Write expression the way it would look in the source */
+static int describe(Node* n, char* buf, int size)
+{
+	if (size <= 1)
+		return 0;
+
+	if (n->type == NODE_TEMP)
+		return snprintf(buf, size, "t%d", n->val);
+	if (is_operator(n)) {
+		const char* ops = "+-*/%";
+		int len = describe(n->op1, buf, size);
+		if (len >= size)
+			return len;
+		len += snprintf(buf + len, size - len, " %c ",
+			ops[n->attribute - TOKEN_PLUS]);
+		if (len >= size)
+			return len;
+		return len + describe(n->op2, buf + len, size - len);
+	}
+
+	switch (n->attribute) {
+		case TOKEN_NUMERIC_VARIABLE:
+			return snprintf(buf, size, "%c", 'a' + n->val);
+		case TOKEN_CHARACTER_LITERAL:
+			return snprintf(buf, size, "'%c'", n->val);
+		case TOKEN_AMPERSAND:
+			if (n->op1->attribute == TOKEN_NUMERIC_VARIABLE)
+				return snprintf(buf, size, "&%c",
+					'a' + n->op1->val);
+			return snprintf(buf, size, "&$%d", n->op1->val + 1);
+		case TOKEN_NUMERIC_LITERAL:
+			return snprintf(buf, size, "%d", n->val);
+		default:
+			return snprintf(buf, size, "%s",
+				keywords_names[n->attribute]);
+	}
+}
+
+/* =============================== VALUE TABLE ============================== */
+static int find_value(int op, int a, int b)
+{
+	for (int i = 0; i < values.len; i++) {
+		ValueTableEntry* e = &values.table[i];
+		if (e->op == op && e->a == a && e->b == b)
+			return i;
+	}
+
+	return -1;
+}
+
+static int add_value(int op, int a, int b, Node* def)
+{
+	if (values.capacity < values.len + 1) {
+		values.capacity *= 2;
+		values.table = mem_realloc(values.table, values.capacity *
+					sizeof(ValueTableEntry));
+	}
+
+	values.table[values.len].op = op;
+	values.table[values.len].a = a;
+	values.table[values.len].b = b;
+	values.table[values.len].def = def;
+	values.table[values.len].temp = -1;
+	values.len++;
+
+	return values.len - 1;
+}
+
+/* End of basic block, nothing computed is available anymore */
+static void reset()
+{
+	values.len = 0;
+	temps = 0;
+}
+
+/* Variable was written, values computed from it are stale */
+static void clobber(Node* var)
+{
+	if (var != NULL && var->attribute == TOKEN_NUMERIC_VARIABLE)
+		versions[var->val] = ++next_version;
+}
+
+/* ============================ VALUE NUMBERING ============================= */
+/* Describe leaf as a key, returns false if it is impure or a string */
+static bool leaf_key(Node* n, int* op, int* a, int* b)
+{
+	*op = n->attribute;
+	*a = 0;
+	*b = 0;
+
+	switch (n->attribute) {
+		case TOKEN_NUMERIC_VARIABLE:
+			*a = n->val;
+			*b = versions[n->val];
+			return true;
+		case TOKEN_NUMERIC_LITERAL:
+		case TOKEN_CHARACTER_LITERAL:
+			*op = TOKEN_NUMERIC_LITERAL;
+			*a = n->val;
+			return true;
+		case TOKEN_AMPERSAND:
+			*a = n->op1->attribute;
+			*b = n->op1->val;
+			return true;
+		case TOKEN_INK:
+			*b = versions[INKVAR];
+			return true;
+		case TOKEN_PROGSTART:
+		case TOKEN_RAMSTART:
+		case TOKEN_VARIABLES:
+		case TOKEN_VERSION:
+			return n->type == NODE_KEYWORD_CALL;
+		default:
+			return false;	/* TIMER, strings and the rest */
+	}
+}
+
+/* Find value number without adding anything, -1 if not computed yet */
+static int lookup(Node* n)
+{
+	int op, a, b;
+
+	if (n == NULL || n->type == NODE_TEMP)
+		return -1;
+
+	if (is_operator(n)) {
+		op = n->attribute;
+		a = lookup(n->op1);
+		b = lookup(n->op2);
+		if (a == -1 || b == -1)
+			return -1;
+	}
+	else if (!leaf_key(n, &op, &a, &b))
+		return -1;
+
+	/* Operands of commutative operators are kept sorted */
+	if ((op == TOKEN_PLUS || op == TOKEN_STAR) && a > b) {
+		int t = a;
+		a = b;
+		b = t;
+	}
+
+	return find_value(op, a, b);
+}
+
+/* Replace n by temporary holding value number vn */
+static void reuse(int vn, Node* n)
+{
+	ValueTableEntry* e = &values.table[vn];
+	int saved = expression_size(n) - 4;	/* MOV AX, [temp] */
+
+	/* First reuse, make first computation save its result */
+	if (e->temp == -1) {
+		saved -= 4;				/* MOV [temp], AX */
+
+		Node* def = e->def;
+		Node* inner = mem_alloc(sizeof(Node));
+		*inner = *def;
+
+		e->temp = temps++;
+		if (temps > max_temps)
+			max_temps = temps;
+
+		def->type = NODE_TEMP;
+		def->val = e->temp;
+		def->op1 = inner;
+		def->op2 = NULL;
+	}
+
+	if (options.debug) {
+		char expr[64];
+		describe(n, expr, sizeof(expr));
+		printf("\x1B[36mCSE\x1B[0m: line %d: reused \"%s\" from line "
+			"%d as t%d (%d operations eliminated)\n", n->line,
+			expr, e->def->line, e->temp, count_operators(n));
+	}
+
+	pass_saved(PASS_CSE, saved);
+
+	/* Now turn n into load of the temporary */
+	free_node(n->op1);
+	free_node(n->op2);
+	n->type = NODE_TEMP;
+	n->val = e->temp;
+	n->op1 = NULL;
+	n->op2 = NULL;
+}
+
+/* Number expression in evaluation order, returns -1 if it can't be reused */
+static int number(Node* n)
+{
+	int op, a, b;
+
+	if (n == NULL || n->type == NODE_TEMP)
+		return -1;
+
+	if (!is_operator(n)) {
+		/* Comparisons and AND are walked, but never reused */
+		if (n->type == NODE_EXPR && n->attribute != TOKEN_AMPERSAND) {
+			number(n->op1);
+
+			/* Right side of AND is evaluated conditionally, what
+			   it computes can't be used after it */
+			int len = values.len;
+			number(n->op2);
+			if (n->attribute == TOKEN_AND)
+				values.len = len;
+			return -1;
+		}
+
+		if (!leaf_key(n, &op, &a, &b))
+			return -1;
+
+		int vn = find_value(op, a, b);
+		return vn != -1 ? vn : add_value(op, a, b, NULL);
+	}
+
+	/* Maybe whole expression was already computed? */
+	int vn = lookup(n);
+	if (vn != -1 && values.table[vn].def != NULL) {
+		reuse(vn, n);
+		return vn;
+	}
+
+	a = number(n->op1);
+	b = number(n->op2);
+	if (a == -1 || b == -1)
+		return -1;
+
+	if ((n->attribute == TOKEN_PLUS || n->attribute == TOKEN_STAR) &&
+	    a > b) {
+		int t = a;
+		a = b;
+		b = t;
+	}
+
+	return add_value(n->attribute, a, b, n);
+}
+
+/* ============================== STATEMENTS ================================ */
+static void keyword(Node* n)
+{
+	switch (n->attribute) {
+		/* Those don't write numeric variables */
+		case TOKEN_ALERT:
+		case TOKEN_ASKFILE:
+		case TOKEN_CASE:
+		case TOKEN_CLS:
+		case TOKEN_CURSOR:
+		case TOKEN_MOVE:
+		case TOKEN_PAGE:
+		case TOKEN_PAUSE:
+		case TOKEN_RANDOMIZE:
+		case TOKEN_SOUND:
+			break;
+
+		case TOKEN_PRINT:
+			number(n->op2->op1);
+			break;
+		case TOKEN_INK:
+			versions[INKVAR] = ++next_version;
+			break;
+
+		/* Those write only their targets */
+		case TOKEN_CURSCHAR:
+		case TOKEN_CURSCOL:
+		case TOKEN_GETKEY:
+		case TOKEN_INPUT:
+		case TOKEN_PEEK:
+		case TOKEN_PEEKINT:
+		case TOKEN_RAND:
+		case TOKEN_WAITKEY:
+			clobber(n->op1);
+			break;
+		case TOKEN_CURSPOS:
+			clobber(n->op1);
+			clobber(n->op2);
+			break;
+		case TOKEN_LEN:
+		case TOKEN_NUMBER:
+		case TOKEN_SERIAL:
+			clobber(n->op2);
+			break;
+		case TOKEN_LISTBOX:
+			clobber(n->op2->op2->op2);
+			break;
+		case TOKEN_PORT:
+			clobber(n->op2->op2);
+			break;
+		case TOKEN_DELETE:
+		case TOKEN_RENAME:
+		case TOKEN_SAVE:
+			versions['r' - 'a'] = ++next_version;
+			break;
+		case TOKEN_SIZE:
+			versions['r' - 'a'] = ++next_version;
+			versions['s' - 'a'] = ++next_version;
+			break;
+
+		/* Control flow, or anything writing to memory ends block */
+		case TOKEN_CALL:
+			number(n->op1);
+			reset();
+			break;
+		default:
+			reset();
+			break;
+	}
+}
+
+static void block(Node* n)
+{
+	/* Labelled statement starts new basic block */
+	for (; n != NULL && n->type == NODE_SEQUENCE; n = n->op2) {
+		if (find_symbol(symbols, n) != -1)
+			reset();
+		block(n->op1);
+	}
+
+	if (n == NULL)
+		return;
+	if (find_symbol(symbols, n) != -1)
+		reset();
+
+	switch (n->type) {
+		case NODE_ASSIGN:
+			number(n->op2);
+			clobber(n->op1);
+			break;
+		case NODE_IF:
+			number(n->op1);
+			reset();
+			block(n->op2->op1);
+			reset();
+			block(n->op2->op2);
+			reset();
+			break;
+		case NODE_DO:
+			reset();
+			block(n->op2->op1);
+			number(n->op1);
+			reset();
+			break;
+		case NODE_FOR:
+			number(n->op1->op2);
+			clobber(n->op1->op1);
+			reset();
+			block(n->op2->op2);
+			clobber(n->op1->op1);
+			number(n->op2->op1);
+			reset();
+			break;
+		case NODE_KEYWORD_CALL:
+			keyword(n);
+			break;
+		default:
+			break;
+	}
+}
+
+int eliminate_subexpressions(Node* ast, SymbolTable* sym)
+{
+	symbols = sym;
+	values.len = 0;
+	values.capacity = 16;
+	values.table = mem_alloc(values.capacity * sizeof(ValueTableEntry));
+	temps = 0;
+	max_temps = 0;
+
+	block(ast);
+
+	mem_free(values.table);
+	values.table = NULL;
+	values.capacity = 0;
+
+	return max_temps;
+}
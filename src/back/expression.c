@@ -3,15 +3,105 @@
  * Licensed under GNU General Public License version 3.
  */
 
+/* Standard library includes */
+#include <stddef.h>
+
 /* Custom includes */
 #include <lexer.h>
 #include <codegen.h>
+#include <runtime.h>
+#include <options.h>
+#include <optimize.h>
 
 static StringTable* strings;
 
+/* Bytes of string literal with terminator, 0 if it isn't a literal */
+static int literal_size(Node* ast)
+{
+	if (ast == NULL || ast->attribute != TOKEN_STRING_LITERAL)
+		return 0;
+	return strings->table[ast->val].len + 1;
+}
+
+/* Compare strings in DI (of op1) and SI (of op2), returns Jcc taken when
+ * they are equal */
+static uint8_t compare_strings(Node* ast, CompileTarget* code)
+{
+	/* Lengths are equal, so only that many bytes can differ */
+	if (options.string_lengths) {
+		emit_byte(code, 0x3B);		/* CMP */
+		emit_byte(code, 0xCA);		/* CX, DX */
+		emit_byte(code, 0x75);		/* JNE */
+		emit_byte(code, 0x02);		/* Over CMPSB (ZF = 0) */
+		emit_byte(code, 0xF3);		/* REPE */
+		emit_byte(code, 0xA6);		/* CMPSB */
+		return 0x74;			/* JE */
+	}
+
+	/* MikeOS' routine costs no bytes of the program */
+	if (options.opt_level == OPT_OS) {
+		/* CALL os_string_compare */
+		emit_call(code, 0x0045);
+		return 0x72;			/* JC */
+	}
+
+	/* Comparing terminator of a literal stops at the shorter one */
+	int a = literal_size(ast->op1);
+	int b = literal_size(ast->op2);
+	int size = (a == 0 || (b != 0 && b < a)) ? b : a;
+	if (size == 0) {
+		emit_helper_call(code, HELPER_COMPARE);
+		return 0x74;			/* JE */
+	}
+
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC1);			/* CX, */
+	emit_word(code, size);			/* imm16 */
+	emit_byte(code, 0xF3);			/* REPE */
+	emit_byte(code, 0xA6);			/* CMPSB */
+	return 0x74;				/* JE */
+}
+
+/* Right side of = or !=, left string stays in DI (and its length in DX) */
+static bool compile_right(Node* ast, bool numeric, CompileTarget* code)
+{
+	/* Concatenation builds its result with DI (and DX) */
+	bool keep = !numeric && ast->type == NODE_EXPR;
+	if (keep) {
+		emit_byte(code, 0x57);		/* PUSH DI */
+		if (options.string_lengths)
+			emit_byte(code, 0x52);	/* PUSH DX */
+	}
+
+	bool b = compile_sized(ast, code);
+
+	if (keep) {
+		if (options.string_lengths)
+			emit_byte(code, 0x5A);	/* POP DX */
+		emit_byte(code, 0x5F);		/* POP DI */
+	}
+	return b;
+}
+
 /* Return true if is numeric, false if string */
 bool compile_expression(Node* ast, CompileTarget* code)
 {
+	/* Temporaries hold results of common subexpressions */
+	if (ast->type == NODE_TEMP) {
+		if (ast->op1 == NULL) {
+			emit_byte(code, 0x8B);			/* MOV */
+			emit_byte(code, 0x06);			/* AX, */
+			emit_data(code, AREA_TEMPS, ast->val * 2);
+			return true;
+		}
+
+		compile_expression(ast->op1, code);
+		emit_byte(code, 0x89);				/* MOV */
+		emit_byte(code, 0x06);				/* [imm16], AX */
+		emit_data(code, AREA_TEMPS, ast->val * 2);
+		return true;
+	}
+
 	switch (ast->attribute) {
 		/* Keyword values: */
 		case TOKEN_INK: {
@@ -44,7 +134,7 @@ bool compile_expression(Node* ast, CompileTarget* code)
 		case TOKEN_VARIABLES: {
 			emit_byte(code, 0xC7);			/* MOV */
 			emit_byte(code, 0xC0);			/* AX, */
-			emit_word(code, (uint16_t)VARS);	/* imm16 */
+			emit_data(code, AREA_VARS, 0);		/* imm16 */
 			return true;
 		}
 		case TOKEN_VERSION: {
@@ -62,10 +152,9 @@ bool compile_expression(Node* ast, CompileTarget* code)
 			return true;
 		}
 		case TOKEN_NUMERIC_VARIABLE: {
-			uint16_t addr = VARS + ast->val * 2;
 			emit_byte(code, 0x8B);			/* MOV */
 			emit_byte(code, 0x06);			/* AX, */
-			emit_word(code, addr);			/* [imm16] */
+			emit_var(code, ast->val);		/* [imm16] */
 			return true;
 		}
 		case TOKEN_STRING_LITERAL: {
@@ -77,10 +166,9 @@ bool compile_expression(Node* ast, CompileTarget* code)
 			return false;
 		}
 		case TOKEN_STRING_VARIABLE: {
-			uint16_t addr = STRVARS + ast->val * 128;
 			emit_byte(code, 0xC7);			/* MOV */
 			emit_byte(code, 0xC6);			/* SI, */
-			emit_word(code, addr);			/* imm16 */
+			emit_strvar(code, ast->val);		/* imm16 */
 			return false;
 		}
 		case TOKEN_CHARACTER_LITERAL: {
@@ -92,7 +180,10 @@ bool compile_expression(Node* ast, CompileTarget* code)
 
 		/* Numeric / string operators: */
 		case TOKEN_PLUS: {
-			bool a = compile_expression(ast->op1, code);
+			if (emit_concat(ast, -1, code))
+				return false;
+
+			bool a = compile_sized(ast->op1, code);
 
 			/* Save value (numeric to BX, string to DI) */
 			if (a) {
@@ -103,8 +194,12 @@ bool compile_expression(Node* ast, CompileTarget* code)
 				emit_byte(code, 0x8B);		/* MOV */
 				emit_byte(code, 0xFE);		/* DI, SI */
 			}
+			if (!a && options.string_lengths) {
+				emit_byte(code, 0x8B);		/* MOV */
+				emit_byte(code, 0xD1);		/* DX, CX */
+			}
 
-			bool b = compile_expression(ast->op2, code);
+			bool b = compile_sized(ast->op2, code);
 
 			/* Check typing */
 			if (a != b) {
@@ -118,12 +213,10 @@ bool compile_expression(Node* ast, CompileTarget* code)
 				emit_byte(code, 0xC3);		/* AX, BX */
 				return true;
 			}
-			else {
-				emit_byte(code, 0x87);		/* XCHG */
-				emit_byte(code, 0xFE);		/* DI, SI */
-				emit_call(code, STRADD);	/* Call adder */
-				return false;
-			}
+
+			/* Strings with -string-lengths, lengths are known */
+			emit_helper_call(code, HELPER_JOIN);
+			return false;
 		}
 		case TOKEN_MINUS: {
 			bool a = compile_expression(ast->op1, code);
@@ -240,15 +333,12 @@ bool compile_expression(Node* ast, CompileTarget* code)
 			return true;
 		}
 		case TOKEN_AMPERSAND: {
-			uint16_t addr;
-			if (ast->op1->attribute == TOKEN_NUMERIC_VARIABLE)
-				addr = VARS + ast->op1->val * 2;
-			else
-				addr = STRVARS + ast->op1->val * 128;
-
 			emit_byte(code, 0xC7);			/* MOV */
 			emit_byte(code, 0xC0);			/* AX, */
-			emit_word(code, addr);			/* imm16 */
+			if (ast->op1->attribute == TOKEN_NUMERIC_VARIABLE)
+				emit_var(code, ast->op1->val);
+			else
+				emit_strvar(code, ast->op1->val);
 			return true;
 		}
 
@@ -299,7 +389,7 @@ bool compile_expression(Node* ast, CompileTarget* code)
 			return true;
 		}
 		case TOKEN_EQUALS: {
-			bool a = compile_expression(ast->op1, code);
+			bool a = compile_sized(ast->op1, code);
 			/* Save value, depending on string/numeric */
 			if (a) {
 				emit_byte(code, 0x8B);	/* MOV */
@@ -309,8 +399,12 @@ bool compile_expression(Node* ast, CompileTarget* code)
 				emit_byte(code, 0x8B);	/* MOV */
 				emit_byte(code, 0xFE);	/* DI, SI */
 			}
+			if (!a && options.string_lengths) {
+				emit_byte(code, 0x8B);	/* MOV */
+				emit_byte(code, 0xD1);	/* DX, CX */
+			}
 
-			bool b = compile_expression(ast->op2, code);
+			bool b = compile_right(ast->op2, a, code);
 			if (a != b) {
 				compile_error("Type error in expression", ast);
 				return false;
@@ -331,9 +425,8 @@ bool compile_expression(Node* ast, CompileTarget* code)
 				emit_byte(code, 0xC0);	/* AX, AX */
 			}
 			else {
-				/* CALL os_string_compare */
-				emit_call(code, 0x0045);
-				emit_byte(code, 0x72);	/* JC */
+				/* JE or JC */
+				emit_byte(code, compare_strings(ast, code));
 				emit_byte(code, 0x04);	/* Skip != branch */
 				emit_byte(code, 0x33);	/* XOR */
 				emit_byte(code, 0xC0);	/* AX, AX */
@@ -404,7 +497,7 @@ bool compile_expression(Node* ast, CompileTarget* code)
 			return true;
 		}
 		case TOKEN_NOT_EQUALS: {
-			bool a = compile_expression(ast->op1, code);
+			bool a = compile_sized(ast->op1, code);
 			/* Save value, depending on string/numeric */
 			if (a) {
 				emit_byte(code, 0x8B);	/* MOV */
@@ -414,8 +507,12 @@ bool compile_expression(Node* ast, CompileTarget* code)
 				emit_byte(code, 0x8B);	/* MOV */
 				emit_byte(code, 0xFE);	/* DI, SI */
 			}
+			if (!a && options.string_lengths) {
+				emit_byte(code, 0x8B);	/* MOV */
+				emit_byte(code, 0xD1);	/* DX, CX */
+			}
 
-			bool b = compile_expression(ast->op2, code);
+			bool b = compile_right(ast->op2, a, code);
 			if (a != b) {
 				compile_error("Type error in expression", ast);
 				return false;
@@ -436,9 +533,8 @@ bool compile_expression(Node* ast, CompileTarget* code)
 				emit_word(code, 0x0001);/* 1 */
 			}
 			else {
-				/* CALL os_string_compare */
-				emit_call(code, 0x0045);
-				emit_byte(code, 0x72);	/* JC */
+				/* JE or JC */
+				emit_byte(code, compare_strings(ast, code));
 				emit_byte(code, 0x06);	/* Skip != branch */
 				emit_byte(code, 0xC7);	/* MOV */
 				emit_byte(code, 0xC0);	/* AX, */
@@ -461,6 +557,172 @@ bool compile_expression(Node* ast, CompileTarget* code)
 	return false;
 }
 
+/* ============================= CONCATENATION ============================== */
+static bool is_concat(Node* ast)
+{
+	return ast->type == NODE_EXPR && ast->attribute == TOKEN_PLUS;
+}
+
+/* Concatenation of strings (the leftmost piece tells) */
+static bool is_string_concat(Node* ast)
+{
+	Node* first = ast;
+	while (is_concat(first))
+		first = first->op1;
+	return first != ast && (first->attribute == TOKEN_STRING_LITERAL ||
+		first->attribute == TOKEN_STRING_VARIABLE);
+}
+
+static int count_uses(Node* ast, int var)
+{
+	if (is_concat(ast))
+		return count_uses(ast->op1, var) + count_uses(ast->op2, var);
+	return ast->attribute == TOKEN_STRING_VARIABLE && ast->val == var;
+}
+
+/* Append piece to DI, which stays at the terminator unless it is the last */
+static void append_piece(Node* ast, bool last, CompileTarget* code)
+{
+	if (is_concat(ast)) {
+		append_piece(ast->op1, false, code);
+		append_piece(ast->op2, last, code);
+		return;
+	}
+
+	int size = literal_size(ast);
+	if (size == 1 && !last)
+		return;
+
+	if (compile_expression(ast, code)) {
+		compile_error("Type error in expression", ast);
+		return;
+	}
+
+	if (size == 0 || options.opt_level == OPT_OS) {
+		emit_helper_call(code, HELPER_COPY);
+		if (!last)
+			emit_byte(code, 0x4F);		/* DEC DI */
+		return;
+	}
+
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC1);			/* CX, */
+	emit_word(code, last ? size : size - 1);	/* imm16 */
+	emit_byte(code, 0xF3);			/* REP */
+	emit_byte(code, 0xA4);			/* MOVSB */
+}
+
+/* Append all pieces but the first one */
+static void append_rest(Node* ast, bool last, CompileTarget* code)
+{
+	if (is_concat(ast->op1))
+		append_rest(ast->op1, false, code);
+	append_piece(ast->op2, last, code);
+}
+
+/* Every piece of concatenation is copied once, right into variable var (or
+ * into STRBUF if var is -1, then SI points to it). Returns false if ast isn't
+ * one, then nothing is emitted */
+bool emit_concat(Node* ast, int var, CompileTarget* code)
+{
+	/* Lengths are kept by the join helper, which appends already */
+	if (options.string_lengths || !is_string_concat(ast))
+		return false;
+
+	/* $1 = $1 + ... appends to the end of $1 */
+	Node* first = ast;
+	while (is_concat(first))
+		first = first->op1;
+	int uses = var < 0 ? 0 : count_uses(ast, var);
+	bool append = uses == 1 && first->attribute == TOKEN_STRING_VARIABLE &&
+		first->val == var;
+
+	/* Other pieces would be overwritten, so build it in STRBUF */
+	bool buffer = var < 0 || (uses > 0 && !append);
+
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC7);			/* DI, */
+	if (buffer)
+		emit_word(code, STRBUF);	/* STRBUF */
+	else
+		emit_strvar(code, var);		/* var */
+
+	if (append) {
+		emit_byte(code, 0x32);		/* XOR */
+		emit_byte(code, 0xC0);		/* AL, AL */
+		emit_byte(code, 0xC7);		/* MOV */
+		emit_byte(code, 0xC1);		/* CX, */
+		emit_word(code, 0xFFFF);	/* Whole segment */
+		emit_byte(code, 0xF2);		/* REPNE */
+		emit_byte(code, 0xAE);		/* SCASB */
+		emit_byte(code, 0x4F);		/* DEC DI */
+
+		/* First piece is there already */
+		append_rest(ast, true, code);
+		return true;
+	}
+
+	append_piece(ast, true, code);
+	if (!buffer)
+		return true;
+
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC6);			/* SI, */
+	emit_word(code, STRBUF);		/* STRBUF */
+	if (var >= 0) {
+		emit_byte(code, 0xC7);		/* MOV */
+		emit_byte(code, 0xC7);		/* DI, */
+		emit_strvar(code, var);		/* var */
+		emit_copy(NULL, code);
+	}
+	return true;
+}
+
+/* Copy string SI (compiled from src) to DI */
+void emit_copy(Node* src, CompileTarget* code)
+{
+	/* MikeOS' routine costs no bytes of the program */
+	if (options.opt_level == OPT_OS) {
+		/* CALL os_string_copy */
+		emit_call(code, 0x0039);
+		return;
+	}
+
+	int size = literal_size(src);
+	if (size == 0) {
+		emit_helper_call(code, HELPER_COPY);
+		return;
+	}
+
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC1);			/* CX, */
+	emit_word(code, size);			/* imm16 */
+	emit_byte(code, 0xF3);			/* REP */
+	emit_byte(code, 0xA4);			/* MOVSB */
+}
+
+/* Strings get their length in CX too, when -string-lengths keeps them */
+bool compile_sized(Node* ast, CompileTarget* code)
+{
+	bool numeric = compile_expression(ast, code);
+	if (numeric || !options.string_lengths)
+		return numeric;
+
+	/* Joined strings have it there already */
+	if (ast->attribute == TOKEN_STRING_LITERAL) {
+		emit_byte(code, 0xC7);			/* MOV */
+		emit_byte(code, 0xC1);			/* CX, */
+		emit_word(code, strings->table[ast->val].len);	/* imm16 */
+	}
+	else if (ast->attribute == TOKEN_STRING_VARIABLE) {
+		emit_byte(code, 0x8B);			/* MOV */
+		emit_byte(code, 0x0E);			/* CX, */
+		emit_strlen(code, ast->val);		/* [imm16] */
+	}
+
+	return false;
+}
+
 void init_expr_compiler(StringTable* str)
 {
 	strings = str;
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Custom includes */
+#include <ast.h>
+#include <parser.h>
+#include <table.h>
+#include <codegen.h>
+#include <options.h>
+#include <optimize.h>
+#include <util.h>
+
+#define INLINE_MAX_STMTS 8	/* Longest subroutine considered */
+#define INLINE_MAX_SIZE 48	/* Biggest body (in bytes) copied to a site */
+#define INLINE_BUDGET 1024	/* How much can whole program grow */
+#define CALL_SIZE 3		/* CALL rel16 replaced by the body */
+
+static SymbolTable* symbols;
+static int growth;		/* Bytes added to the program so far */
+
+/* ================================ UTILITY ================================= */
+static bool is_keyword(Node* n, TokenType kw)
+{
+	return n != NULL && n->type == NODE_KEYWORD_CALL && n->attribute == kw;
+}
+
+/* Body can be copied if nothing jumps into it and it doesn't jump out */
+static bool can_copy(Node* n, Node* entry)
+{
+	if (n == NULL)
+		return true;
+
+	if (n != entry && find_symbol(symbols, n) != -1)
+		return false;
+	if (is_keyword(n, TOKEN_GOTO) || is_keyword(n, TOKEN_GOSUB) ||
+	    is_keyword(n, TOKEN_RETURN))
+		return false;
+
+	return can_copy(n->op1, entry) && can_copy(n->op2, entry);
+}
+
+/* Find top-level sequence node holding statement */
+static Node* find_in_program(Node* program, Node* stmt)
+{
+	for (Node* n = program; n != NULL; n = n->op2)
+		if (n->type == NODE_SEQUENCE && n->op1 == stmt)
+			return n;
+
+	return NULL;
+}
+
+/* Copy statements from start up to RETURN, NULL if it isn't a subroutine */
+static Node* copy_body(Node* start, int* stmts, bool* found)
+{
+	Node* body = NULL;
+	Node** tail = &body;
+
+	*stmts = 0;
+	*found = false;
+	for (Node* n = start; n != NULL; n = n->op2) {
+		if (n->type != NODE_SEQUENCE)
+			break;
+
+		/* End of the subroutine */
+		if (is_keyword(n->op1, TOKEN_RETURN)) {
+			*found = true;
+			return body;
+		}
+
+		if (*stmts == INLINE_MAX_STMTS || !can_copy(n->op1, start->op1))
+			break;
+
+		Token empty = { 0, NULL, 0, n->op1 ? n->op1->line : 0 };
+		*tail = init_node(NODE_SEQUENCE, empty, 0, copy_node(n->op1),
+				NULL);
+		tail = &(*tail)->op2;
+		(*stmts)++;
+	}
+
+	free_node(body);
+	return NULL;
+}
+
+/* Collect all GOSUBs to given label */
+static void find_sites(Node* n, int id, Node*** sites, int* len, int* cap)
+{
+	/* Sequences are walked in a loop */
+	for (; n != NULL && n->type == NODE_SEQUENCE; n = n->op2)
+		find_sites(n->op1, id, sites, len, cap);
+
+	if (n == NULL)
+		return;
+
+	if (is_keyword(n, TOKEN_GOSUB) && n->op1->val == id) {
+		if (*cap < *len + 1) {
+			*cap = *cap ? *cap * 2 : 8;
+			*sites = mem_realloc(*sites, *cap * sizeof(Node*));
+		}
+		(*sites)[(*len)++] = n;
+		return;
+	}
+
+	find_sites(n->op1, id, sites, len, cap);
+	find_sites(n->op2, id, sites, len, cap);
+}
+
+/* Labels of the site go to the first statement of its copied body */
+static void move_labels(Node* site)
+{
+	if (site->op1 == NULL)
+		return;
+
+	for (int i = 0; i < symbols->len; i++)
+		if (symbols->table[i].target == site)
+			symbols->table[i].target = site->op1;
+}
+
+/* ================================ INLINER ================================= */
+static void inline_sub(Node* program, int id)
+{
+	SymbolTableEntry* sub = &symbols->table[id];
+	Node* start = find_in_program(program, sub->target);
+	if (start == NULL)
+		return;
+
+	int stmts;
+	bool found;
+	Node* body = copy_body(start, &stmts, &found);
+	if (!found)
+		return;
+
+	/* Size budget */
+	int size = measure_ast(body);
+	if (size > INLINE_MAX_SIZE) {
+		free_node(body);
+		return;
+	}
+
+	Node** sites = NULL;
+	int len = 0, cap = 0;
+	find_sites(program, id, &sites, &len, &cap);
+
+	for (int i = 0; i < len; i++) {
+		if (growth + size - CALL_SIZE > INLINE_BUDGET)
+			break;
+		growth += size - CALL_SIZE;
+		pass_saved(PASS_INLINE, CALL_SIZE - size);
+
+		if (options.debug)
+			printf("\x1B[36mInline\x1B[0m: line %d: GOSUB %.*s "
+				"(%d statements, %d bytes)\n", sites[i]->line,
+				sub->len, sub->str, stmts, size);
+
+		/* Site becomes sequence of copied statements */
+		Node* copy = copy_node(body);
+		if (copy == NULL) {
+			Token empty = { 0, NULL, 0, sites[i]->line };
+			copy = init_node(NODE_SEQUENCE, empty, 0, NULL, NULL);
+		}
+		free_node(sites[i]->op1);
+		*sites[i] = *copy;
+		mem_free(copy);
+		move_labels(sites[i]);
+	}
+
+	mem_free(sites);
+	free_node(body);
+}
+
+void inline_subroutines(Node* ast, SymbolTable* sym)
+{
+	symbols = sym;
+	growth = 0;
+
+	for (int i = 0; i < sym->len; i++)
+		if (sym->table[i].isreal && sym->table[i].target != NULL)
+			inline_sub(ast, i);
+}
@@ -11,6 +11,8 @@
 #include <table.h>
 #include <codegen.h>
 #include <runtime.h>
+#include <options.h>
+#include <optimize.h>
 
 static SymbolTable* symbols;
 static StringTable* strings;
@@ -34,9 +36,27 @@ void compile_alert(Node* ast, CompileTarget* code)
 	emit_call(code, 0x003C);
 }
 
+/* Length of string variable changed by MikeOS (-string-lengths) */
+static void update_length(CompileTarget* code, int var)
+{
+	if (!options.string_lengths)
+		return;
+
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC0);			/* AX, */
+	emit_strvar(code, var);			/* var */
+
+	/* CALL os_string_length */
+	emit_call(code, 0x002D);
+
+	emit_byte(code, 0x89);			/* MOV */
+	emit_byte(code, 0x06);			/* [imm16], AX */
+	emit_strlen(code, var);			/* var */
+}
+
 void compile_askfile(Node* ast, CompileTarget* code)
 {
-	uint16_t var = STRVARS + ast->op1->val * 128;
+	int var = ast->op1->val;
 
 	/* CALL os_file_selector */
 	emit_call(code, 0x005A);
@@ -45,10 +65,10 @@ void compile_askfile(Node* ast, CompileTarget* code)
 	emit_byte(code, 0xF0);			/* SI, AX */
 	emit_byte(code, 0xC7);			/* MOV */
 	emit_byte(code, 0xC7);			/* DI, */
-	emit_word(code, var);			/* var */
+	emit_strvar(code, var);			/* var */
 
-	/* CALL os_string_copy */
-	emit_call(code, 0x0039);
+	emit_copy(NULL, code);
+	update_length(code, var);
 }
 
 void compile_break(Node* ast, CompileTarget* code)
@@ -80,11 +100,11 @@ void compile_call(Node* ast, CompileTarget* code)
 
 void compile_case(Node* ast, CompileTarget* code)
 {
-	uint16_t var = STRVARS + ast->op2->val * 128;
+	int var = ast->op2->val;
 
 	emit_byte(code, 0xC7);			/* MOV */
 	emit_byte(code, 0xC0);			/* AX, */
-	emit_word(code, var);			/* imm16 */
+	emit_strvar(code, var);			/* imm16 */
 
 	/* CALL os_string_lowercase */
 	if (ast->op1->attribute == TOKEN_LOWER)
@@ -101,6 +121,129 @@ void compile_cls(Node* ast, CompileTarget* code)
 	emit_call(code, 0x0009);
 }
 
+/* Registers, as numbered in ModRM */
+enum { REG_AX = 0, REG_CX = 1, REG_BX = 3, REG_SI = 6, REG_DI = 7 };
+
+/* Address known at compile time (number, &var, VARIABLES or PROGSTART) */
+static bool is_absolute(Node* addr)
+{
+	if (addr->type == NODE_TEMP)
+		return false;
+
+	switch (addr->attribute) {
+		case TOKEN_NUMERIC_LITERAL:
+		case TOKEN_AMPERSAND:
+		case TOKEN_VARIABLES:
+		case TOKEN_PROGSTART:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/* Absolute address itself */
+static void emit_absolute(Node* addr, CompileTarget* code)
+{
+	switch (addr->attribute) {
+		case TOKEN_NUMERIC_LITERAL:
+			emit_word(code, (uint16_t) addr->val);
+			break;
+		case TOKEN_VARIABLES:
+			emit_data(code, AREA_VARS, 0);
+			break;
+		case TOKEN_PROGSTART:
+			emit_word(code, LOAD);
+			break;
+		default:
+			if (addr->op1->attribute == TOKEN_NUMERIC_VARIABLE)
+				emit_var(code, addr->op1->val);
+			else
+				emit_strvar(code, addr->op1->val);
+			break;
+	}
+}
+
+/* Put a primary in register reg (numbered as in ModRM), only the computed ones
+ * (TIMER, temporaries) go through AX */
+static void load_register(Node* n, int reg, CompileTarget* code)
+{
+	if (is_absolute(n)) {
+		emit_byte(code, 0xC7);			/* MOV */
+		emit_byte(code, 0xC0 | reg);		/* reg, */
+		emit_absolute(n, code);			/* imm16 */
+		return;
+	}
+
+	if (n->attribute == TOKEN_NUMERIC_VARIABLE) {
+		emit_byte(code, 0x8B);			/* MOV */
+		emit_byte(code, 0x06 | reg << 3);	/* reg, */
+		emit_var(code, n->val);			/* [imm16] */
+		return;
+	}
+
+	compile_expression(n, code);
+	if (reg != REG_AX) {
+		emit_byte(code, 0x8B);			/* MOV */
+		emit_byte(code, 0xC0 | reg << 3);	/* reg, AX */
+	}
+}
+
+/* Put address of PEEK/POKE in BX, unless it is absolute */
+static void load_address(Node* addr, CompileTarget* code)
+{
+	if (!is_absolute(addr))
+		load_register(addr, REG_BX, code);
+}
+
+/* REP STOS or MOVS (op is the byte form) of count bytes in CX, by words and the
+ * odd byte last. Loading CX can't change AX if keep_ax is set */
+static void emit_repeat(Node* count, uint8_t op, bool keep_ax,
+			CompileTarget* code)
+{
+	if (count->attribute == TOKEN_NUMERIC_LITERAL) {
+		uint16_t n = count->val;
+		if (n / 2 > 1) {
+			emit_byte(code, 0xC7);		/* MOV */
+			emit_byte(code, 0xC1);		/* CX, */
+			emit_word(code, n / 2);		/* words */
+			emit_byte(code, 0xF3);		/* REP */
+		}
+		if (n / 2 > 0)
+			emit_byte(code, op | 1);	/* STOSW / MOVSW */
+		if (n & 1)
+			emit_byte(code, op);		/* STOSB / MOVSB */
+		return;
+	}
+
+	bool computed = !is_absolute(count) &&
+		count->attribute != TOKEN_NUMERIC_VARIABLE;
+	if (keep_ax && computed)
+		emit_byte(code, 0x50);			/* PUSH AX */
+	load_register(count, REG_CX, code);
+	if (keep_ax && computed)
+		emit_byte(code, 0x58);			/* POP AX */
+
+	emit_byte(code, 0xD1);				/* SHR */
+	emit_byte(code, 0xE9);				/* CX, 1 */
+	emit_byte(code, 0xF3);				/* REP */
+	emit_byte(code, op | 1);			/* STOSW / MOVSW */
+	emit_byte(code, 0x13);				/* ADC */
+	emit_byte(code, 0xC9);				/* CX, CX (odd byte) */
+	emit_byte(code, 0xF3);				/* REP */
+	emit_byte(code, op);				/* STOSB / MOVSB */
+}
+
+void compile_copy(Node* ast, CompileTarget* code)
+{
+	Node* count = ast->op2->op2;
+	if (count->attribute == TOKEN_NUMERIC_LITERAL && count->val == 0)
+		return;
+
+	load_register(ast->op1, REG_SI, code);
+	load_register(ast->op2->op1, REG_DI, code);
+	emit_repeat(count, 0xA4, false, code);
+}
+
 void compile_cursor(Node* ast, CompileTarget* code)
 {
 	/* CALL os_show_cursor */
@@ -113,7 +256,7 @@ void compile_cursor(Node* ast, CompileTarget* code)
 
 void compile_curschar(Node* ast, CompileTarget* code)
 {
-	uint16_t var = VARS + ast->op1->val * 2;
+	int var = ast->op1->val;
 
 	/* Call BIOS for character */
 	emit_byte(code, 0xC7);			/* MOV */
@@ -130,12 +273,12 @@ void compile_curschar(Node* ast, CompileTarget* code)
 	emit_word(code, 0x00FF);		/* 0x00FF */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, var);
+	emit_var(code, var);
 }
 
 void compile_curscol(Node* ast, CompileTarget* code)
 {
-	uint16_t var = VARS + ast->op1->val * 2;
+	int var = ast->op1->val;
 
 	/* Call BIOS for character */
 	emit_byte(code, 0xC7);			/* MOV */
@@ -153,13 +296,13 @@ void compile_curscol(Node* ast, CompileTarget* code)
 	emit_byte(code, 0x08);			/* 8 */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, var);
+	emit_var(code, var);
 }
 
 void compile_curspos(Node* ast, CompileTarget* code)
 {
-	uint16_t vara = VARS + ast->op1->val * 2;
-	uint16_t varb = VARS + ast->op2->val * 2;
+	int vara = ast->op1->val;
+	int varb = ast->op2->val;
 
 	/* CALL os_get_cursor_pos */
 	emit_call(code, 0x0069);
@@ -171,7 +314,7 @@ void compile_curspos(Node* ast, CompileTarget* code)
 	emit_word(code, 0x00FF);		/* 0x00FF */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, vara);
+	emit_var(code, vara);
 
 	/* Store row */
 	emit_byte(code, 0x8B);			/* MOV */
@@ -181,46 +324,17 @@ void compile_curspos(Node* ast, CompileTarget* code)
 	emit_byte(code, 0x08);			/* 8 */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, varb);
+	emit_var(code, varb);
 }
 
 void compile_delete(Node* ast, CompileTarget* code)
 {
-	uint16_t rvar = VARS + ('r' - 'a') * 2;
-
 	compile_expression(ast->op1, code);
 
-	/* Check if file exists (CALL os_file_exists) */
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0xC6);			/* AX, SI */
-	emit_call(code, 0x0099);
-	emit_byte(code, 0x72);			/* JC */
-	emit_byte(code, 0x11);			/* Over exists branch */
-
-	/* Try deleting file (CALL os_remove_file) */
-	emit_call(code, 0x009F);
-	emit_byte(code, 0x72);			/* JC */
-	emit_byte(code, 0x04);			/* Jump over failure */
-
-	/* File deleted, set R to 0 */
-	emit_byte(code, 0x33);			/* XOR */
-	emit_byte(code, 0xC0);			/* AX, AX */
-	emit_byte(code, 0xEB);			/* JMP */
-	emit_byte(code, 0x0E);			/* Over failures */
-
-	/* File couldn't be deleted, set R to 1 */
-	emit_byte(code, 0xC7);			/* MOV */
-	emit_byte(code, 0x06);
-	emit_word(code, rvar);			/* [rvar], */
-	emit_word(code, 0x0001);		/* 1 */
-	emit_byte(code, 0xEB);			/* JMP */
-	emit_byte(code, 0x06);			/* Over failure */
-
-	/* File doesn't exist, set R to 2 */
-	emit_byte(code, 0xC7);			/* MOV */
-	emit_byte(code, 0x06);
-	emit_word(code, rvar);			/* [rvar], */
-	emit_word(code, 0x0002);		/* 2 */
+	if (is_outlined(HELPER_DELETE))
+		emit_helper_call(code, HELPER_DELETE);
+	else
+		emit_delete_file(code);
 }
 
 void compile_end(Node* ast, CompileTarget* code)
@@ -233,65 +347,51 @@ void compile_files(Node* ast, CompileTarget* code)
 {
 	ast->op1 = NULL;			/* Shut up */
 
-	/* First set AX to our buffer */
-	emit_byte(code, 0xC7);			/* MOV */
-	emit_byte(code, 0xC0);			/* AX, */
-	emit_word(code, STRBUF);		/* STRBUF */
-
-	/* CALL os_get_file_list */
-	emit_call(code, 0x0042);
-
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0xF0);			/* SI, AX */
-	emit_byte(code, 0x56);			/* PUSH SI */
-	emit_byte(code, 0x25);			/* AND AX, */
-	emit_word(code, 0x00FF);
-
-	/* Loop through list, replace all commas for newlines */
-	emit_byte(code, 0xAC);			/* LODSB */
-	emit_byte(code, 0x85);			/* TEST */
-	emit_byte(code, 0xC0);			/* AX, AX */
-	emit_byte(code, 0x74);			/* JZ */
-	emit_byte(code, 0x10);			/* To the end */
-	emit_byte(code, 0x3D);			/* CMP AX, */
-	emit_word(code, 0x002C);		/* 0x002C = ',' */
-	emit_byte(code, 0x75);			/* JNE */
-	emit_byte(code, 0xF6);			/* Back to the loop */
-
-	/* Replace byte */
-	emit_byte(code, 0xC7);			/* MOV */
-	emit_byte(code, 0xC0);			/* AX, */
-	emit_word(code, 0x000A);		/* 0xA */
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0xFE);			/* DI, SI */
-	emit_byte(code, 0xFF);			/* DEC */
-	emit_byte(code, 0xCF);			/* DI */
-	emit_byte(code, 0xAA);			/* STOSB */
-	emit_byte(code, 0xEB);			/* JMP */
-	emit_byte(code, 0xEB);			/* Back to the loop */
+	if (is_outlined(HELPER_FILES))
+		emit_helper_call(code, HELPER_FILES);
+	else
+		emit_file_list(code);
+}
 
-	emit_byte(code, 0x5E);			/* POP SI */
-	/* CALL print_string */
-	emit_call(code, PRINTSTR);
+void compile_fill(Node* ast, CompileTarget* code)
+{
+	Node* count = ast->op2->op1;
+	Node* val = ast->op2->op2;
+	bool literal = count->attribute == TOKEN_NUMERIC_LITERAL;
+	if (literal && count->val == 0)
+		return;
 
-	/* Put NL in STRBUF and print it */
-	emit_byte(code, 0xC7);			/* MOV */
-	emit_byte(code, 0xC0);			/* AX, */
-	emit_word(code, 0x000A);		/* 0xA */
-	emit_byte(code, 0x89);			/* MOV */
-	emit_byte(code, 0x06);			/* [imm], AX */
-	emit_word(code, STRBUF);
-	emit_byte(code, 0xC7);			/* MOV */
-	emit_byte(code, 0xC6);			/* SI, */
-	emit_word(code, STRBUF);
+	/* Byte goes to AL, and to AH too if there are words to store */
+	bool words = !literal || (uint16_t) count->val > 1;
+	load_register(ast->op1, REG_DI, code);
+	if (val->attribute == TOKEN_NUMERIC_LITERAL) {
+		uint16_t byte = val->val & 0xFF;
+		emit_byte(code, 0xC7);			/* MOV */
+		emit_byte(code, 0xC0);			/* AX, */
+		emit_word(code, words ? byte * 0x0101 : byte);	/* imm16 */
+	}
+	else {
+		load_register(val, REG_AX, code);
+		if (words) {
+			emit_byte(code, 0x8A);		/* MOV */
+			emit_byte(code, 0xE0);		/* AH, AL */
+		}
+	}
 
-	/* CALL print_string */
-	emit_call(code, PRINTSTR);
+	emit_repeat(count, 0xAA, true, code);
 }
 
 void compile_getkey(Node* ast, CompileTarget* code)
 {
-	uint16_t var = VARS + ast->op1->val * 2;
+	int var = ast->op1->val;
+
+	if (is_outlined(HELPER_GETKEY)) {
+		emit_helper_call(code, HELPER_GETKEY);
+		emit_byte(code, 0x89);		/* MOV */
+		emit_byte(code, 0x06);		/* [imm16], AX */
+		emit_var(code, var);
+		return;
+	}
 
 	/* CALL os_check_for_key */
 	emit_call(code, 0x0015);
@@ -319,7 +419,7 @@ void compile_getkey(Node* ast, CompileTarget* code)
 	emit_word(code, 0x00FF);		/* 0x00FF */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, var);
+	emit_var(code, var);
 	emit_byte(code, 0xEB);			/* JMP */
 	emit_byte(code, 0x18);			/* Over others (24) */
 
@@ -365,7 +465,7 @@ void compile_gosub(Node* ast, CompileTarget* code)
 
 	/* Label was already compiled */
 	if (symbols->table[id].addr != 0)
-		emit_call(code, symbols->table[id].addr);
+		emit_call(code, LOAD + symbols->table[id].addr);
 	/* It wasn't */
 	else {
 		emit_byte(code, 0xE8);
@@ -386,7 +486,7 @@ void compile_goto(Node* ast, CompileTarget* code)
 
 	/* Label was already compiled */
 	if (symbols->table[id].addr != 0)
-		emit_jump(code, symbols->table[id].addr);
+		emit_jump(code, LOAD + symbols->table[id].addr);
 	/* It wasn't */
 	else {
 		emit_byte(code, 0xE9);
@@ -408,13 +508,14 @@ void compile_input(Node* ast, CompileTarget* code)
 {
 	/* Do we want string? */
 	if (ast->op1->attribute == TOKEN_STRING_VARIABLE) {
-		uint16_t var = STRVARS + ast->op1->val * 128;
+		int var = ast->op1->val;
 		emit_byte(code, 0xC7);		/* MOV */
 		emit_byte(code, 0xC0);		/* AX, */
-		emit_word(code, var);		/* var */
+		emit_strvar(code, var);		/* var */
 
 		/* CALL os_input_string */
 		emit_call(code, 0x0036);
+		update_length(code, var);
 		/* CALL os_print_newline */
 		emit_call(code, 0x000F);
 
@@ -422,41 +523,22 @@ void compile_input(Node* ast, CompileTarget* code)
 	}
 
 	/* No, we want numeric, use buffer */
-	uint16_t var = VARS + ast->op1->val * 2;
-
-	emit_byte(code, 0xC7);			/* MOV */
-	emit_byte(code, 0xC0);			/* AX, */
-	emit_word(code, STRBUF);		/* STRBUF */
-
-	/* CALL os_input_string */
-	emit_call(code, 0x0036);
-
-	/* Check for empty string */
-	emit_call(code, 0x002D);
-	emit_byte(code, 0x85);			/* TEST */
-	emit_byte(code, 0xC0);			/* AX, AX */
-	emit_byte(code, 0x75);			/* JNZ */
-	emit_byte(code, 0x08);			/* Over zeroing it */
+	int var = ast->op1->val;
 
-	/* We need to put "0(NUL)" in buffer */
-	emit_byte(code, 0xC7);			/* MOV */
-	emit_byte(code, 0xC0);			/* AX, */
-	emit_word(code, 0x0030);		/* 0x0030 -> "0\0" */
-	emit_byte(code, 0x89);			/* MOV */
-	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, STRBUF);		/* STRBUF */
+	if (is_outlined(HELPER_INPUT)) {
+		emit_helper_call(code, HELPER_INPUT);
+		emit_byte(code, 0x89);		/* MOV */
+		emit_byte(code, 0x06);		/* [imm16], AX */
+		emit_var(code, var);		/* var */
+		return;
+	}
 
-	/* Convert string to number */
-	emit_byte(code, 0xC7);			/* MOV */
-	emit_byte(code, 0xC6);			/* SI, */
-	emit_word(code, STRBUF);		/* STRBUF */
-	/* CALL os_string_to_int */
-	emit_call(code, 0x00B1);
+	emit_input_number(code);
 
 	/* Store it */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, var);			/* var */
+	emit_var(code, var);			/* var */
 
 	/* CALL os_print_newline */
 	emit_call(code, 0x000F);
@@ -464,23 +546,33 @@ void compile_input(Node* ast, CompileTarget* code)
 
 void compile_len(Node* ast, CompileTarget* code)
 {
-	uint16_t var = VARS + ast->op2->val * 2;
+	int var = ast->op2->val;
 
 	/* Compile string first */
-	compile_expression(ast->op1, code);
+	compile_sized(ast->op1, code);
 
-	/* Calculate its length */
-	emit_call(code, 0x002D);
+	/* Calculate its length, unless it is kept */
+	if (options.string_lengths) {
+		emit_byte(code, 0x8B);		/* MOV */
+		emit_byte(code, 0xC1);		/* AX, CX */
+	}
+	else {
+		emit_byte(code, 0x8B);		/* MOV */
+		emit_byte(code, 0xC6);		/* AX, SI */
+
+		/* CALL os_string_length */
+		emit_call(code, 0x002D);
+	}
 
 	/* Store it */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, var);			/* var */
+	emit_var(code, var);			/* var */
 }
 
 void compile_listbox(Node* ast, CompileTarget* code)
 {
-	uint16_t var = VARS + ast->op2->op2->op2->val * 2;
+	int var = ast->op2->op2->op2->val;
 
 	/* First string to AX */
 	compile_expression(ast->op1, code);
@@ -507,7 +599,7 @@ void compile_listbox(Node* ast, CompileTarget* code)
 	/* Store the value */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, var);			/* var */
+	emit_var(code, var);			/* var */
 	emit_byte(code, 0xEB);			/* JMP */
 	emit_byte(code, 0x04);			/* Over ESC */
 
@@ -520,8 +612,8 @@ void compile_listbox(Node* ast, CompileTarget* code)
 
 void compile_load(Node* ast, CompileTarget* code)
 {
-	uint16_t rvar = VARS + ('r' - 'a') * 2;
-	uint16_t svar = VARS + ('s' - 'a') * 2;
+	int rvar = 'r' - 'a';
+	int svar = 's' - 'a';
 
 	/* Put load position in CX */
 	compile_expression(ast->op2, code);
@@ -543,7 +635,7 @@ void compile_load(Node* ast, CompileTarget* code)
 	/* Okay, set BX to 0 and S to file size */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x1E);			/* [imm16], BX */
-	emit_word(code, svar);			/* svar */
+	emit_var(code, svar);			/* svar */
 	emit_byte(code, 0x33);			/* XOR */
 	emit_byte(code, 0xD8);			/* BX, BX */
 	emit_byte(code, 0xEB);			/* JMP */
@@ -557,7 +649,7 @@ void compile_load(Node* ast, CompileTarget* code)
 	/* Store BX to R */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x1E);			/* [imm16], BX */
-	emit_word(code, rvar);			/* rvar */
+	emit_var(code, rvar);			/* rvar */
 }
 
 void compile_move(Node* ast, CompileTarget* code)
@@ -581,30 +673,64 @@ void compile_move(Node* ast, CompileTarget* code)
 	emit_call(code, 0x0006);
 }
 
+/* SI = AX as text, written to string variable var (STRBUF if it is -1) */
+static void emit_format(CompileTarget* code, bool hex, int var)
+{
+	/* MikeOS' routines cost no bytes of the program */
+	if (options.opt_level == OPT_OS && hex) {
+		emit_byte(code, 0x33);		/* XOR */
+		emit_byte(code, 0xD2);		/* DX, DX */
+		emit_byte(code, 0xC7);		/* MOV */
+		emit_byte(code, 0xC3);		/* BX, imm */
+		emit_word(code, 0x0010);	/* 0x10 = 16 */
+		emit_byte(code, 0xC7);		/* MOV */
+		emit_byte(code, 0xC7);		/* DI, imm */
+		emit_word(code, STRBUF);
+
+		/* CALL os_long_int_to_string */
+		emit_call(code, 0x007E);
+		emit_byte(code, 0x8B);		/* MOV */
+		emit_byte(code, 0xF7);		/* SI, DI */
+		return;
+	}
+	if (options.opt_level == OPT_OS) {
+		/* CALL os_int_to_string */
+		emit_call(code, 0x0018);
+		emit_byte(code, 0x8B);		/* MOV */
+		emit_byte(code, 0xF0);		/* SI, AX */
+		return;
+	}
+
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC7);			/* DI, */
+	if (var == -1)
+		emit_word(code, STRBUF);	/* STRBUF */
+	else
+		emit_strvar(code, var);		/* var */
+	emit_helper_call(code, hex ? HELPER_HEX : HELPER_DECIMAL);
+}
+
 void compile_number(Node* ast, CompileTarget* code)
 {
 	bool src = compile_expression(ast->op1, code);
 
 	/* Is it numeric to string? */
 	if (src) {
-		uint16_t dst = STRVARS + ast->op2->val * 128;
+		int dst = ast->op2->val;
+		emit_format(code, false, dst);
 
-		/* CALL os_int_to_string */
-		emit_call(code, 0x0018);
-
-		/* Copy internal buffer into destination */
-		emit_byte(code, 0x8B);		/* MOV */
-		emit_byte(code, 0xF0);		/* SI, AX */
+		/* Digits start after skipped zeros, move them to the beginning
+		 * (or copy MikeOS' buffer) */
 		emit_byte(code, 0xC7);		/* MOV */
 		emit_byte(code, 0xC7);		/* DI, */
-		emit_word(code, dst);		/* dst */
+		emit_strvar(code, dst);		/* dst */
 
-		/* CALL os_string_copy */
-		emit_call(code, 0x0039);
+		emit_copy(NULL, code);
+		update_length(code, dst);
 	}
 	/* No, string to numeric */
 	else {
-		uint16_t dst = VARS + ast->op2->val * 2;
+		int dst = ast->op2->val;
 
 		/* CALL os_string_to_int */
 		emit_call(code, 0x00B1);
@@ -612,7 +738,7 @@ void compile_number(Node* ast, CompileTarget* code)
 		/* Store result to variable */
 		emit_byte(code, 0x89);		/* MOV */
 		emit_byte(code, 0x06);		/* [imm16], AX */
-		emit_word(code, dst);		/* dst */
+		emit_var(code, dst);		/* dst */
 	}
 }
 
@@ -649,86 +775,88 @@ void compile_pause(Node* ast, CompileTarget* code)
 	emit_call(code, 0x0024);
 }
 
-void compile_peek(Node* ast, CompileTarget* code)
+/* Load byte (zero extended) or word from memory */
+static void emit_peek(Node* ast, CompileTarget* code, bool word)
 {
-	uint16_t var = VARS + ast->op1->val * 2;
+	int var = ast->op1->val;
+	Node* addr = ast->op2;
 
-	/* Address will be in AX, put it in BX and load */
-	compile_expression(ast->op2, code);
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0xD8);			/* BX, AX */
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0x07);			/* AX, [BX] */
+	load_address(addr, code);
+	if (is_absolute(addr)) {
+		emit_byte(code, word ? 0xA1 : 0xA0);	/* MOV AX / AL, */
+		emit_absolute(addr, code);		/* [imm16] */
+	}
+	else {
+		emit_byte(code, word ? 0x8B : 0x8A);	/* MOV */
+		emit_byte(code, 0x07);			/* AX / AL, [BX] */
+	}
 
-	/* Now mask the upper byte */
-	emit_byte(code, 0x25);			/* AND AX, */
-	emit_word(code, 0x00FF);		/* 0x00FF */
+	if (!word) {
+		emit_byte(code, 0x32);		/* XOR */
+		emit_byte(code, 0xE4);		/* AH, AH */
+	}
 
 	/* Store the result */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, var);			/* var */
+	emit_var(code, var);			/* var */
 }
 
-void compile_peekint(Node* ast, CompileTarget* code)
+/* Store byte or word, without touching memory around it */
+static void emit_poke(Node* ast, CompileTarget* code, bool word)
 {
-	uint16_t var = VARS + ast->op1->val * 2;
+	Node* val = ast->op1;
+	Node* addr = ast->op2;
+
+	/* Values are primaries, they don't change BX */
+	load_address(addr, code);
+
+	/* Constant is stored right away */
+	if (val->attribute == TOKEN_NUMERIC_LITERAL) {
+		emit_byte(code, word ? 0xC7 : 0xC6);	/* MOV */
+		if (is_absolute(addr)) {
+			emit_byte(code, 0x06);		/* [imm16], */
+			emit_absolute(addr, code);
+		}
+		else
+			emit_byte(code, 0x07);		/* [BX], */
 
-	/* Address will be in AX, put it in BX and load */
-	compile_expression(ast->op2, code);
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0xD8);			/* BX, AX */
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0x07);			/* AX, [BX] */
+		if (word)
+			emit_word(code, (uint16_t) val->val);	/* imm16 */
+		else
+			emit_byte(code, val->val & 0xFF);	/* imm8 */
+		return;
+	}
 
-	/* Store the result */
-	emit_byte(code, 0x89);			/* MOV */
-	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, var);			/* var */
+	compile_expression(val, code);
+	if (is_absolute(addr)) {
+		emit_byte(code, word ? 0xA3 : 0xA2);	/* MOV [imm16], */
+		emit_absolute(addr, code);		/* AX / AL */
+	}
+	else {
+		emit_byte(code, word ? 0x89 : 0x88);	/* MOV */
+		emit_byte(code, 0x07);			/* [BX], AX / AL */
+	}
 }
 
-void compile_poke(Node* ast, CompileTarget* code)
+void compile_peek(Node* ast, CompileTarget* code)
 {
-	/* Before we can poke, we need to read one byte more */
-	compile_expression(ast->op2, code);
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0xD8);			/* BX, AX */
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0x07);			/* AX, [BX] */
-	emit_byte(code, 0x25);			/* AND AX, */
-	emit_word(code, 0xFF00);		/* 0xFF00 */
-
-	/* Save upper byte in CX */
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0xC8);			/* CX, AX */
-
-	/* Get value to poke, and mask upper byte */
-	compile_expression(ast->op1, code);
-	emit_byte(code, 0x25);			/* AND AX, */
-	emit_word(code, 0x00FF);		/* 0x00FF */
+	emit_peek(ast, code, false);
+}
 
-	/* Add it into CX */
-	emit_byte(code, 0x03);			/* ADD */
-	emit_byte(code, 0xC8);			/* CX, AX */
+void compile_peekint(Node* ast, CompileTarget* code)
+{
+	emit_peek(ast, code, true);
+}
 
-	/* Store CX under [BX] */
-	emit_byte(code, 0x89);			/* MOV */
-	emit_byte(code, 0x0F);			/* [BX], CX */
+void compile_poke(Node* ast, CompileTarget* code)
+{
+	emit_poke(ast, code, false);
 }
 
 void compile_pokeint(Node* ast, CompileTarget* code)
 {
-	/* Put address in BX */
-	compile_expression(ast->op2, code);
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0xD8);			/* BX, AX */
-
-	/* Get value to poke, and mask upper byte */
-	compile_expression(ast->op1, code);
-
-	/* Store AX under [BX] */
-	emit_byte(code, 0x89);			/* MOV */
-	emit_byte(code, 0x07);			/* [BX], AX */
+	emit_poke(ast, code, true);
 }
 
 void compile_port(Node* ast, CompileTarget* code)
@@ -747,7 +875,7 @@ void compile_port(Node* ast, CompileTarget* code)
 	}
 	/* No, read it in */
 	else {
-		uint16_t var = VARS + ast->op2->op2->val * 2;
+		int var = ast->op2->op2->val;
 
 		/* CALL os_port_byte_in */
 		emit_call(code, 0x00CC);
@@ -757,7 +885,7 @@ void compile_port(Node* ast, CompileTarget* code)
 		emit_word(code, 0x00FF);	/* 0x00FF */
 		emit_byte(code, 0x89);		/* MOV */
 		emit_byte(code, 0x06);		/* [imm16], AX */
-		emit_word(code, var);		/* var */
+		emit_var(code, var);		/* var */
 	}
 }
 
@@ -774,14 +902,8 @@ void compile_print(Node* ast, CompileTarget* code)
 
 	/* We want to print SI, but if it is numeric, we need to
 	   fill it with what we want */
-	if (expr && ast->op1 == NULL) {
-		/* CALL os_int_to_string */
-		emit_call(code, 0x0018);
-
-		/* Put it in SI */
-		emit_byte(code, 0x8B);		/* MOV */
-		emit_byte(code, 0xF0);		/* SI, AX */
-	}
+	if (expr && ast->op1 == NULL)
+		emit_format(code, false, -1);
 	else if (expr && ast->op1->attribute == TOKEN_CHR) {
 		emit_byte(code, 0x25);		/* AND AX, */
 		emit_word(code, 0x00FF);	/* 0x00FF */
@@ -794,71 +916,98 @@ void compile_print(Node* ast, CompileTarget* code)
 		emit_byte(code, 0xC6);		/* SI, imm */
 		emit_word(code, STRBUF);
 	}
-	else if (expr && ast->op1->attribute == TOKEN_HEX) {
-		/* First set DX to zero and BX to 16 */
-		emit_byte(code, 0x33);		/* XOR */
-		emit_byte(code, 0xD2);		/* DX, DX */
-		emit_byte(code, 0xC7);		/* MOV */
-		emit_byte(code, 0xC3);		/* BX, imm */
-		emit_word(code, 0x0010);	/* 0x10 = 16 */
+	else if (expr && ast->op1->attribute == TOKEN_HEX)
+		emit_format(code, true, -1);
 
-		/* Now set DI to STRBUF */
-		emit_byte(code, 0xC7);		/* MOV */
-		emit_byte(code, 0xC7);		/* DI, imm */
-		emit_word(code, STRBUF);
+	emit_print(code);
 
-		/* CALL os_long_int_to_string */
-		emit_call(code, 0x007E);
+	/* If there is no semicolon, print NL */
+	if (ast->op2->op2 == NULL && is_outlined(HELPER_NEWLINE))
+		emit_helper_call(code, HELPER_NEWLINE);
+	else if (ast->op2->op2 == NULL)
+		emit_newline(code);
+}
 
-		/* Now set SI to DI */
-		emit_byte(code, 0x8B);		/* MOV */
-		emit_byte(code, 0xF7);		/* SI, DI */
+void compile_rand(Node* ast, CompileTarget* code)
+{
+	int var = ast->op1->val;
+	Node* low = ast->op2->op1;
+	Node* high = ast->op2->op2;
+	bool known = low->attribute == TOKEN_NUMERIC_LITERAL &&
+		high->attribute == TOKEN_NUMERIC_LITERAL;
+
+	/* Size of the range to BX, first value to SI (if it isn't known) */
+	if (!known) {
+		load_register(high, REG_BX, code);
+		load_register(low, REG_SI, code);
+		emit_byte(code, 0x2B);		/* SUB */
+		emit_byte(code, 0xDE);		/* BX, SI */
+		emit_byte(code, 0x43);		/* INC BX */
 	}
 
-	/* CALL print_string */
-	emit_call(code, PRINTSTR);
+	if (is_outlined(HELPER_RANDOM))
+		emit_helper_call(code, HELPER_RANDOM);
+	else
+		emit_random(code);
 
-	/* If there is no semicolon, print NL */
-	if (ast->op2->op2 == NULL) {
-		emit_byte(code, 0xC7);		/* MOV */
-		emit_byte(code, 0xC0);		/* AX, */
-		emit_word(code, 0x000A);	/* 0xA */
-		emit_byte(code, 0x89);		/* MOV */
-		emit_byte(code, 0x06);		/* [imm], AX */
-		emit_word(code, STRBUF);
-		emit_byte(code, 0xC7);		/* MOV */
-		emit_byte(code, 0xC6);		/* SI, */
-		emit_word(code, STRBUF);
+	/* Scale to the range: high word of random * size (no DIV) */
+	uint16_t size = known ? high->val - low->val + 1 : 0;
+	if (known && size == 0) {
+		emit_byte(code, 0x8B);		/* MOV */
+		emit_byte(code, 0xD0);		/* DX, AX (whole range) */
+	}
+	else {
+		if (known) {
+			emit_byte(code, 0xC7);	/* MOV */
+			emit_byte(code, 0xC3);	/* BX, */
+			emit_word(code, size);	/* size */
+		}
+		emit_byte(code, 0xF7);		/* MUL */
+		emit_byte(code, 0xE3);		/* BX */
+	}
 
-		/* CALL print_string */
-		emit_call(code, PRINTSTR);
+	if (!known) {
+		emit_byte(code, 0x03);		/* ADD */
+		emit_byte(code, 0xD6);		/* DX, SI */
+	}
+	else if ((uint16_t) low->val != 0) {
+		emit_byte(code, 0x81);		/* ADD */
+		emit_byte(code, 0xC2);		/* DX, */
+		emit_word(code, (uint16_t) low->val);	/* imm16 */
 	}
+
+	emit_byte(code, 0x89);			/* MOV */
+	emit_byte(code, 0x16);			/* [imm16], DX */
+	emit_var(code, var);
 }
 
-void compile_rand(Node* ast, CompileTarget* code)
+void compile_randomize(Node* ast, CompileTarget* code)
 {
-	uint16_t var = VARS + ast->op1->val * 2;
+	Node* seed = ast->op1;
 
-	/* Second value to BX */
-	compile_expression(ast->op2->op2, code);
-	emit_byte(code, 0x8B);			/* MOV */
-	emit_byte(code, 0xD8);			/* BX, AX */
-
-	/* First to AX */
-	compile_expression(ast->op2->op1, code);
-
-	/* CALL os_get_random */
-	emit_call(code, 0x00B7);
+	/* State of xorshift can't be 0, it would stay there */
+	if (seed->attribute == TOKEN_NUMERIC_LITERAL) {
+		uint16_t val = seed->val;
+		emit_byte(code, 0xC7);		/* MOV */
+		emit_byte(code, 0x06);		/* [imm16], */
+		emit_word(code, RANDSTATE);	/* [RANDSTATE] */
+		emit_word(code, val ? val : 1);	/* imm16 */
+		return;
+	}
 
-	/* Store result from CX */
-	emit_byte(code, 0x89);			/* MOV */
-	emit_byte(code, 0x0E);			/* [imm16], CX */
-	emit_word(code, var);
+	load_register(seed, REG_AX, code);
+	emit_byte(code, 0x3D);			/* CMP AX, */
+	emit_word(code, 0x0001);		/* 1 (CF = 1 if it is 0) */
+	emit_byte(code, 0x83);			/* ADC */
+	emit_byte(code, 0xD0);			/* AX, */
+	emit_byte(code, 0x00);			/* 0 */
+	emit_byte(code, 0xA3);			/* MOV */
+	emit_word(code, RANDSTATE);		/* [RANDSTATE], AX */
 }
 
 void compile_rename(Node* ast, CompileTarget* code)
 {
-	uint16_t rvar = VARS + ('r' - 'a') * 2;
+	int rvar = 'r' - 'a';
 
 	/* First we check if destination exists */
 	compile_expression(ast->op2, code);
@@ -918,7 +1067,7 @@ void compile_rename(Node* ast, CompileTarget* code)
 	code->code[patch] = rel & 0xFF;
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, rvar);
+	emit_var(code, rvar);
 }
 
 void compile_return(Node* ast, CompileTarget* code)
@@ -929,7 +1078,7 @@ void compile_return(Node* ast, CompileTarget* code)
 
 void compile_save(Node* ast, CompileTarget* code)
 {
-	uint16_t rvar = VARS + ('r' - 'a') * 2;
+	int rvar = 'r' - 'a';
 
 	/* Put load address in BX */
 	compile_expression(ast->op2->op1, code);
@@ -979,7 +1128,7 @@ void compile_save(Node* ast, CompileTarget* code)
 	/* Store AX to R */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, rvar);			/* rvar */
+	emit_var(code, rvar);			/* rvar */
 }
 
 void compile_serial(Node* ast, CompileTarget* code)
@@ -1021,7 +1170,7 @@ void compile_serial(Node* ast, CompileTarget* code)
 	}
 
 	/* We want to receive byte */
-	uint16_t var = VARS + ast->op2->val * 2;
+	int var = ast->op2->val;
 
 	/* CALL os_get_via_serial */
 	emit_call(code, 0x0063);
@@ -1031,13 +1180,13 @@ void compile_serial(Node* ast, CompileTarget* code)
 	emit_word(code, 0x00FF);		/* 0x00FF */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, var);			/* var */
+	emit_var(code, var);			/* var */
 }
 
 void compile_size(Node* ast, CompileTarget* code)
 {
-	uint16_t rvar = VARS + ('r' - 'a') * 2;
-	uint16_t svar = VARS + ('s' - 'a') * 2;
+	int rvar = 'r' - 'a';
+	int svar = 's' - 'a';
 
 	/* Store filename to AX */
 	compile_expression(ast->op1, code);
@@ -1052,7 +1201,7 @@ void compile_size(Node* ast, CompileTarget* code)
 	/* Okay, store size (BX) to S and zero it */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x1E);			/* [imm16], BX */
-	emit_word(code, svar);			/* svar */
+	emit_var(code, svar);			/* svar */
 	emit_byte(code, 0x33);			/* XOR */
 	emit_byte(code, 0xDB);			/* BX, BX */
 	emit_byte(code, 0xEB);			/* JMP */
@@ -1066,7 +1215,7 @@ void compile_size(Node* ast, CompileTarget* code)
 	/* Store BX to R */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x1E);			/* [imm16], BX */
-	emit_word(code, rvar);			/* rvar */
+	emit_var(code, rvar);			/* rvar */
 }
 
 void compile_sound(Node* ast, CompileTarget* code)
@@ -1087,7 +1236,7 @@ void compile_sound(Node* ast, CompileTarget* code)
 
 void compile_string(Node* ast, CompileTarget* code)
 {
-	uint16_t var = VARS + ast->op2->op2->op2->val * 2;
+	int var = ast->op2->op2->op2->val;
 
 	/* String in SI */
 	compile_expression(ast->op2->op1, code);
@@ -1110,7 +1259,7 @@ void compile_string(Node* ast, CompileTarget* code)
 		/* And store it back */
 		emit_byte(code, 0x89);		/* MOV */
 		emit_byte(code, 0x06);		/* [imm16], AX */
-		emit_word(code, var);		/* var */
+		emit_var(code, var);		/* var */
 	}
 	/* Set it with STOSB */
 	else {
@@ -1123,12 +1272,25 @@ void compile_string(Node* ast, CompileTarget* code)
 
 		/* Set byte and all is done */
 		emit_byte(code, 0xAA);		/* STOSB */
+
+		/* Byte may have ended the string, or made it longer */
+		Node* str = ast->op2->op1;
+		if (str->attribute == TOKEN_STRING_VARIABLE)
+			update_length(code, str->val);
 	}
 }
 
 void compile_waitkey(Node* ast, CompileTarget* code)
 {
-	uint16_t var = VARS + ast->op1->val * 2;
+	int var = ast->op1->val;
+
+	if (is_outlined(HELPER_WAITKEY)) {
+		emit_helper_call(code, HELPER_WAITKEY);
+		emit_byte(code, 0x89);		/* MOV */
+		emit_byte(code, 0x06);		/* [imm16], AX */
+		emit_var(code, var);
+		return;
+	}
 
 	/* CALL os_wait_for_key */
 	emit_call(code, 0x0012);
@@ -1156,7 +1318,7 @@ void compile_waitkey(Node* ast, CompileTarget* code)
 	emit_word(code, 0x00FF);		/* 0x00FF */
 	emit_byte(code, 0x89);			/* MOV */
 	emit_byte(code, 0x06);			/* [imm16], AX */
-	emit_word(code, var);
+	emit_var(code, var);
 	emit_byte(code, 0xEB);			/* JMP */
 	emit_byte(code, 0x18);			/* Over others (24) */
 
@@ -1198,6 +1360,7 @@ static KeywordCompileFuncPtr compiler[] = {
 	[TOKEN_CALL] = compile_call,
 	[TOKEN_CASE] = compile_case,
 	[TOKEN_CLS] = compile_cls,
+	[TOKEN_COPY] = compile_copy,
 	[TOKEN_CURSOR] = compile_cursor,
 	[TOKEN_CURSCHAR] = compile_curschar,
 	[TOKEN_CURSCOL] = compile_curscol,
@@ -1205,6 +1368,7 @@ static KeywordCompileFuncPtr compiler[] = {
 	[TOKEN_DELETE] = compile_delete,
 	[TOKEN_END] = compile_end,
 	[TOKEN_FILES] = compile_files,
+	[TOKEN_FILL] = compile_fill,
 	[TOKEN_GETKEY] = compile_getkey,
 	[TOKEN_GOSUB] = compile_gosub,
 	[TOKEN_GOTO] = compile_goto,
@@ -1225,6 +1389,7 @@ static KeywordCompileFuncPtr compiler[] = {
 	[TOKEN_PORT] = compile_port,
 	[TOKEN_PRINT] = compile_print,
 	[TOKEN_RAND] = compile_rand,
+	[TOKEN_RANDOMIZE] = compile_randomize,
 	[TOKEN_READ] = NULL,
 	[TOKEN_RENAME] = compile_rename,
 	[TOKEN_RETURN] = compile_return,
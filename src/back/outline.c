@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Standard library includes */
+#include <stddef.h>
+
+/* Custom includes */
+#include <ast.h>
+#include <runtime.h>
+#include <options.h>
+#include <optimize.h>
+
+/* Count keywords whose code can be moved to a runtime helper */
+static void count_uses(Node* n, int* uses)
+{
+	/* Sequences are walked in a loop */
+	for (; n != NULL && n->type == NODE_SEQUENCE; n = n->op2)
+		count_uses(n->op1, uses);
+
+	if (n == NULL)
+		return;
+
+	if (n->type == NODE_KEYWORD_CALL) {
+		switch (n->attribute) {
+			case TOKEN_PRINT:
+				if (n->op2->op2 == NULL)
+					uses[HELPER_NEWLINE]++;
+				break;
+			case TOKEN_GETKEY:
+				uses[HELPER_GETKEY]++;
+				break;
+			case TOKEN_WAITKEY:
+				uses[HELPER_WAITKEY]++;
+				break;
+			case TOKEN_FILES:
+				uses[HELPER_FILES]++;
+				break;
+			case TOKEN_DELETE:
+				uses[HELPER_DELETE]++;
+				break;
+			case TOKEN_RAND:
+				uses[HELPER_RANDOM]++;
+				break;
+			case TOKEN_INPUT:
+				if (n->op1->attribute == TOKEN_NUMERIC_VARIABLE)
+					uses[HELPER_INPUT]++;
+				break;
+			default:
+				break;
+		}
+		return;
+	}
+
+	count_uses(n->op1, uses);
+	count_uses(n->op2, uses);
+}
+
+void outline_sequences(Node* ast)
+{
+	int uses[HELPER_COUNT] = { 0 };
+	count_uses(ast, uses);
+
+	for (int i = 0; i < HELPER_COUNT; i++)
+		if (uses[i] > options.outline_min)
+			outline_helper(i, uses[i]);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <string.h>
+
+/* Custom includes */
+#include <optimize.h>
+#include <util.h>
+
+typedef void (*PassFuncPtr)(PassContext*);
+
+typedef struct {
+	const char* name;	/* Name used by -f<name> and -fno-<name> */
+	int levels;		/* Bitmask of levels enabling the pass */
+	PassFuncPtr run;	/* NULL if pass runs inside of codegen */
+	bool enabled;
+	double time;		/* Wall time spent (seconds) */
+	double start;		/* Time of last pass_begin() */
+	int saved;		/* Bytes of code saved */
+} Pass;
+
+#define LEVEL(l) (1 << (l))
+#define ABOVE_O0 (LEVEL(OPT_O1) | LEVEL(OPT_O2) | LEVEL(OPT_OS))
+
+static void run_inline(PassContext* ctx)
+{
+	inline_subroutines(ctx->ast, ctx->sym);
+}
+
+static void run_fold_strings(PassContext* ctx)
+{
+	fold_strings(ctx->ast, ctx->sym, ctx->str);
+}
+
+static void run_elide_copies(PassContext* ctx)
+{
+	elide_copies(ctx->ast, ctx->sym, ctx->str);
+}
+
+static void run_cse(PassContext* ctx)
+{
+	ctx->temps = eliminate_subexpressions(ctx->ast, ctx->sym);
+}
+
+static void run_outline(PassContext* ctx)
+{
+	outline_sequences(ctx->ast);
+}
+
+/* Passes in order they are run */
+static Pass passes[] = {
+	[PASS_INLINE] = { "inline", LEVEL(OPT_O2), run_inline, false, 0, 0, 0 },
+	[PASS_FOLD_STRINGS] = { "fold-strings", ABOVE_O0, run_fold_strings,
+				false, 0, 0, 0 },
+	[PASS_ELIDE_COPIES] = { "elide-copies", ABOVE_O0, run_elide_copies,
+				false, 0, 0, 0 },
+	[PASS_CSE] = { "cse", ABOVE_O0, run_cse, false, 0, 0, 0 },
+	[PASS_OUTLINE] = { "outline", LEVEL(OPT_OS), run_outline, false, 0, 0, 0 }
+};
+
+void set_opt_level(OptLevel level)
+{
+	for (int i = 0; i < PASS_COUNT; i++)
+		passes[i].enabled = (passes[i].levels & LEVEL(level)) != 0;
+}
+
+bool set_pass(const char* name, bool enabled)
+{
+	for (int i = 0; i < PASS_COUNT; i++) {
+		if (!strcmp(passes[i].name, name)) {
+			passes[i].enabled = enabled;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool pass_enabled(PassId id)
+{
+	return passes[id].enabled;
+}
+
+void pass_begin(PassId id)
+{
+	passes[id].start = wall_time();
+}
+
+void pass_end(PassId id)
+{
+	passes[id].time += wall_time() - passes[id].start;
+}
+
+void pass_saved(PassId id, int bytes)
+{
+	passes[id].saved += bytes;
+}
+
+void run_passes(PassContext* ctx)
+{
+	ctx->temps = 0;
+
+	for (int i = 0; i < PASS_COUNT; i++) {
+		if (!passes[i].enabled || passes[i].run == NULL)
+			continue;
+
+		pass_begin(i);
+		passes[i].run(ctx);
+		pass_end(i);
+	}
+}
+
+void print_pass_times()
+{
+	double time = 0;
+	int saved = 0;
+
+	printf("\x1B[36mPass timing\x1B[0m:\n");
+	for (int i = 0; i < PASS_COUNT; i++) {
+		if (!passes[i].enabled)
+			printf("  %-12s %10s\n", passes[i].name, "disabled");
+		else
+			printf("  %-12s %8.3f ms %8d bytes saved\n",
+				passes[i].name, passes[i].time * 1000,
+				passes[i].saved);
+
+		time += passes[i].time;
+		saved += passes[i].saved;
+	}
+	printf("  %-12s %8.3f ms %8d bytes saved\n", "total", time * 1000,
+		saved);
+}
@@ -3,9 +3,15 @@
  * Licensed under GNU General Public License version 3.
  */
 
+/* Standard library includes */
+#include <stdio.h>
+
 /* Custom includes */
 #include <table.h>
 #include <codegen.h>
+#include <runtime.h>
+#include <options.h>
+#include <optimize.h>
 
 void make_exit(CompileTarget* code)
 {
@@ -27,53 +33,25 @@ void make_exit(CompileTarget* code)
 /* Length of this handler: 4 + 3 + 9 + 32 = 48 bytes */
 void zero_divide_handler(CompileTarget* code)
 {
-	/* Print message (it is 2 + 3 + 3 = 8 bytes) */
+	/* Print message (it is 2 + 3 + 9 = 14 bytes away) */
 	emit_byte(code, 0xC7);				/* MOV */
 	emit_byte(code, 0xC6);				/* SI, */
-	emit_word(code, LOAD + code->length + 8);	/* imm16 */
+	emit_word(code, LOAD + code->length + 14);	/* imm16 */
 
 	/* Call os_print_string */
 	emit_call(code, 0x0003);
 
 	/* Exit */
 	make_exit(code);
+	add_range(code, "zero_divide", ZERODIV - LOAD);
 
+	uint16_t msg = code->length;
 	emit_string(code, "BASIC Runtime: Division by zero");
+	add_range(code, "zero_divide_msg", msg);
 }
 
-/* Length of this handler: 1 + 4 + 3 + 2 + 1 + 3 * 2 + 3 = 20 bytes */
-void add_strings(CompileTarget* code)
-{
-	emit_byte(code, 0x57);		/* PUSH DI */
-	emit_byte(code, 0xC7);		/* MOV */
-	emit_byte(code, 0xC7);		/* DI, */
-	emit_word(code, STRBUF);	/* imm16 */
-
-	/* CALL os_string_copy */
-	emit_call(code, 0x0039);
-
-	emit_byte(code, 0x8B);		/* MOV */
-	emit_byte(code, 0xF7);		/* SI, DI */
-
-	emit_byte(code, 0x5F);		/* POP DI */
-
-	/* Now SI = buffer with old SI, DI = 2nd string */
-	emit_byte(code, 0x8B);		/* MOV */
-	emit_byte(code, 0xC6);		/* AX, SI */
-	emit_byte(code, 0x8B);		/* MOV */
-	emit_byte(code, 0xDF);		/* BX, DI */
-	emit_byte(code, 0x8B);		/* MOV */
-	emit_byte(code, 0xCE);		/* CX, SI */
-
-	/* CALL os_string_join */
-	emit_call(code, 0x003F);
-
-	/* Return from handler */
-	emit_byte(code, 0xC3);
-}
-
-/* Length of this handler: 80 bytes */
-void print_string(CompileTarget* code)
+/* BIOS printing of -compat-print, 3 calls per character (80 bytes) */
+static void bios_print_string(CompileTarget* code)
 {
 	/* Prepare to enter print loop (19 bytes) */
 	emit_byte(code, 0xC7);		/* MOV */
@@ -156,6 +134,106 @@ void print_string(CompileTarget* code)
 	emit_byte(code, 0x90);		/* NOP */
 }
 
+/* Characters go straight to video memory of working page, DX is the cursor
+ * (read from BIOS at the start, given back at the end) and DI its address.
+ * Length of this handler: 77 bytes + 3 bytes of padding
+ */
+static void fast_print_string(CompileTarget* code)
+{
+	/* Get cursor of working page, ES = its video memory (20 bytes) */
+	emit_byte(code, 0x06);		/* PUSH ES */
+	emit_byte(code, 0x57);		/* PUSH DI */
+	emit_byte(code, 0x8A);		/* MOV */
+	emit_byte(code, 0x3E);		/* BH, */
+	emit_word(code, WORKPAGE);	/* [WORKPAGE] */
+	emit_byte(code, 0xC7);		/* MOV */
+	emit_byte(code, 0xC0);		/* AX, */
+	emit_word(code, 0x0300);	/* AH = 3 */
+	emit_byte(code, 0xCD);		/* INT */
+	emit_byte(code, 0x10);		/* 0x10 */
+	emit_byte(code, 0xC7);		/* MOV */
+	emit_byte(code, 0xC0);		/* AX, */
+	emit_word(code, 0xB800);	/* Text mode video memory */
+	emit_byte(code, 0x02);		/* ADD */
+	emit_byte(code, 0xE7);		/* AH, BH (pages are 0x1000 apart) */
+	emit_byte(code, 0x8E);		/* MOV */
+	emit_byte(code, 0xC0);		/* ES, AX */
+
+	/* DI = (row * 80 + column) * 2, AH = INK (17 bytes) */
+	emit_byte(code, 0xB0);		/* MOV AL, */
+	emit_byte(code, 0x50);		/* 80 */
+	emit_byte(code, 0xF6);		/* MUL */
+	emit_byte(code, 0xE6);		/* DH */
+	emit_byte(code, 0x02);		/* ADD */
+	emit_byte(code, 0xC2);		/* AL, DL */
+	emit_byte(code, 0x80);		/* ADC */
+	emit_byte(code, 0xD4);		/* AH, */
+	emit_byte(code, 0x00);		/* 0 */
+	emit_byte(code, 0xD1);		/* SHL */
+	emit_byte(code, 0xE0);		/* AX, 1 */
+	emit_byte(code, 0x8B);		/* MOV */
+	emit_byte(code, 0xF8);		/* DI, AX */
+	emit_byte(code, 0x8A);		/* MOV */
+	emit_byte(code, 0x26);		/* AH, */
+	emit_word(code, INKADDR);	/* [INKADDR] */
+
+	/* Loop itself, wraps after the last column (17 bytes) */
+	emit_byte(code, 0xAC);		/* LODSB */
+	emit_byte(code, 0x84);		/* TEST */
+	emit_byte(code, 0xC0);		/* AL, AL */
+	emit_byte(code, 0x74);		/* JZ */
+	emit_byte(code, 0x1A);		/* To the end (+26) */
+	emit_byte(code, 0x3C);		/* CMP AL, */
+	emit_byte(code, 0x0A);		/* 0x0A */
+	emit_byte(code, 0x74);		/* JE */
+	emit_byte(code, 0x08);		/* To newline (+8) */
+	emit_byte(code, 0xAB);		/* STOSW */
+	emit_byte(code, 0xFE);		/* INC */
+	emit_byte(code, 0xC2);		/* DL */
+	emit_byte(code, 0x80);		/* CMP */
+	emit_byte(code, 0xFA);		/* DL, */
+	emit_byte(code, 0x50);		/* 80 */
+	emit_byte(code, 0x72);		/* JB */
+	emit_byte(code, 0xEF);		/* Back to the loop (-17) */
+
+	/* Next line, scroll if it is below the screen (14 bytes) */
+	emit_byte(code, 0x32);		/* XOR */
+	emit_byte(code, 0xD2);		/* DL, DL */
+	emit_byte(code, 0xFE);		/* INC */
+	emit_byte(code, 0xC6);		/* DH */
+	emit_byte(code, 0x80);		/* CMP */
+	emit_byte(code, 0xFE);		/* DH, */
+	emit_byte(code, 0x19);		/* 25 */
+	emit_byte(code, 0x72);		/* JB */
+	emit_byte(code, 0xD5);		/* To address of the cursor (-43) */
+	emit_helper_call(code, HELPER_SCROLL);
+	emit_byte(code, 0xEB);		/* JMP */
+	emit_byte(code, 0xD0);		/* To address of the cursor (-48) */
+
+	/* Move cursor where printing ended (9 bytes) */
+	emit_byte(code, 0xC7);		/* MOV */
+	emit_byte(code, 0xC0);		/* AX, */
+	emit_word(code, 0x0200);	/* AH = 2 */
+	emit_byte(code, 0xCD);		/* INT */
+	emit_byte(code, 0x10);		/* 0x10 */
+	emit_byte(code, 0x5F);		/* POP DI */
+	emit_byte(code, 0x07);		/* POP ES */
+	emit_byte(code, 0xC3);		/* RET */
+
+	/* Padding to the length of BIOS version (3 bytes) */
+	for (int i = 0; i < 3; i++)
+		emit_byte(code, 0x90);	/* NOP */
+}
+
+/* Length of this handler: 80 bytes */
+void print_string(CompileTarget* code)
+{
+	if (options.compat_print)
+		bios_print_string(code);
+	else
+		fast_print_string(code);
+}
+
 void make_entry(CompileTarget* code, StringTable* strings)
 {
 	int len = strings->blob_len;
@@ -163,45 +241,675 @@ void make_entry(CompileTarget* code, StringTable* strings)
 
 	/* Jump over runtime and strings */
 	emit_jump(code, LOAD + rel);
+	emit_byte(code, 0x90);		/* NOP (runtime data stays aligned) */
+	add_range(code, "entry", 0);
 
 	/* Runtime functions */
-	add_strings(code);
 	zero_divide_handler(code);
 	print_string(code);
+	add_range(code, "print_string", PRINTSTR - LOAD);
 
 	/* Empty places for different values */
 	emit_word(code, 0x0007);	/* INK (default 7) */
 	emit_word(code, 0x0000);	/* RAMSTART (codegen will fill it) */
 	emit_word(code, 0x0000);	/* WORKPAGE */
 	emit_word(code, 0x0000);	/* ACTIVEPAGE */
+	emit_word(code, 0xACE1);	/* RANDSTATE (RANDOMIZE changes it) */
+	add_range(code, "runtime_data", INKADDR - LOAD);
 
 	/* Write out string table */
 	for (int i = 0; i < len; i++)
 		emit_byte(code, strings->blob[i]);
+	add_range(code, "string_table", RUNTIMELEN);
+	uint16_t start = code->length;
 
 	/* Clear out numeric variables */
 	emit_byte(code, 0x33);		/* XOR */
 	emit_byte(code, 0xC0);		/* AX, AX */
 	emit_byte(code, 0xC7);		/* MOV */
 	emit_byte(code, 0xC7);		/* DI, */
-	emit_word(code, VARS);		/* VARS */
+	emit_data(code, AREA_VARS, 0);	/* VARS */
 	emit_byte(code, 0xC7);		/* MOV */
 	emit_byte(code, 0xC1);		/* CX, */
-	emit_word(code, 0x002E);	/* 46 */
+	emit_word(code, VARSLEN / 2);	/* 26 */
 	emit_byte(code, 0xF3);		/* REP */
-	emit_byte(code, 0xAA);		/* STOSB */
+	emit_byte(code, 0xAB);		/* STOSW */
 
 	/* Clear out string variables */
 	emit_byte(code, 0xC7);		/* MOV */
 	emit_byte(code, 0xC7);		/* DI, */
-	emit_word(code, STRVARS);	/* STRVARS */
+	emit_data(code, AREA_STRVARS, 0);	/* STRVARS */
 	emit_byte(code, 0xC7);		/* MOV */
 	emit_byte(code, 0xC1);		/* CX, */
-	emit_word(code, 0x0400);	/* 1024 */
+	emit_word(code, STRVARSLEN / 2);	/* 512 */
 	emit_byte(code, 0xF3);		/* REP */
-	emit_byte(code, 0xAA);		/* STOSB */
+	emit_byte(code, 0xAB);		/* STOSW */
+
+	/* And their lengths (-string-lengths) */
+	if (options.string_lengths) {
+		emit_byte(code, 0xC7);		/* MOV */
+		emit_byte(code, 0xC7);		/* DI, */
+		emit_data(code, AREA_STRLENS, 0);	/* STRLENS */
+		emit_byte(code, 0xB1);		/* MOV CL, */
+		emit_byte(code, STRLENSLEN / 2);	/* 8 */
+		emit_byte(code, 0xF3);		/* REP */
+		emit_byte(code, 0xAB);		/* STOSW */
+	}
 
 	/* Setup stack */
 	emit_byte(code, 0x8B);		/* MOV */
 	emit_byte(code, 0xEC);		/* BP, SP */
+	add_range(code, "prologue", start);
+}
+
+/* ============================ SHARED SEQUENCES ============================ */
+/* Length: 3 bytes */
+void emit_print(CompileTarget* code)
+{
+	/* CALL print_string */
+	emit_call(code, PRINTSTR);
+	code->printed = true;
+}
+
+/* Length: 4 + 4 + 4 + 3 = 15 bytes */
+void emit_newline(CompileTarget* code)
+{
+	/* Put NL in STRBUF and print it */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC0);			/* AX, */
+	emit_word(code, 0x000A);		/* 0xA */
+	emit_byte(code, 0x89);			/* MOV */
+	emit_byte(code, 0x06);			/* [imm], AX */
+	emit_word(code, STRBUF);
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC6);			/* SI, */
+	emit_word(code, STRBUF);
+
+	emit_print(code);
+}
+
+/* Length: 13 + 10 + 11 + 4 + 15 = 53 bytes */
+void emit_file_list(CompileTarget* code)
+{
+	/* First set AX to our buffer */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC0);			/* AX, */
+	emit_word(code, STRBUF);		/* STRBUF */
+
+	/* CALL os_get_file_list */
+	emit_call(code, 0x0042);
+
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0xF0);			/* SI, AX */
+	emit_byte(code, 0x56);			/* PUSH SI */
+	emit_byte(code, 0x25);			/* AND AX, */
+	emit_word(code, 0x00FF);
+
+	/* Loop through list, replace all commas for newlines */
+	emit_byte(code, 0xAC);			/* LODSB */
+	emit_byte(code, 0x85);			/* TEST */
+	emit_byte(code, 0xC0);			/* AX, AX */
+	emit_byte(code, 0x74);			/* JZ */
+	emit_byte(code, 0x10);			/* To the end */
+	emit_byte(code, 0x3D);			/* CMP AX, */
+	emit_word(code, 0x002C);		/* 0x002C = ',' */
+	emit_byte(code, 0x75);			/* JNE */
+	emit_byte(code, 0xF6);			/* Back to the loop */
+
+	/* Replace byte */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC0);			/* AX, */
+	emit_word(code, 0x000A);		/* 0xA */
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0xFE);			/* DI, SI */
+	emit_byte(code, 0xFF);			/* DEC */
+	emit_byte(code, 0xCF);			/* DI */
+	emit_byte(code, 0xAA);			/* STOSB */
+	emit_byte(code, 0xEB);			/* JMP */
+	emit_byte(code, 0xEB);			/* Back to the loop */
+
+	emit_byte(code, 0x5E);			/* POP SI */
+	emit_print(code);
+
+	emit_newline(code);
+}
+
+/* Length: 2 + 3 + 2 + 3 + 2 + 6 + 2 + 6 + 2 + 6 = 34 bytes */
+void emit_delete_file(CompileTarget* code)
+{
+	int rvar = 'r' - 'a';
+
+	/* Check if file exists (CALL os_file_exists) */
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0xC6);			/* AX, SI */
+	emit_call(code, 0x0099);
+	emit_byte(code, 0x72);			/* JC */
+	emit_byte(code, 0x15);			/* Over exists branch */
+
+	/* Try deleting file (CALL os_remove_file) */
+	emit_call(code, 0x009F);
+	emit_byte(code, 0x72);			/* JC */
+	emit_byte(code, 0x08);			/* Jump over success */
+
+	/* File deleted, set R to 0 */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0x06);
+	emit_var(code, rvar);			/* [rvar], */
+	emit_word(code, 0x0000);		/* 0 */
+	emit_byte(code, 0xEB);			/* JMP */
+	emit_byte(code, 0x0E);			/* Over failures */
+
+	/* File couldn't be deleted, set R to 1 */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0x06);
+	emit_var(code, rvar);			/* [rvar], */
+	emit_word(code, 0x0001);		/* 1 */
+	emit_byte(code, 0xEB);			/* JMP */
+	emit_byte(code, 0x06);			/* Over failure */
+
+	/* File doesn't exist, set R to 2 */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0x06);
+	emit_var(code, rvar);			/* [rvar], */
+	emit_word(code, 0x0002);		/* 2 */
+}
+
+/* Length: 4 + 3 + 3 + 2 + 2 + 4 + 4 + 4 + 3 = 29 bytes */
+void emit_input_number(CompileTarget* code)
+{
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC0);			/* AX, */
+	emit_word(code, STRBUF);		/* STRBUF */
+
+	/* CALL os_input_string */
+	emit_call(code, 0x0036);
+
+	/* Check for empty string */
+	emit_call(code, 0x002D);
+	emit_byte(code, 0x85);			/* TEST */
+	emit_byte(code, 0xC0);			/* AX, AX */
+	emit_byte(code, 0x75);			/* JNZ */
+	emit_byte(code, 0x08);			/* Over zeroing it */
+
+	/* We need to put "0(NUL)" in buffer */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC0);			/* AX, */
+	emit_word(code, 0x0030);		/* 0x0030 -> "0\0" */
+	emit_byte(code, 0x89);			/* MOV */
+	emit_byte(code, 0x06);			/* [imm16], AX */
+	emit_word(code, STRBUF);		/* STRBUF */
+
+	/* Convert string to number */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC6);			/* SI, */
+	emit_word(code, STRBUF);		/* STRBUF */
+	/* CALL os_string_to_int */
+	emit_call(code, 0x00B1);
+}
+
+/* Step of 16 bit xorshift (7, 9, 8), instead of os_get_random (26 bytes) */
+void emit_random(CompileTarget* code)
+{
+	emit_byte(code, 0xA1);			/* MOV AX, */
+	emit_word(code, RANDSTATE);		/* [RANDSTATE] */
+
+	/* x ^= x << 7, as (x >> 1) << 8 with the lowest bit back in DL */
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0xD0);			/* DX, AX */
+	emit_byte(code, 0xD1);			/* SHR */
+	emit_byte(code, 0xEA);			/* DX, 1 */
+	emit_byte(code, 0x8A);			/* MOV */
+	emit_byte(code, 0xF2);			/* DH, DL */
+	emit_byte(code, 0xB2);			/* MOV DL, */
+	emit_byte(code, 0x00);			/* 0 */
+	emit_byte(code, 0xD0);			/* RCR */
+	emit_byte(code, 0xDA);			/* DL, 1 */
+	emit_byte(code, 0x33);			/* XOR */
+	emit_byte(code, 0xC2);			/* AX, DX */
+
+	/* x ^= x >> 9 */
+	emit_byte(code, 0x8A);			/* MOV */
+	emit_byte(code, 0xD4);			/* DL, AH */
+	emit_byte(code, 0xD0);			/* SHR */
+	emit_byte(code, 0xEA);			/* DL, 1 */
+	emit_byte(code, 0x32);			/* XOR */
+	emit_byte(code, 0xC2);			/* AL, DL */
+
+	/* x ^= x << 8 */
+	emit_byte(code, 0x32);			/* XOR */
+	emit_byte(code, 0xE0);			/* AH, AL */
+	emit_byte(code, 0xA3);			/* MOV */
+	emit_word(code, RANDSTATE);		/* [RANDSTATE], AX */
+}
+
+/* ============================ RUNTIME HELPERS ============================= */
+static void newline_helper(CompileTarget* code)
+{
+	emit_newline(code);
+	emit_byte(code, 0xC3);			/* RET */
+}
+
+/* Translate key from API call to GETKEY/WAITKEY value (47 bytes) */
+static void key_helper(CompileTarget* code, uint16_t api)
+{
+	emit_call(code, api);
+
+	/* Is it special char? (all jumps are +19) */
+	emit_byte(code, 0x3D);			/* CMP AX, */
+	emit_word(code, 0x48E0);		/* 0x48E0 */
+	emit_byte(code, 0x74);			/* JE */
+	emit_byte(code, 0x13);			/* To UP */
+	emit_byte(code, 0x3D);			/* CMP AX, */
+	emit_word(code, 0x50E0);		/* 0x50E0 */
+	emit_byte(code, 0x74);			/* JE */
+	emit_byte(code, 0x13);			/* To DOWN */
+	emit_byte(code, 0x3D);			/* CMP AX, */
+	emit_word(code, 0x4BE0);		/* 0x4BE0 */
+	emit_byte(code, 0x74);			/* JE */
+	emit_byte(code, 0x13);			/* To LEFT */
+	emit_byte(code, 0x3D);			/* CMP AX, */
+	emit_word(code, 0x4DE0);		/* 0x4DE0 */
+	emit_byte(code, 0x74);			/* JE */
+	emit_byte(code, 0x13);			/* To RIGHT */
+
+	/* Plain character */
+	emit_byte(code, 0x25);			/* AND AX, */
+	emit_word(code, 0x00FF);		/* 0x00FF */
+	emit_byte(code, 0xC3);			/* RET */
+
+	/* UP, DOWN, LEFT and RIGHT are 1 to 4 */
+	for (int i = 1; i <= 4; i++) {
+		emit_byte(code, 0xC7);		/* MOV */
+		emit_byte(code, 0xC0);		/* AX, */
+		emit_word(code, i);		/* imm16 */
+		emit_byte(code, 0xC3);		/* RET */
+	}
+}
+
+static void getkey_helper(CompileTarget* code)
+{
+	/* CALL os_check_for_key */
+	key_helper(code, 0x0015);
+}
+
+static void waitkey_helper(CompileTarget* code)
+{
+	/* CALL os_wait_for_key */
+	key_helper(code, 0x0012);
+}
+
+static void files_helper(CompileTarget* code)
+{
+	emit_file_list(code);
+	emit_byte(code, 0xC3);			/* RET */
+}
+
+static void delete_helper(CompileTarget* code)
+{
+	emit_delete_file(code);
+	emit_byte(code, 0xC3);			/* RET */
+}
+
+static void input_helper(CompileTarget* code)
+{
+	emit_input_number(code);
+	emit_byte(code, 0x50);			/* PUSH AX */
+	/* CALL os_print_newline */
+	emit_call(code, 0x000F);
+	emit_byte(code, 0x58);			/* POP AX */
+	emit_byte(code, 0xC3);			/* RET */
+}
+
+/* Scroll working page of fast print_string up, DH = last row (63 bytes) */
+static void scroll_helper(CompileTarget* code)
+{
+	emit_byte(code, 0xFE);			/* DEC */
+	emit_byte(code, 0xCE);			/* DH */
+	emit_byte(code, 0x50);			/* PUSH AX */
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0x06);			/* AX, */
+	emit_word(code, WORKPAGE);		/* [WORKPAGE] */
+	emit_byte(code, 0x3B);			/* CMP */
+	emit_byte(code, 0x06);			/* AX, */
+	emit_word(code, ACTIVEPAGE);		/* [ACTIVEPAGE] */
+	emit_byte(code, 0x75);			/* JNE */
+	emit_byte(code, 0x16);			/* To hidden page (+22) */
+
+	/* Page is on screen, let BIOS scroll it */
+	emit_byte(code, 0x53);			/* PUSH BX */
+	emit_byte(code, 0x52);			/* PUSH DX */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC0);			/* AX, */
+	emit_word(code, 0x0601);		/* AH = 6, AL = 1 line */
+	emit_byte(code, 0x8A);			/* MOV */
+	emit_byte(code, 0x3E);			/* BH, */
+	emit_word(code, INKADDR);		/* [INKADDR] */
+	emit_byte(code, 0x33);			/* XOR */
+	emit_byte(code, 0xC9);			/* CX, CX */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC2);			/* DX, */
+	emit_word(code, 0x184F);		/* Row 24, column 79 */
+	emit_byte(code, 0xCD);			/* INT */
+	emit_byte(code, 0x10);			/* 0x10 */
+	emit_byte(code, 0x5A);			/* POP DX */
+	emit_byte(code, 0x5B);			/* POP BX */
+	emit_byte(code, 0x58);			/* POP AX */
+	emit_byte(code, 0xC3);			/* RET */
+
+	/* Hidden page, move its video memory (ES) ourselves */
+	emit_byte(code, 0x58);			/* POP AX */
+	emit_byte(code, 0x56);			/* PUSH SI */
+	emit_byte(code, 0x1E);			/* PUSH DS */
+	emit_byte(code, 0x06);			/* PUSH ES */
+	emit_byte(code, 0x1F);			/* POP DS */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC6);			/* SI, */
+	emit_word(code, 80 * 2);		/* Second row */
+	emit_byte(code, 0x33);			/* XOR */
+	emit_byte(code, 0xFF);			/* DI, DI */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC1);			/* CX, */
+	emit_word(code, 24 * 80);		/* 24 rows */
+	emit_byte(code, 0xF3);			/* REP */
+	emit_byte(code, 0xA5);			/* MOVSW */
+
+	/* Clear the last row with INK (AH) */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC1);			/* CX, */
+	emit_word(code, 80);			/* 80 */
+	emit_byte(code, 0xB0);			/* MOV AL, */
+	emit_byte(code, 0x20);			/* ' ' */
+	emit_byte(code, 0xF3);			/* REP */
+	emit_byte(code, 0xAB);			/* STOSW */
+	emit_byte(code, 0x1F);			/* POP DS */
+	emit_byte(code, 0x5E);			/* POP SI */
+	emit_byte(code, 0xC3);			/* RET */
+}
+
+/* SI = DI + SI in STRBUF for -string-lengths, DX and CX are their lengths and
+ * CX becomes length of the result (34 bytes) */
+static void join_helper(CompileTarget* code)
+{
+	emit_byte(code, 0x56);			/* PUSH SI */
+	emit_byte(code, 0x51);			/* PUSH CX */
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0xF7);			/* SI, DI */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC7);			/* DI, */
+	emit_word(code, STRBUF);		/* STRBUF */
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0xCA);			/* CX, DX */
+
+	/* First string is already there when joins are chained */
+	emit_byte(code, 0x3B);			/* CMP */
+	emit_byte(code, 0xF7);			/* SI, DI */
+	emit_byte(code, 0x75);			/* JNE */
+	emit_byte(code, 0x04);			/* To the copy (+4) */
+	emit_byte(code, 0x03);			/* ADD */
+	emit_byte(code, 0xF9);			/* DI, CX */
+	emit_byte(code, 0xEB);			/* JMP short */
+	emit_byte(code, 0x02);			/* Over the copy */
+	emit_byte(code, 0xF3);			/* REP */
+	emit_byte(code, 0xA4);			/* MOVSB */
+
+	/* Second one with its terminator */
+	emit_byte(code, 0x59);			/* POP CX */
+	emit_byte(code, 0x5E);			/* POP SI */
+	emit_byte(code, 0x03);			/* ADD */
+	emit_byte(code, 0xD1);			/* DX, CX */
+	emit_byte(code, 0x41);			/* INC CX */
+	emit_byte(code, 0xF3);			/* REP */
+	emit_byte(code, 0xA4);			/* MOVSB */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC6);			/* SI, */
+	emit_word(code, STRBUF);		/* STRBUF */
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0xCA);			/* CX, DX */
+	emit_byte(code, 0xC3);			/* RET */
+}
+
+/* Copy SI to DI with its terminator, instead of os_string_copy (7 bytes) */
+static void copy_helper(CompileTarget* code)
+{
+	emit_byte(code, 0xAC);			/* LODSB */
+	emit_byte(code, 0xAA);			/* STOSB */
+	emit_byte(code, 0x84);			/* TEST */
+	emit_byte(code, 0xC0);			/* AL, AL */
+	emit_byte(code, 0x75);			/* JNZ */
+	emit_byte(code, 0xFA);			/* Back to the loop */
+	emit_byte(code, 0xC3);			/* RET */
+}
+
+/* ZF = 1 if SI and DI are equal, instead of os_string_compare (9 bytes) */
+static void compare_helper(CompileTarget* code)
+{
+	emit_byte(code, 0xAC);			/* LODSB */
+	emit_byte(code, 0xAE);			/* SCASB */
+	emit_byte(code, 0x75);			/* JNE */
+	emit_byte(code, 0x04);			/* To the end (ZF = 0) */
+	emit_byte(code, 0x84);			/* TEST */
+	emit_byte(code, 0xC0);			/* AL, AL */
+	emit_byte(code, 0x75);			/* JNZ */
+	emit_byte(code, 0xF8);			/* Back to the loop */
+	emit_byte(code, 0xC3);			/* RET */
+}
+
+static void random_helper(CompileTarget* code)
+{
+	emit_random(code);
+	emit_byte(code, 0xC3);			/* RET */
+}
+
+/* SI = AX in decimal, instead of os_int_to_string: all 5 digits are written at
+ * DI (one DIV by 100 and DIVs of bytes by 10), leading zeros skipped (52 bytes) */
+static void decimal_helper(CompileTarget* code)
+{
+	emit_byte(code, 0x57);			/* PUSH DI */
+	emit_byte(code, 0x33);			/* XOR */
+	emit_byte(code, 0xD2);			/* DX, DX */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC1);			/* CX, */
+	emit_word(code, 100);			/* 100 */
+	emit_byte(code, 0xF7);			/* DIV */
+	emit_byte(code, 0xF1);			/* CX (DX = last 2 digits) */
+
+	/* Ten thousands, then thousands and hundreds */
+	emit_byte(code, 0xF6);			/* DIV */
+	emit_byte(code, 0xF1);			/* CL (AH = middle 2 digits) */
+	emit_byte(code, 0x04);			/* ADD AL, */
+	emit_byte(code, '0');			/* '0' */
+	emit_byte(code, 0xAA);			/* STOSB */
+	emit_byte(code, 0xB1);			/* MOV CL, */
+	emit_byte(code, 10);			/* 10 */
+	emit_byte(code, 0x8A);			/* MOV */
+	emit_byte(code, 0xC4);			/* AL, AH */
+	emit_byte(code, 0x32);			/* XOR */
+	emit_byte(code, 0xE4);			/* AH, AH */
+	emit_byte(code, 0xF6);			/* DIV */
+	emit_byte(code, 0xF1);			/* CL */
+	emit_byte(code, 0x0D);			/* OR AX, */
+	emit_word(code, 0x3030);		/* '0', '0' */
+	emit_byte(code, 0xAB);			/* STOSW */
+
+	/* Tens and ones */
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0xC2);			/* AX, DX */
+	emit_byte(code, 0xF6);			/* DIV */
+	emit_byte(code, 0xF1);			/* CL */
+	emit_byte(code, 0x0D);			/* OR AX, */
+	emit_word(code, 0x3030);		/* '0', '0' */
+	emit_byte(code, 0xAB);			/* STOSW */
+	emit_byte(code, 0xC6);			/* MOV */
+	emit_byte(code, 0x05);			/* [DI], */
+	emit_byte(code, 0x00);			/* 0 */
+
+	/* Start at first digit which isn't 0 (or at the last one) */
+	emit_byte(code, 0x5F);			/* POP DI */
+	emit_byte(code, 0xB0);			/* MOV AL, */
+	emit_byte(code, '0');			/* '0' */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC1);			/* CX, */
+	emit_word(code, 4);			/* 4 */
+	emit_byte(code, 0xF3);			/* REPE */
+	emit_byte(code, 0xAE);			/* SCASB */
+	emit_byte(code, 0x74);			/* JE */
+	emit_byte(code, 0x01);			/* Over DEC (all were 0) */
+	emit_byte(code, 0x4F);			/* DEC DI */
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0xF7);			/* SI, DI */
+	emit_byte(code, 0xC3);			/* RET */
+}
+
+/* SI = AX in hexadecimal, instead of os_long_int_to_string: digits are looked
+ * up in a table after the code with XLAT (41 + 16 bytes) */
+static void hex_helper(CompileTarget* code)
+{
+	uint16_t table = LOAD + code->length + 41;
+
+	emit_byte(code, 0x57);			/* PUSH DI */
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0xD0);			/* DX, AX */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC3);			/* BX, */
+	emit_word(code, table);			/* table */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC1);			/* CX, */
+	emit_word(code, 0x0404);		/* 4 digits, shift by 4 */
+
+	/* Rotate next digit to the bottom */
+	emit_byte(code, 0xD3);			/* ROL */
+	emit_byte(code, 0xC2);			/* DX, CL */
+	emit_byte(code, 0x8A);			/* MOV */
+	emit_byte(code, 0xC2);			/* AL, DL */
+	emit_byte(code, 0x24);			/* AND AL, */
+	emit_byte(code, 0x0F);			/* 0x0F */
+	emit_byte(code, 0xD7);			/* XLAT */
+	emit_byte(code, 0xAA);			/* STOSB */
+	emit_byte(code, 0xFE);			/* DEC */
+	emit_byte(code, 0xCD);			/* CH */
+	emit_byte(code, 0x75);			/* JNZ */
+	emit_byte(code, 0xF4);			/* Back to ROL (-12) */
+	emit_byte(code, 0xC6);			/* MOV */
+	emit_byte(code, 0x05);			/* [DI], */
+	emit_byte(code, 0x00);			/* 0 */
+
+	/* Start at first digit which isn't 0 (or at the last one) */
+	emit_byte(code, 0x5F);			/* POP DI */
+	emit_byte(code, 0xB0);			/* MOV AL, */
+	emit_byte(code, '0');			/* '0' */
+	emit_byte(code, 0xC7);			/* MOV */
+	emit_byte(code, 0xC1);			/* CX, */
+	emit_word(code, 3);			/* 3 */
+	emit_byte(code, 0xF3);			/* REPE */
+	emit_byte(code, 0xAE);			/* SCASB */
+	emit_byte(code, 0x74);			/* JE */
+	emit_byte(code, 0x01);			/* Over DEC (all were 0) */
+	emit_byte(code, 0x4F);			/* DEC DI */
+	emit_byte(code, 0x8B);			/* MOV */
+	emit_byte(code, 0xF7);			/* SI, DI */
+	emit_byte(code, 0xC3);			/* RET */
+
+	for (const char* c = "0123456789ABCDEF"; *c != '\0'; c++)
+		emit_byte(code, *c);
+}
+
+typedef void (*HelperFuncPtr)(CompileTarget*);
+
+typedef struct {
+	const char* name;	/* Shown in -debug */
+	HelperFuncPtr emit;	/* Emits whole helper */
+	int inline_len;		/* Bytes at every use when it is inlined */
+	int site_len;		/* Bytes at every use when it is called */
+} Helper;
+
+static const Helper helpers[] = {
+	[HELPER_NEWLINE] = { "newline", newline_helper, 15, 3 },
+	[HELPER_GETKEY] = { "getkey", getkey_helper, 56, 7 },
+	[HELPER_WAITKEY] = { "waitkey", waitkey_helper, 56, 7 },
+	[HELPER_FILES] = { "files", files_helper, 53, 3 },
+	[HELPER_DELETE] = { "delete", delete_helper, 34, 3 },
+	[HELPER_INPUT] = { "input", input_helper, 36, 7 },
+	[HELPER_SCROLL] = { "scroll", scroll_helper, 0, 3 },
+	[HELPER_JOIN] = { "join", join_helper, 0, 3 },
+	[HELPER_COPY] = { "copy", copy_helper, 0, 3 },
+	[HELPER_COMPARE] = { "compare", compare_helper, 0, 3 },
+	[HELPER_RANDOM] = { "random", random_helper, 26, 3 },
+	[HELPER_DECIMAL] = { "decimal", decimal_helper, 0, 3 },
+	[HELPER_HEX] = { "hex", hex_helper, 0, 3 }
+};
+
+static int uses[HELPER_COUNT];	/* Uses of outlined helpers (0 if inlined) */
+
+void init_helpers()
+{
+	for (int i = 0; i < HELPER_COUNT; i++)
+		uses[i] = 0;
+}
+
+void outline_helper(HelperId id, int n)
+{
+	uses[id] = n;
+}
+
+bool is_outlined(HelperId id)
+{
+	return uses[id] != 0;
+}
+
+static bool is_called(CompileTarget* code, int id)
+{
+	for (int i = 0; i < code->helpers.length; i++)
+		if (code->helpers.table[i].id == id)
+			return true;
+
+	return false;
+}
+
+void emit_helpers(CompileTarget* code)
+{
+	uint16_t addrs[HELPER_COUNT] = { 0 };
+	bool again = true;
+
+	/* Without printing, scroll call in print_string is never reached */
+	PatchTable* h = &code->helpers;
+	for (int i = h->length - 1; i >= 0 && !code->printed; i--)
+		if (h->table[i].id == HELPER_SCROLL)
+			h->table[i] = h->table[--h->length];
+
+	/* Helpers may call each other, so repeat until nothing is added */
+	while (again) {
+		again = false;
+		for (int i = 0; i < HELPER_COUNT; i++) {
+			if (addrs[i] != 0 || !is_called(code, i))
+				continue;
+
+			addrs[i] = code->length;
+			helpers[i].emit(code);
+			add_range(code, helpers[i].name, addrs[i]);
+			again = true;
+
+			if (uses[i] == 0)
+				continue;
+
+			/* Outlining paid off by that many bytes */
+			int len = code->length - addrs[i];
+			int saved = uses[i] * (helpers[i].inline_len -
+					helpers[i].site_len) - len;
+			pass_saved(PASS_OUTLINE, saved);
+
+			if (options.debug)
+				printf("\x1B[36mOutline\x1B[0m: %s used %d "
+					"times, moved to helper (%d bytes "
+					"saved)\n", helpers[i].name, uses[i],
+					saved);
+		}
+	}
+
+	/* Now all addresses are known */
+	for (int i = 0; i < code->helpers.length; i++) {
+		uint16_t a = code->helpers.table[i].addr;
+		int16_t rel = addrs[code->helpers.table[i].id] - (a + 2);
+		code->code[a] = (uint8_t) rel & 0xFF;
+		code->code[a + 1] = (uint8_t) (rel >> 8) & 0xFF;
+	}
 }
@@ -0,0 +1,495 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Custom includes */
+#include <ast.h>
+#include <parser.h>
+#include <table.h>
+#include <options.h>
+#include <optimize.h>
+#include <util.h>
+
+#define PRINT_SIZE 7		/* MOV SI, literal and CALL print_string */
+#define NEWLINE_SIZE 15		/* emit_newline() */
+#define JOIN_SIZE 10		/* MOV SI, literal and appending it */
+#define COPY_SIZE 11		/* MOV SI, literal, MOV DI, var and copying */
+#define STRVARS 8
+
+static SymbolTable* symbols;
+static StringTable* strings;
+
+/* Text of string being built */
+static char* text;
+static int text_len;
+static int text_capacity;
+
+/* ================================ UTILITY ================================= */
+static void append(const char* s, int len)
+{
+	if (text_capacity < text_len + len + 1) {
+		while (text_capacity < text_len + len + 1)
+			text_capacity *= 2;
+		text = mem_realloc(text, text_capacity);
+	}
+
+	memcpy(text + text_len, s, len);
+	text_len += len;
+	text[text_len] = '\0';
+}
+
+static bool is_string(Node* n)
+{
+	return n != NULL && n->type == NODE_LITERAL &&
+		n->attribute == TOKEN_STRING_LITERAL;
+}
+
+/* Append what literal prints (numbers as os_int_to_string makes them) */
+static void append_literal(Node* n)
+{
+	if (is_string(n)) {
+		append(get_string(strings, n->val), strings->table[n->val].len);
+		return;
+	}
+
+	char num[8];
+	int len = snprintf(num, sizeof(num), "%u", (uint16_t) n->val);
+	append(num, len);
+}
+
+/* Make n a literal of built text */
+static void set_literal(Node* n)
+{
+	n->type = NODE_LITERAL;
+	n->attribute = TOKEN_STRING_LITERAL;
+	n->val = add_string(strings, text, text_len);
+}
+
+/* ========================== CONSTANT CONCATENATION ======================== */
+static void fold_concat(Node* n)
+{
+	/* Operands are folded first, (x + "a") + "b" becomes x + "ab" */
+	Node* left = n->op1;
+	if (left != NULL && left->type == NODE_EXPR &&
+	    left->attribute == TOKEN_PLUS && is_string(left->op2))
+		left = left->op2;
+	if (!is_string(left) || !is_string(n->op2))
+		return;
+
+	text_len = 0;
+	append_literal(left);
+	append_literal(n->op2);
+	pass_saved(PASS_FOLD_STRINGS, JOIN_SIZE);
+
+	if (options.debug)
+		printf("\x1B[36mFold\x1B[0m: line %d: joined \"%s\" at compile "
+			"time\n", n->line, text);
+
+	free_node(n->op2);
+	n->op2 = NULL;
+	if (left == n->op1) {
+		free_node(n->op1);
+		n->op1 = NULL;
+		set_literal(n);
+	}
+	else {
+		/* Outer node takes place of the inner one */
+		Node* inner = n->op1;
+		set_literal(inner->op2);
+		*n = *inner;
+		mem_free(inner);
+	}
+}
+
+static void fold_expressions(Node* n)
+{
+	/* Walk op2 in a loop, sequences of long programs are deep */
+	for (; n != NULL; n = n->op2) {
+		fold_expressions(n->op1);
+		if (n->type == NODE_EXPR && n->attribute == TOKEN_PLUS) {
+			fold_expressions(n->op2);
+			fold_concat(n);
+			return;
+		}
+	}
+}
+
+/* ============================= PRINT MERGING ============================== */
+typedef struct {
+	Node*** table;		/* Places holding statements of one block */
+	int len;
+	int capacity;
+} Block;
+
+static void add_place(Block* b, Node** place)
+{
+	if (b->capacity < b->len + 1) {
+		b->capacity *= 2;
+		b->table = mem_realloc(b->table, b->capacity * sizeof(Node**));
+	}
+	b->table[b->len++] = place;
+}
+
+/* Statements in order, nested sequences (loops, inlined bodies) included */
+static void collect(Block* b, Node** place)
+{
+	while (*place != NULL && (*place)->type == NODE_SEQUENCE) {
+		Node** stmt = &(*place)->op1;
+
+		/* Labelled sequence (inlined GOSUB) is a block of its own */
+		if (*stmt != NULL && (*stmt)->type == NODE_SEQUENCE &&
+		    find_symbol(symbols, *stmt) != -1)
+			add_place(b, stmt);
+		else
+			collect(b, stmt);
+		place = &(*place)->op2;
+	}
+
+	if (*place != NULL)
+		add_place(b, place);
+}
+
+static bool is_print(Node* n)
+{
+	return n != NULL && n->type == NODE_KEYWORD_CALL &&
+		n->attribute == TOKEN_PRINT;
+}
+
+/* PRINT "text" or PRINT number (without CHR or HEX) */
+static bool is_constant_print(Node* n)
+{
+	if (!is_print(n) || n->op1 != NULL)
+		return false;
+
+	Node* val = n->op2->op1;
+	return val != NULL && val->type == NODE_LITERAL &&
+		(val->attribute == TOKEN_STRING_LITERAL ||
+		 val->attribute == TOKEN_NUMERIC_LITERAL);
+}
+
+static bool has_newline(Node* n)
+{
+	return n->op2->op2 == NULL;
+}
+
+/* Statement can be joined with one before it (nothing jumps to it, and
+ * -instrument counts lines separately) */
+static bool can_join(Node* n)
+{
+	return !options.instrument && find_symbol(symbols, n) == -1;
+}
+
+static void add_semicolon(Node* n)
+{
+	Token t = { TOKEN_SEMICOLON, NULL, 0, n->line };
+	n->op2->op2 = init_node(NODE_KEYWORD_CALL, t, 0, NULL, NULL);
+}
+
+/* Join constant PRINTs starting at i, returns index after them */
+static int merge_run(Block* b, int i, bool newline_before)
+{
+	Node* first = *b->table[i];
+	int prints = 0, newlines = 0;
+
+	text_len = 0;
+	if (newline_before)
+		append("\n", 1);
+
+	int j = i;
+	do {
+		Node* n = *b->table[j];
+		append_literal(n->op2->op1);
+		if (has_newline(n)) {
+			append("\n", 1);
+			newlines++;
+		}
+
+		/* Joined statement is gone */
+		if (n != first) {
+			free_node(n);
+			*b->table[j] = NULL;
+			prints++;
+		}
+		j++;
+	} while (j < b->len && is_constant_print(*b->table[j]) &&
+		 can_join(*b->table[j]));
+
+	set_literal(first->op2->op1);
+	if (has_newline(first))
+		add_semicolon(first);
+	pass_saved(PASS_FOLD_STRINGS, prints * PRINT_SIZE +
+		newlines * NEWLINE_SIZE);
+
+	if (options.debug && prints > 0)
+		printf("\x1B[36mFold\x1B[0m: line %d: merged %d PRINT "
+			"statements into one\n", first->line, prints + 1);
+
+	return j;
+}
+
+static void merge_prints(Node** place);
+
+static void merge_block(Node** place)
+{
+	Block b = { mem_alloc(16 * sizeof(Node**)), 0, 16 };
+	collect(&b, place);
+
+	int i = 0;
+	while (i < b.len) {
+		Node* n = *b.table[i];
+
+		/* Newline of PRINT x goes to the following constant one */
+		bool next = i + 1 < b.len &&
+			is_constant_print(*b.table[i + 1]) &&
+			can_join(*b.table[i + 1]);
+		if (is_print(n) && !is_constant_print(n) && has_newline(n) &&
+		    next) {
+			add_semicolon(n);
+			i = merge_run(&b, i + 1, true);
+		}
+		else if (is_constant_print(n))
+			i = merge_run(&b, i, false);
+		else {
+			merge_prints(b.table[i]);
+			i++;
+		}
+	}
+
+	mem_free(b.table);
+}
+
+/* Look for blocks in statement */
+static void merge_prints(Node** place)
+{
+	Node* n = *place;
+	switch (n->type) {
+		case NODE_IF:
+			if (n->op2->op1 != NULL)
+				merge_block(&n->op2->op1);
+			if (n->op2->op2 != NULL)
+				merge_block(&n->op2->op2);
+			break;
+		case NODE_DO:
+			merge_block(&n->op2->op1);
+			break;
+		case NODE_FOR:
+			merge_block(&n->op2->op2);
+			break;
+		case NODE_SEQUENCE:
+			merge_block(place);
+			break;
+		default:
+			break;
+	}
+}
+
+/* ========================== UNUSED STRINGS REMOVAL ======================== */
+static void mark_used(Node* n, int* ids)
+{
+	for (; n != NULL; n = n->op2) {
+		mark_used(n->op1, ids);
+		if (is_string(n))
+			ids[n->val] = 1;
+	}
+}
+
+static void renumber(Node* n, int* ids)
+{
+	for (; n != NULL; n = n->op2) {
+		renumber(n->op1, ids);
+		if (is_string(n))
+			n->val = ids[n->val];
+	}
+}
+
+/* Strings replaced by joined ones would still take place in the table */
+static void remove_unused(Node* ast)
+{
+	int* ids = mem_alloc((strings->len + 1) * sizeof(int));
+	memset(ids, 0, (strings->len + 1) * sizeof(int));
+	mark_used(ast, ids);
+
+	StringTable used;
+	init_str_table(&used);
+	for (int i = 0; i < strings->len; i++)
+		if (ids[i])
+			ids[i] = add_string(&used, get_string(strings, i),
+				strings->table[i].len);
+
+	renumber(ast, ids);
+	mem_free(ids);
+	free_str_table(strings);
+	*strings = used;
+}
+
+/* ============================== COPY ELISION ============================== */
+static bool is_strvar(Node* n, int var)
+{
+	return n != NULL && n->type == NODE_VARIABLE &&
+		n->attribute == TOKEN_STRING_VARIABLE && n->val == var;
+}
+
+static bool uses(Node* n, int var)
+{
+	for (; n != NULL; n = n->op2) {
+		if (is_strvar(n, var) || uses(n->op1, var))
+			return true;
+	}
+	return false;
+}
+
+/* Anything changing contents of var (or letting other code do it) */
+static bool writes(Node* n, int var)
+{
+	for (; n != NULL; n = n->op2) {
+		if (writes(n->op1, var))
+			return true;
+
+		if (n->type == NODE_ASSIGN && is_strvar(n->op1, var))
+			return true;
+		if (n->type == NODE_EXPR && n->attribute == TOKEN_AMPERSAND &&
+		    is_strvar(n->op1, var))
+			return true;
+		if (n->type != NODE_KEYWORD_CALL)
+			continue;
+
+		switch (n->attribute) {
+			case TOKEN_ASKFILE:
+			case TOKEN_CASE:
+			case TOKEN_INPUT:
+			case TOKEN_NUMBER:
+				if (uses(n, var))
+					return true;
+				break;
+			case TOKEN_STRING:
+				if (n->op1->attribute == TOKEN_SET &&
+				    uses(n->op2->op1, var))
+					return true;
+				break;
+			default:
+				break;
+		}
+	}
+	return false;
+}
+
+/* Control can leave straight line code (so skip the assignment) */
+static bool jumps(Node* n)
+{
+	for (; n != NULL; n = n->op2) {
+		if (jumps(n->op1))
+			return true;
+		if (n->type != NODE_KEYWORD_CALL)
+			continue;
+
+		switch (n->attribute) {
+			case TOKEN_GOTO:
+			case TOKEN_GOSUB:
+			case TOKEN_RETURN:
+			case TOKEN_END:
+			case TOKEN_CALL:
+				return true;
+			default:
+				break;
+		}
+	}
+	return false;
+}
+
+static void make_literal(Node* n, int var, int id)
+{
+	for (; n != NULL; n = n->op2) {
+		make_literal(n->op1, var, id);
+		if (is_strvar(n, var)) {
+			n->type = NODE_LITERAL;
+			n->attribute = TOKEN_STRING_LITERAL;
+			n->val = id;
+		}
+	}
+}
+
+/* Variable set once to a literal, before anything can read it, is the literal
+ * itself */
+static bool elide(Node* ast, int var)
+{
+	Node** place = NULL;
+	for (Node* n = ast; n != NULL && n->type == NODE_SEQUENCE; n = n->op2) {
+		Node* s = n->op1;
+		if (s == NULL)
+			continue;
+		if (s->type == NODE_ASSIGN && is_strvar(s->op1, var)) {
+			place = &n->op1;
+			break;
+		}
+		if (uses(s, var) || jumps(s))
+			return false;
+	}
+
+	if (place == NULL)
+		return false;
+	Node* assign = *place;
+	if (!is_string(assign->op2) || !can_join(assign))
+		return false;
+
+	/* Nothing else may change it */
+	*place = NULL;
+	if (writes(ast, var)) {
+		*place = assign;
+		return false;
+	}
+
+	make_literal(ast, var, assign->op2->val);
+	pass_saved(PASS_ELIDE_COPIES, COPY_SIZE);
+
+	if (options.debug)
+		printf("\x1B[36mElide\x1B[0m: line %d: $%d is always \"%s\"\n",
+			assign->line, var + 1, get_string(strings,
+			assign->op2->val));
+
+	free_node(assign);
+	return true;
+}
+
+void elide_copies(Node* ast, SymbolTable* sym, StringTable* str)
+{
+	symbols = sym;
+	strings = str;
+
+	/* Programs may PEEK at MikeOS' string variables */
+	if (options.compat_vars)
+		return;
+
+	/* $2 = $1 can become a literal too, once $1 is one */
+	bool elided = false, again = true;
+	while (again) {
+		again = false;
+		for (int var = 0; var < STRVARS; var++)
+			again |= elide(ast, var);
+		elided |= again;
+	}
+
+	if (elided)
+		remove_unused(ast);
+}
+
+void fold_strings(Node* ast, SymbolTable* sym, StringTable* str)
+{
+	symbols = sym;
+	strings = str;
+	text_capacity = 64;
+	text_len = 0;
+	text = mem_alloc(text_capacity);
+
+	fold_expressions(ast);
+	merge_block(&ast);
+	remove_unused(ast);
+
+	mem_free(text);
+	text = NULL;
+}
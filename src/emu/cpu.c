@@ -0,0 +1,1072 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Custom includes */
+#include <emu.h>
+
+/* Prefixes of current instruction */
+static int seg_override;	/* Segment register, -1 if none */
+static int rep;			/* 0 - none, 0xF3 - REP(E), 0xF2 - REPNE */
+static Insn insn;		/* Current instruction, for timing */
+
+/* Decoded ModRM byte */
+typedef struct {
+	int mod;		/* Addressing mode (3 - register) */
+	int reg;		/* Register (or opcode extension) */
+	int rm;			/* Register or memory operand */
+	uint16_t seg;		/* Segment of memory operand */
+	uint16_t off;		/* Its offset */
+} ModRM;
+
+void emu_error(Cpu* cpu, const char* msg, int val)
+{
+	printf("\x1B[31mError (emulator)\x1B[0m: %s 0x%02X at %04X:%04X.\n",
+		msg, val, cpu->sregs[CS], cpu->ip);
+	cpu->state = RUN_ERROR;
+}
+
+/* ================================= MEMORY ================================= */
+static uint32_t linear(uint16_t seg, uint16_t off)
+{
+	return (((uint32_t) seg << 4) + off) & (EMU_MEMSIZE - 1);
+}
+
+/* Every access is counted, words at odd addresses twice */
+static void count_access(Cpu* cpu, uint16_t off, bool w)
+{
+	cpu->bus++;
+	if (w && (off & 1))
+		cpu->odd++;
+}
+
+uint8_t read8(Cpu* cpu, uint16_t seg, uint16_t off)
+{
+	count_access(cpu, off, false);
+	return cpu->mem[linear(seg, off)];
+}
+
+uint16_t read16(Cpu* cpu, uint16_t seg, uint16_t off)
+{
+	count_access(cpu, off, true);
+	return cpu->mem[linear(seg, off)] |
+		(cpu->mem[linear(seg, off + 1)] << 8);
+}
+
+void write8(Cpu* cpu, uint16_t seg, uint16_t off, uint8_t val)
+{
+	count_access(cpu, off, false);
+	cpu->mem[linear(seg, off)] = val;
+}
+
+void write16(Cpu* cpu, uint16_t seg, uint16_t off, uint16_t val)
+{
+	count_access(cpu, off, true);
+	cpu->mem[linear(seg, off)] = val & 0xFF;
+	cpu->mem[linear(seg, off + 1)] = val >> 8;
+}
+
+void push(Cpu* cpu, uint16_t val)
+{
+	cpu->regs[SP] -= 2;
+	write16(cpu, cpu->sregs[SS], cpu->regs[SP], val);
+}
+
+uint16_t pop(Cpu* cpu)
+{
+	uint16_t val = read16(cpu, cpu->sregs[SS], cpu->regs[SP]);
+	cpu->regs[SP] += 2;
+	return val;
+}
+
+/* Code comes from prefetch queue, it isn't counted as access */
+static uint8_t fetch8(Cpu* cpu)
+{
+	insn.len++;
+	return cpu->mem[linear(cpu->sregs[CS], cpu->ip++)];
+}
+
+static uint16_t fetch16(Cpu* cpu)
+{
+	uint16_t val = fetch8(cpu);
+	return val | (fetch8(cpu) << 8);
+}
+
+/* ================================ OPERANDS ================================ */
+static uint8_t get_reg8(Cpu* cpu, int r)
+{
+	return r < 4 ? cpu->regs[r] & 0xFF : cpu->regs[r - 4] >> 8;
+}
+
+static void set_reg8(Cpu* cpu, int r, uint8_t val)
+{
+	if (r < 4)
+		cpu->regs[r] = (cpu->regs[r] & 0xFF00) | val;
+	else
+		cpu->regs[r - 4] = (cpu->regs[r - 4] & 0x00FF) | (val << 8);
+}
+
+static uint16_t get_reg(Cpu* cpu, int r, bool w)
+{
+	return w ? cpu->regs[r] : get_reg8(cpu, r);
+}
+
+static void set_reg(Cpu* cpu, int r, bool w, uint16_t val)
+{
+	if (w)
+		cpu->regs[r] = val;
+	else
+		set_reg8(cpu, r, val);
+}
+
+static uint16_t data_seg(Cpu* cpu, int def)
+{
+	return cpu->sregs[seg_override != -1 ? seg_override : def];
+}
+
+static ModRM decode_modrm(Cpu* cpu)
+{
+	ModRM m;
+	uint8_t b = fetch8(cpu);
+	m.mod = b >> 6;
+	m.reg = (b >> 3) & 7;
+	m.rm = b & 7;
+	m.seg = 0;
+	m.off = 0;
+	insn.ext = m.reg;
+	insn.mem = m.mod != 3;
+
+	if (m.mod == 3)
+		return m;
+
+	/* Base and index (BP based addressing uses stack segment) */
+	int def = DS;
+	uint16_t* r = cpu->regs;
+	switch (m.rm) {
+		case 0: m.off = r[BX] + r[SI]; break;
+		case 1: m.off = r[BX] + r[DI]; break;
+		case 2: m.off = r[BP] + r[SI]; def = SS; break;
+		case 3: m.off = r[BP] + r[DI]; def = SS; break;
+		case 4: m.off = r[SI]; break;
+		case 5: m.off = r[DI]; break;
+		case 6: m.off = r[BP]; def = SS; break;
+		case 7: m.off = r[BX]; break;
+	}
+
+	/* Displacement ([disp16] replaces [BP] without one) */
+	if (m.mod == 0 && m.rm == 6) {
+		m.off = fetch16(cpu);
+		def = DS;
+	}
+	else if (m.mod == 1)
+		m.off += (int8_t) fetch8(cpu);
+	else if (m.mod == 2)
+		m.off += fetch16(cpu);
+
+	m.seg = data_seg(cpu, def);
+
+	/* 8086 needs time to calculate address */
+	static const uint8_t ea[8] = { 7, 8, 8, 7, 5, 5, 5, 5 };
+	if (m.mod == 0 && m.rm == 6)
+		insn.ea = 6;
+	else
+		insn.ea = ea[m.rm] + (m.mod != 0 ? 4 : 0);
+	insn.ea_long = m.mod != 0 && m.rm < 4;
+
+	return m;
+}
+
+static uint16_t get_rm(Cpu* cpu, ModRM* m, bool w)
+{
+	if (m->mod == 3)
+		return get_reg(cpu, m->rm, w);
+
+	return w ? read16(cpu, m->seg, m->off) : read8(cpu, m->seg, m->off);
+}
+
+static void set_rm(Cpu* cpu, ModRM* m, bool w, uint16_t val)
+{
+	if (m->mod == 3)
+		set_reg(cpu, m->rm, w, val);
+	else if (w)
+		write16(cpu, m->seg, m->off, val);
+	else
+		write8(cpu, m->seg, m->off, val);
+}
+
+/* ================================= FLAGS ================================== */
+static void set_flag(Cpu* cpu, uint16_t flag, bool val)
+{
+	if (val)
+		cpu->flags |= flag;
+	else
+		cpu->flags &= ~flag;
+}
+
+static bool get_flag(Cpu* cpu, uint16_t flag)
+{
+	return (cpu->flags & flag) != 0;
+}
+
+/* Set ZF, SF and PF for result */
+static void set_szp(Cpu* cpu, uint16_t res, bool w)
+{
+	uint16_t mask = w ? 0xFFFF : 0xFF;
+	uint16_t sign = w ? 0x8000 : 0x80;
+	uint8_t low = res & 0xFF;
+	low ^= low >> 4;
+	low ^= low >> 2;
+	low ^= low >> 1;
+
+	set_flag(cpu, FLAG_ZF, (res & mask) == 0);
+	set_flag(cpu, FLAG_SF, (res & sign) != 0);
+	set_flag(cpu, FLAG_PF, !(low & 1));
+}
+
+/* ADD, OR, ADC, SBB, AND, SUB, XOR, CMP (in order of their encoding) */
+static uint16_t alu(Cpu* cpu, int op, uint16_t a, uint16_t b, bool w)
+{
+	uint32_t mask = w ? 0xFFFF : 0xFF;
+	uint32_t sign = w ? 0x8000 : 0x80;
+	uint32_t carry = get_flag(cpu, FLAG_CF) ? 1 : 0;
+	uint32_t res = 0;
+
+	switch (op) {
+		case 0:		/* ADD */
+		case 2:		/* ADC */
+			if (op == 0)
+				carry = 0;
+			res = a + b + carry;
+			set_flag(cpu, FLAG_CF, res > mask);
+			set_flag(cpu, FLAG_OF, (a ^ res) & (b ^ res) & sign);
+			set_flag(cpu, FLAG_AF, (a ^ b ^ res) & 0x10);
+			break;
+		case 3:		/* SBB */
+		case 5:		/* SUB */
+		case 7:		/* CMP */
+			if (op != 3)
+				carry = 0;
+			res = a - b - carry;
+			set_flag(cpu, FLAG_CF, (uint32_t) a < b + carry);
+			set_flag(cpu, FLAG_OF, (a ^ b) & (a ^ res) & sign);
+			set_flag(cpu, FLAG_AF, (a ^ b ^ res) & 0x10);
+			break;
+		case 1:		/* OR */
+		case 4:		/* AND */
+		case 6:		/* XOR */
+			res = op == 1 ? a | b : op == 4 ? a & b : a ^ b;
+			set_flag(cpu, FLAG_CF, false);
+			set_flag(cpu, FLAG_OF, false);
+			break;
+	}
+
+	set_szp(cpu, res, w);
+	return res & mask;
+}
+
+/* INC and DEC leave CF alone */
+static uint16_t inc_dec(Cpu* cpu, uint16_t val, bool dec, bool w)
+{
+	bool cf = get_flag(cpu, FLAG_CF);
+	uint16_t res = alu(cpu, dec ? 5 : 0, val, 1, w);
+	set_flag(cpu, FLAG_CF, cf);
+	return res;
+}
+
+/* ROL, ROR, RCL, RCR, SHL, SHR, SAL, SAR */
+static uint16_t shift(Cpu* cpu, int op, uint16_t val, int count, bool w)
+{
+	uint16_t mask = w ? 0xFFFF : 0xFF;
+	uint16_t sign = w ? 0x8000 : 0x80;
+
+	count &= 0x1F;
+	insn.count = count;
+	if (count == 0)
+		return val;
+
+	for (int i = 0; i < count; i++) {
+		bool top = (val & sign) != 0;
+		bool cf = get_flag(cpu, FLAG_CF);
+
+		switch (op) {
+			case 0:		/* ROL */
+				val = (val << 1) | top;
+				set_flag(cpu, FLAG_CF, top);
+				break;
+			case 1:		/* ROR */
+				set_flag(cpu, FLAG_CF, val & 1);
+				val = (val >> 1) | ((val & 1) ? sign : 0);
+				break;
+			case 2:		/* RCL */
+				val = (val << 1) | cf;
+				set_flag(cpu, FLAG_CF, top);
+				break;
+			case 3:		/* RCR */
+				set_flag(cpu, FLAG_CF, val & 1);
+				val = (val >> 1) | (cf ? sign : 0);
+				break;
+			case 4:		/* SHL */
+			case 6:		/* SAL */
+				set_flag(cpu, FLAG_CF, top);
+				val <<= 1;
+				break;
+			case 5:		/* SHR */
+				set_flag(cpu, FLAG_CF, val & 1);
+				val >>= 1;
+				break;
+			case 7:		/* SAR */
+				set_flag(cpu, FLAG_CF, val & 1);
+				val = (val >> 1) | (top ? sign : 0);
+				break;
+		}
+		val &= mask;
+	}
+
+	/* OF is defined for single shifts, we set it always */
+	bool top = (val & sign) != 0;
+	if (op == 0 || op == 2 || op == 4 || op == 6)
+		set_flag(cpu, FLAG_OF, top != get_flag(cpu, FLAG_CF));
+	else if (op == 1 || op == 3)
+		set_flag(cpu, FLAG_OF, top != ((val & (sign >> 1)) != 0));
+	else if (op == 5)
+		set_flag(cpu, FLAG_OF, count == 1 && (val & (sign >> 1)));
+	else
+		set_flag(cpu, FLAG_OF, false);
+
+	if (op >= 4)
+		set_szp(cpu, val, w);
+
+	return val;
+}
+
+static bool condition(Cpu* cpu, int cc)
+{
+	bool cf = get_flag(cpu, FLAG_CF), zf = get_flag(cpu, FLAG_ZF);
+	bool sf = get_flag(cpu, FLAG_SF), of = get_flag(cpu, FLAG_OF);
+	bool pf = get_flag(cpu, FLAG_PF);
+	bool res;
+
+	switch (cc >> 1) {
+		case 0: res = of; break;		/* JO */
+		case 1: res = cf; break;		/* JB */
+		case 2: res = zf; break;		/* JZ */
+		case 3: res = cf || zf; break;		/* JBE */
+		case 4: res = sf; break;		/* JS */
+		case 5: res = pf; break;		/* JP */
+		case 6: res = sf != of; break;		/* JL */
+		default: res = zf || sf != of; break;	/* JLE */
+	}
+
+	/* Odd conditions are negations */
+	return (cc & 1) ? !res : res;
+}
+
+/* ============================== INSTRUCTIONS ============================== */
+/* MUL, IMUL, DIV and IDIV, false on divide error */
+static bool mul_div(Cpu* cpu, int op, uint16_t src, bool w)
+{
+	uint16_t* r = cpu->regs;
+
+	if (!w) {
+		uint16_t ax = r[AX];
+		switch (op) {
+			case 4: {	/* MUL */
+				r[AX] = (ax & 0xFF) * src;
+				set_flag(cpu, FLAG_CF, r[AX] >> 8);
+				break;
+			}
+			case 5: {	/* IMUL */
+				int16_t res = (int8_t) ax * (int8_t) src;
+				r[AX] = res;
+				set_flag(cpu, FLAG_CF, res != (int8_t) res);
+				break;
+			}
+			case 6: {	/* DIV */
+				if (src == 0 || ax / src > 0xFF)
+					return false;
+				r[AX] = ((ax % src) << 8) | (ax / src);
+				break;
+			}
+			case 7: {	/* IDIV */
+				int16_t a = ax;
+				int8_t b = src;
+				if (b == 0 || a / b > 127 || a / b < -128)
+					return false;
+				r[AX] = ((uint8_t) (a % b) << 8) |
+					(uint8_t) (a / b);
+				break;
+			}
+		}
+	}
+	else {
+		uint32_t dxax = ((uint32_t) r[DX] << 16) | r[AX];
+		switch (op) {
+			case 4: {	/* MUL */
+				uint32_t res = (uint32_t) r[AX] * src;
+				r[AX] = res & 0xFFFF;
+				r[DX] = res >> 16;
+				set_flag(cpu, FLAG_CF, r[DX] != 0);
+				break;
+			}
+			case 5: {	/* IMUL */
+				int32_t res = (int16_t) r[AX] * (int16_t) src;
+				r[AX] = res & 0xFFFF;
+				r[DX] = (uint32_t) res >> 16;
+				set_flag(cpu, FLAG_CF, res != (int16_t) res);
+				break;
+			}
+			case 6: {	/* DIV */
+				if (src == 0 || dxax / src > 0xFFFF)
+					return false;
+				r[AX] = dxax / src;
+				r[DX] = dxax % src;
+				break;
+			}
+			case 7: {	/* IDIV */
+				int32_t a = dxax;
+				int16_t b = src;
+				if (b == 0 || a / b > 32767 || a / b < -32768)
+					return false;
+				r[AX] = a / b;
+				r[DX] = a % b;
+				break;
+			}
+		}
+	}
+
+	set_flag(cpu, FLAG_OF, get_flag(cpu, FLAG_CF));
+	return true;
+}
+
+/* MOVS, CMPS, STOS, LODS, SCAS (with REP prefixes) */
+static void string_op(Cpu* cpu, uint8_t op)
+{
+	bool w = op & 1;
+	int delta = (get_flag(cpu, FLAG_DF) ? -1 : 1) * (w ? 2 : 1);
+	uint16_t* r = cpu->regs;
+	uint16_t src = data_seg(cpu, DS);
+	uint16_t es = cpu->sregs[ES];
+
+	while (!rep || r[CX] != 0) {
+		switch (op & 0xFE) {
+			case 0xA4: {	/* MOVS */
+				if (w)
+					write16(cpu, es, r[DI],
+						read16(cpu, src, r[SI]));
+				else
+					write8(cpu, es, r[DI],
+						read8(cpu, src, r[SI]));
+				r[SI] += delta;
+				r[DI] += delta;
+				break;
+			}
+			case 0xA6: {	/* CMPS */
+				uint16_t a = w ? read16(cpu, src, r[SI]) :
+						read8(cpu, src, r[SI]);
+				uint16_t b = w ? read16(cpu, es, r[DI]) :
+						read8(cpu, es, r[DI]);
+				alu(cpu, 7, a, b, w);
+				r[SI] += delta;
+				r[DI] += delta;
+				break;
+			}
+			case 0xAA: {	/* STOS */
+				if (w)
+					write16(cpu, es, r[DI], r[AX]);
+				else
+					write8(cpu, es, r[DI], r[AX] & 0xFF);
+				r[DI] += delta;
+				break;
+			}
+			case 0xAC: {	/* LODS */
+				set_reg(cpu, AX, w, w ? read16(cpu, src, r[SI])
+						: read8(cpu, src, r[SI]));
+				r[SI] += delta;
+				break;
+			}
+			case 0xAE: {	/* SCAS */
+				uint16_t b = w ? read16(cpu, es, r[DI]) :
+						read8(cpu, es, r[DI]);
+				alu(cpu, 7, get_reg(cpu, AX, w), b, w);
+				r[DI] += delta;
+				break;
+			}
+		}
+
+		if (!rep)
+			break;
+		r[CX]--;
+		insn.count++;
+
+		/* CMPS and SCAS also look at ZF */
+		bool cmp = (op & 0xFE) == 0xA6 || (op & 0xFE) == 0xAE;
+		if (cmp && rep == 0xF3 && !get_flag(cpu, FLAG_ZF))
+			break;
+		if (cmp && rep == 0xF2 && get_flag(cpu, FLAG_ZF))
+			break;
+	}
+}
+
+static void jump_rel(Cpu* cpu, int16_t rel, bool taken)
+{
+	if (taken)
+		cpu->ip += rel;
+}
+
+/* Everything under opcodes 0xF6/0xF7 and 0xFE/0xFF */
+static void group(Cpu* cpu, uint8_t op)
+{
+	bool w = op & 1;
+	ModRM m = decode_modrm(cpu);
+	uint16_t val = get_rm(cpu, &m, w);
+
+	if (op == 0xF6 || op == 0xF7) {
+		switch (m.reg) {
+			case 0:
+			case 1: {	/* TEST */
+				uint16_t imm = w ? fetch16(cpu) : fetch8(cpu);
+				alu(cpu, 4, val, imm, w);
+				break;
+			}
+			case 2:		/* NOT */
+				set_rm(cpu, &m, w, ~val);
+				break;
+			case 3:		/* NEG */
+				set_rm(cpu, &m, w, alu(cpu, 5, 0, val, w));
+				break;
+			default:
+				if (!mul_div(cpu, m.reg, val, w))
+					emu_error(cpu, "Divide error, opcode", op);
+				break;
+		}
+		return;
+	}
+
+	switch (m.reg) {
+		case 0:		/* INC */
+		case 1:		/* DEC */
+			set_rm(cpu, &m, w, inc_dec(cpu, val, m.reg, w));
+			return;
+		case 2:		/* CALL near */
+			push(cpu, cpu->ip);
+			cpu->ip = val;
+			return;
+		case 3:		/* CALL far */
+			push(cpu, cpu->sregs[CS]);
+			push(cpu, cpu->ip);
+			cpu->ip = val;
+			cpu->sregs[CS] = read16(cpu, m.seg, m.off + 2);
+			return;
+		case 4:		/* JMP near */
+			cpu->ip = val;
+			return;
+		case 5:		/* JMP far */
+			cpu->ip = val;
+			cpu->sregs[CS] = read16(cpu, m.seg, m.off + 2);
+			return;
+		case 6:		/* PUSH */
+			push(cpu, val);
+			return;
+	}
+
+	emu_error(cpu, "Invalid opcode extension of", op);
+}
+
+/* Execute one instruction (prefixes are part of it) */
+static void execute(Cpu* cpu, uint8_t op)
+{
+	uint16_t* r = cpu->regs;
+	bool w = op & 1;
+
+	/* Regular ALU operations: 0x00 - 0x3F with low 3 bits < 6 */
+	if (op < 0x40 && (op & 7) < 6) {
+		int alu_op = op >> 3;
+		uint16_t res;
+
+		if ((op & 7) < 4) {
+			ModRM m = decode_modrm(cpu);
+			bool d = op & 2;
+			uint16_t a = d ? get_reg(cpu, m.reg, w) :
+					get_rm(cpu, &m, w);
+			uint16_t b = d ? get_rm(cpu, &m, w) :
+					get_reg(cpu, m.reg, w);
+			res = alu(cpu, alu_op, a, b, w);
+			if (alu_op != 7 && d)
+				set_reg(cpu, m.reg, w, res);
+			else if (alu_op != 7)
+				set_rm(cpu, &m, w, res);
+		}
+		else {
+			uint16_t imm = w ? fetch16(cpu) : fetch8(cpu);
+			res = alu(cpu, alu_op, get_reg(cpu, AX, w), imm, w);
+			if (alu_op != 7)
+				set_reg(cpu, AX, w, res);
+		}
+		return;
+	}
+
+	/* Conditional short jumps */
+	if (op >= 0x70 && op <= 0x7F) {
+		int8_t rel = fetch8(cpu);
+		jump_rel(cpu, rel, condition(cpu, op & 0xF));
+		return;
+	}
+
+	/* MOV reg, imm */
+	if (op >= 0xB0 && op <= 0xBF) {
+		if (op < 0xB8)
+			set_reg8(cpu, op & 7, fetch8(cpu));
+		else
+			r[op & 7] = fetch16(cpu);
+		return;
+	}
+
+	switch (op) {
+		/* PUSH and POP of segment registers */
+		case 0x06: case 0x0E: case 0x16: case 0x1E:
+			push(cpu, cpu->sregs[(op >> 3) & 3]);
+			return;
+		case 0x07: case 0x17: case 0x1F:
+			cpu->sregs[(op >> 3) & 3] = pop(cpu);
+			return;
+
+		/* 386 near conditional jumps (0x0F 0x8?) */
+		case 0x0F: {
+			uint8_t next = fetch8(cpu);
+			insn.ext = next;
+			if (next < 0x80 || next > 0x8F) {
+				emu_error(cpu, "Unsupported opcode 0x0F", next);
+				return;
+			}
+			int16_t rel = fetch16(cpu);
+			jump_rel(cpu, rel, condition(cpu, next & 0xF));
+			return;
+		}
+
+		/* INC, DEC, PUSH, POP of registers */
+		case 0x40: case 0x41: case 0x42: case 0x43:
+		case 0x44: case 0x45: case 0x46: case 0x47:
+			r[op & 7] = inc_dec(cpu, r[op & 7], false, true);
+			return;
+		case 0x48: case 0x49: case 0x4A: case 0x4B:
+		case 0x4C: case 0x4D: case 0x4E: case 0x4F:
+			r[op & 7] = inc_dec(cpu, r[op & 7], true, true);
+			return;
+		case 0x50: case 0x51: case 0x52: case 0x53:
+		case 0x54: case 0x55: case 0x56: case 0x57: {
+			/* 8086 pushes already decremented SP */
+			uint16_t val = r[op & 7];
+			if ((op & 7) == SP)
+				val -= 2;
+			push(cpu, val);
+			return;
+		}
+		case 0x58: case 0x59: case 0x5A: case 0x5B:
+		case 0x5C: case 0x5D: case 0x5E: case 0x5F:
+			r[op & 7] = pop(cpu);
+			return;
+
+		/* 186 additions */
+		case 0x60: {		/* PUSHA */
+			uint16_t sp = r[SP];
+			for (int i = 0; i < 8; i++)
+				push(cpu, i == SP ? sp : r[i]);
+			return;
+		}
+		case 0x61:		/* POPA */
+			for (int i = 7; i >= 0; i--) {
+				uint16_t val = pop(cpu);
+				if (i != SP)
+					r[i] = val;
+			}
+			return;
+		case 0x68:		/* PUSH imm16 */
+			push(cpu, fetch16(cpu));
+			return;
+		case 0x6A:		/* PUSH imm8 */
+			push(cpu, (int8_t) fetch8(cpu));
+			return;
+		case 0x69:		/* IMUL reg, rm, imm */
+		case 0x6B: {
+			ModRM m = decode_modrm(cpu);
+			int16_t a = get_rm(cpu, &m, true);
+			int16_t b = op == 0x69 ? (int16_t) fetch16(cpu) :
+					(int8_t) fetch8(cpu);
+			int32_t res = a * b;
+			r[m.reg] = res;
+			set_flag(cpu, FLAG_CF, res != (int16_t) res);
+			set_flag(cpu, FLAG_OF, res != (int16_t) res);
+			return;
+		}
+
+		/* ALU with immediate */
+		case 0x80: case 0x81: case 0x82: case 0x83: {
+			ModRM m = decode_modrm(cpu);
+			uint16_t imm;
+			if (op == 0x81)
+				imm = fetch16(cpu);
+			else if (op == 0x83)
+				imm = (int8_t) fetch8(cpu);
+			else
+				imm = fetch8(cpu);
+			uint16_t res = alu(cpu, m.reg, get_rm(cpu, &m, w),
+					imm, w);
+			if (m.reg != 7)
+				set_rm(cpu, &m, w, res);
+			return;
+		}
+
+		/* TEST and XCHG */
+		case 0x84: case 0x85: {
+			ModRM m = decode_modrm(cpu);
+			alu(cpu, 4, get_rm(cpu, &m, w), get_reg(cpu, m.reg, w),
+				w);
+			return;
+		}
+		case 0x86: case 0x87: {
+			ModRM m = decode_modrm(cpu);
+			uint16_t tmp = get_rm(cpu, &m, w);
+			set_rm(cpu, &m, w, get_reg(cpu, m.reg, w));
+			set_reg(cpu, m.reg, w, tmp);
+			return;
+		}
+
+		/* MOV */
+		case 0x88: case 0x89: {
+			ModRM m = decode_modrm(cpu);
+			set_rm(cpu, &m, w, get_reg(cpu, m.reg, w));
+			return;
+		}
+		case 0x8A: case 0x8B: {
+			ModRM m = decode_modrm(cpu);
+			set_reg(cpu, m.reg, w, get_rm(cpu, &m, w));
+			return;
+		}
+		case 0x8C: {
+			ModRM m = decode_modrm(cpu);
+			set_rm(cpu, &m, true, cpu->sregs[m.reg & 3]);
+			return;
+		}
+		case 0x8D: {		/* LEA */
+			ModRM m = decode_modrm(cpu);
+			r[m.reg] = m.off;
+			return;
+		}
+		case 0x8E: {
+			ModRM m = decode_modrm(cpu);
+			cpu->sregs[m.reg & 3] = get_rm(cpu, &m, true);
+			return;
+		}
+		case 0x8F: {		/* POP rm */
+			ModRM m = decode_modrm(cpu);
+			set_rm(cpu, &m, true, pop(cpu));
+			return;
+		}
+
+		/* XCHG AX, reg (0x90 is NOP) */
+		case 0x90: case 0x91: case 0x92: case 0x93:
+		case 0x94: case 0x95: case 0x96: case 0x97: {
+			uint16_t tmp = r[AX];
+			r[AX] = r[op & 7];
+			r[op & 7] = tmp;
+			return;
+		}
+		case 0x98:		/* CBW */
+			r[AX] = (int8_t) (r[AX] & 0xFF);
+			return;
+		case 0x99:		/* CWD */
+			r[DX] = (r[AX] & 0x8000) ? 0xFFFF : 0;
+			return;
+		case 0x9A: {		/* CALL far */
+			uint16_t off = fetch16(cpu);
+			uint16_t seg = fetch16(cpu);
+			push(cpu, cpu->sregs[CS]);
+			push(cpu, cpu->ip);
+			cpu->sregs[CS] = seg;
+			cpu->ip = off;
+			return;
+		}
+		case 0x9B:		/* WAIT */
+			return;
+		case 0x9C:		/* PUSHF */
+			push(cpu, cpu->flags);
+			return;
+		case 0x9D:		/* POPF */
+			cpu->flags = (pop(cpu) & 0x0FD5) | 0xF002;
+			return;
+		case 0x9E:		/* SAHF */
+			cpu->flags = (cpu->flags & 0xFF00) | (r[AX] >> 8);
+			return;
+		case 0x9F:		/* LAHF */
+			set_reg8(cpu, 4, cpu->flags & 0xFF);
+			return;
+
+		/* MOV with direct address */
+		case 0xA0: case 0xA1: {
+			uint16_t off = fetch16(cpu);
+			uint16_t seg = data_seg(cpu, DS);
+			set_reg(cpu, AX, w, w ? read16(cpu, seg, off) :
+					read8(cpu, seg, off));
+			return;
+		}
+		case 0xA2: case 0xA3: {
+			uint16_t off = fetch16(cpu);
+			uint16_t seg = data_seg(cpu, DS);
+			if (w)
+				write16(cpu, seg, off, r[AX]);
+			else
+				write8(cpu, seg, off, r[AX] & 0xFF);
+			return;
+		}
+
+		/* String operations */
+		case 0xA4: case 0xA5: case 0xA6: case 0xA7:
+		case 0xAA: case 0xAB: case 0xAC: case 0xAD:
+		case 0xAE: case 0xAF:
+			string_op(cpu, op);
+			return;
+		case 0xA8: case 0xA9: {	/* TEST AL/AX, imm */
+			uint16_t imm = w ? fetch16(cpu) : fetch8(cpu);
+			alu(cpu, 4, get_reg(cpu, AX, w), imm, w);
+			return;
+		}
+
+		/* Shifts */
+		case 0xC0: case 0xC1: case 0xD0: case 0xD1:
+		case 0xD2: case 0xD3: {
+			ModRM m = decode_modrm(cpu);
+			int count = 1;
+			if (op <= 0xC1)
+				count = fetch8(cpu);
+			else if (op >= 0xD2)
+				count = r[CX] & 0xFF;
+			set_rm(cpu, &m, w, shift(cpu, m.reg,
+				get_rm(cpu, &m, w), count, w));
+			return;
+		}
+
+		/* Returns */
+		case 0xC2: {
+			uint16_t n = fetch16(cpu);
+			cpu->ip = pop(cpu);
+			r[SP] += n;
+			return;
+		}
+		case 0xC3:
+			cpu->ip = pop(cpu);
+			return;
+		case 0xCA: case 0xCB: {
+			uint16_t n = op == 0xCA ? fetch16(cpu) : 0;
+			cpu->ip = pop(cpu);
+			cpu->sregs[CS] = pop(cpu);
+			r[SP] += n;
+			return;
+		}
+		case 0xCF:		/* IRET */
+			cpu->ip = pop(cpu);
+			cpu->sregs[CS] = pop(cpu);
+			cpu->flags = pop(cpu);
+			return;
+
+		/* LES and LDS */
+		case 0xC4: case 0xC5: {
+			ModRM m = decode_modrm(cpu);
+			r[m.reg] = read16(cpu, m.seg, m.off);
+			cpu->sregs[op == 0xC4 ? ES : DS] =
+				read16(cpu, m.seg, m.off + 2);
+			return;
+		}
+
+		/* MOV rm, imm */
+		case 0xC6: case 0xC7: {
+			ModRM m = decode_modrm(cpu);
+			set_rm(cpu, &m, w, w ? fetch16(cpu) : fetch8(cpu));
+			return;
+		}
+		case 0xC9:		/* LEAVE */
+			r[SP] = r[BP];
+			r[BP] = pop(cpu);
+			return;
+
+		/* Interrupts are handled by the machine */
+		case 0xCC:
+			emu_error(cpu, "Breakpoint, opcode", op);
+			return;
+		case 0xCD: {
+			uint8_t n = fetch8(cpu);
+			if (!interrupt(cpu, n))
+				emu_error(cpu, "Unsupported interrupt", n);
+			return;
+		}
+
+		case 0xD7:		/* XLAT */
+			set_reg8(cpu, 0, read8(cpu, data_seg(cpu, DS),
+				r[BX] + (r[AX] & 0xFF)));
+			return;
+
+		/* Loops */
+		case 0xE0: case 0xE1: case 0xE2: {
+			int8_t rel = fetch8(cpu);
+			bool zf = get_flag(cpu, FLAG_ZF);
+			r[CX]--;
+			bool taken = r[CX] != 0;
+			if (op == 0xE0)
+				taken = taken && !zf;
+			else if (op == 0xE1)
+				taken = taken && zf;
+			jump_rel(cpu, rel, taken);
+			return;
+		}
+		case 0xE3: {		/* JCXZ */
+			int8_t rel = fetch8(cpu);
+			jump_rel(cpu, rel, r[CX] == 0);
+			return;
+		}
+
+		/* Ports aren't connected to anything */
+		case 0xE4: case 0xE5:
+			fetch8(cpu);
+			set_reg(cpu, AX, w, 0xFFFF);
+			return;
+		case 0xE6: case 0xE7:
+			fetch8(cpu);
+			return;
+		case 0xEC: case 0xED:
+			set_reg(cpu, AX, w, 0xFFFF);
+			return;
+		case 0xEE: case 0xEF:
+			return;
+
+		/* Calls and jumps */
+		case 0xE8: {
+			int16_t rel = fetch16(cpu);
+			push(cpu, cpu->ip);
+			cpu->ip += rel;
+			return;
+		}
+		case 0xE9: {
+			int16_t rel = fetch16(cpu);
+			cpu->ip += rel;
+			return;
+		}
+		case 0xEA: {
+			uint16_t off = fetch16(cpu);
+			cpu->sregs[CS] = fetch16(cpu);
+			cpu->ip = off;
+			return;
+		}
+		case 0xEB: {
+			int8_t rel = fetch8(cpu);
+			cpu->ip += rel;
+			return;
+		}
+
+		case 0xF4:		/* HLT */
+			cpu->state = RUN_HALTED;
+			return;
+		case 0xF5:		/* CMC */
+			set_flag(cpu, FLAG_CF, !get_flag(cpu, FLAG_CF));
+			return;
+		case 0xF6: case 0xF7: case 0xFE: case 0xFF:
+			group(cpu, op);
+			return;
+
+		/* Flags */
+		case 0xF8: set_flag(cpu, FLAG_CF, false); return;
+		case 0xF9: set_flag(cpu, FLAG_CF, true); return;
+		case 0xFA: set_flag(cpu, FLAG_IF, false); return;
+		case 0xFB: set_flag(cpu, FLAG_IF, true); return;
+		case 0xFC: set_flag(cpu, FLAG_DF, false); return;
+		case 0xFD: set_flag(cpu, FLAG_DF, true); return;
+	}
+
+	emu_error(cpu, "Unsupported opcode", op);
+}
+
+/* ================================ INTERFACE =============================== */
+void init_cpu(Cpu* cpu)
+{
+	memset(cpu->regs, 0, sizeof(cpu->regs));
+	cpu->sregs[ES] = EMU_SEGMENT;
+	cpu->sregs[CS] = EMU_SEGMENT;
+	cpu->sregs[DS] = EMU_SEGMENT;
+	cpu->sregs[SS] = EMU_STACK;
+	cpu->regs[SP] = 0xFFFE;
+	cpu->ip = LOAD;
+	cpu->flags = 0xF202;		/* Interrupts enabled */
+	cpu->mem = calloc(EMU_MEMSIZE, 1);
+	cpu->instructions = 0;
+	cpu->state = RUN_RUNNING;
+	memset(cpu->cycles, 0, sizeof(cpu->cycles));
+	memset(cpu->queue, 0, sizeof(cpu->queue));
+}
+
+void free_cpu(Cpu* cpu)
+{
+	free(cpu->mem);
+	cpu->mem = NULL;
+}
+
+void step(Cpu* cpu)
+{
+	/* MikeOS API (and the return to it) is emulated at high level */
+	if (cpu->sregs[CS] == EMU_SEGMENT && cpu->ip < EMU_APIEND) {
+		if (cpu->ip == EMU_EXIT)
+			cpu->state = RUN_EXITED;
+		else if (!call_api(cpu, cpu->ip))
+			emu_error(cpu, "Unsupported API call", cpu->ip);
+		else {
+			/* Time inside MikeOS is unknown, count only RET */
+			cpu->bus = 0;
+			cpu->odd = 0;
+			cpu->ip = pop(cpu);
+			cpu->instructions++;
+			Insn ret = { .op = 0xC3, .jumped = true };
+			count_cycles(cpu, &ret);
+		}
+		return;
+	}
+
+	seg_override = -1;
+	rep = 0;
+	memset(&insn, 0, sizeof(insn));
+	cpu->bus = 0;
+	cpu->odd = 0;
+
+	/* Gather prefixes */
+	uint16_t start = cpu->ip;
+	uint8_t op = fetch8(cpu);
+	while (true) {
+		if (op == 0x26 || op == 0x2E || op == 0x36 || op == 0x3E) {
+			seg_override = (op >> 3) & 3;
+			insn.prefixes++;
+		}
+		else if (op == 0xF2 || op == 0xF3)
+			rep = op;
+		else if (op == 0xF0)		/* LOCK does nothing */
+			insn.prefixes++;
+		else
+			break;
+		op = fetch8(cpu);
+	}
+
+	execute(cpu, op);
+
+	/* Report errors where the instruction starts */
+	if (cpu->state == RUN_ERROR) {
+		cpu->ip = start;
+		return;
+	}
+
+	insn.op = op;
+	insn.rep = rep != 0;
+	insn.jumped = cpu->ip != (uint16_t) (start + insn.len);
+	count_cycles(cpu, &insn);
+	cpu->instructions++;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/* Custom includes */
+#include <emu.h>
+#include <options.h>
+
+static const char* state_name[] = {
+	[RUN_RUNNING] = "is still running",
+	[RUN_EXITED] = "exited",
+	[RUN_LIMIT] = "hit instruction limit",
+	[RUN_HALTED] = "halted (waiting for input)",
+	[RUN_ERROR] = "failed"
+};
+
+/* Save the table of -instrument counters, as tools/counters reads it */
+static void dump_counters(Cpu* cpu, CompileTarget* code)
+{
+	FILE* f = fopen(options.counter_dump, "wb");
+	if (f == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not write %s.\n",
+			options.counter_dump);
+		return;
+	}
+
+	int addr = (EMU_SEGMENT << 4) + code->areas[AREA_COUNTERS];
+	fwrite(&cpu->mem[addr], 2, code->counters.length, f);
+	fclose(f);
+}
+
+bool run_program(CompileTarget* code, SymbolTable* sym)
+{
+	Cpu cpu;
+	init_cpu(&cpu);
+	if (cpu.mem == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not allocate emulator "
+			"memory.\n");
+		return false;
+	}
+	init_machine(&cpu);
+
+	/* Program is loaded and called by MikeOS */
+	memcpy(&cpu.mem[(EMU_SEGMENT << 4) + LOAD], code->code, code->length);
+	push(&cpu, EMU_EXIT);
+
+	bool profile = options.profile != PROFILE_OFF;
+	if (profile)
+		init_profile(code, sym);
+
+	uint64_t limit = options.run_limit;
+	while (cpu.state == RUN_RUNNING) {
+		if (cpu.instructions >= limit) {
+			cpu.state = RUN_LIMIT;
+			break;
+		}
+
+		if (!profile) {
+			step(&cpu);
+			continue;
+		}
+
+		uint16_t ip = cpu.ip;
+		uint8_t op = cpu.mem[(cpu.sregs[CS] << 4) + ip];
+		uint64_t cycles[CPU_COUNT];
+		memcpy(cycles, cpu.cycles, sizeof(cycles));
+		step(&cpu);
+		profile_step(&cpu, ip, op, cycles);
+	}
+
+	/* Show what program left on the screen */
+	dump_screen(&cpu);
+	printf("\x1B[36mEmulator\x1B[0m: program %s after %" PRIu64
+		" instructions (%" PRIu64 " cycles on 8086, %" PRIu64
+		" on 286)\n", state_name[cpu.state], cpu.instructions,
+		cpu.cycles[CPU_8086], cpu.cycles[CPU_286]);
+
+	if (profile) {
+		print_profile();
+		free_profile();
+	}
+
+	if (options.counter_dump != NULL)
+		dump_counters(&cpu, code);
+
+	bool ok = cpu.state == RUN_EXITED || cpu.state == RUN_HALTED;
+	free_cpu(&cpu);
+	return ok;
+}
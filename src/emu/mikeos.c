@@ -0,0 +1,663 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+
+/* Custom includes */
+#include <emu.h>
+
+#define COLS 80			/* Text mode is 80x25 */
+#define ROWS 25
+#define PAGES 8
+#define PAGE_SIZE 0x1000	/* Bytes between pages in video memory */
+#define TICK_INSTRS 26000	/* Instructions per timer tick (18.2 Hz) */
+#define NAME_MAX_LEN 64		/* Longest file name we accept */
+
+/* Screen state (BIOS keeps it in its data area, we keep it here) */
+static uint8_t cursor_row[PAGES];
+static uint8_t cursor_col[PAGES];
+static uint8_t active_page;
+
+/* Keyboard lookahead, -1 if there is nothing */
+static int next_key;
+
+/* Timer ticks added by os_pause, random generator state */
+static uint32_t pause_ticks;
+static uint32_t random_state;
+
+/* ================================= UTILITY ================================ */
+static void set_cf(Cpu* cpu, bool val)
+{
+	if (val)
+		cpu->flags |= FLAG_CF;
+	else
+		cpu->flags &= ~FLAG_CF;
+}
+
+/* Copy zero terminated string from program into buffer */
+static void read_str(Cpu* cpu, uint16_t off, char* buf, int max)
+{
+	int i;
+	for (i = 0; i < max - 1; i++) {
+		buf[i] = read8(cpu, EMU_SEGMENT, off + i);
+		if (buf[i] == '\0')
+			return;
+	}
+	buf[i] = '\0';
+}
+
+static void write_str(Cpu* cpu, uint16_t off, const char* str)
+{
+	do
+		write8(cpu, EMU_SEGMENT, off++, *str);
+	while (*str++ != '\0');
+}
+
+static int str_len(Cpu* cpu, uint16_t off)
+{
+	int len = 0;
+	while (read8(cpu, EMU_SEGMENT, off + len) != 0 && len < 0xFFFF)
+		len++;
+	return len;
+}
+
+/* MikeOS file names are plain names in current directory */
+static FILE* open_file(Cpu* cpu, uint16_t name, const char* mode)
+{
+	char buf[NAME_MAX_LEN];
+	read_str(cpu, name, buf, NAME_MAX_LEN);
+	if (buf[0] == '\0' || strchr(buf, '/') || strchr(buf, '\\'))
+		return NULL;
+
+	FILE* f = fopen(buf, mode);
+	if (f != NULL || mode[0] == 'w')
+		return f;
+
+	/* Names are usually written in upper case, files may not be */
+	for (char* c = buf; *c; c++)
+		*c = tolower(*c);
+	return fopen(buf, mode);
+}
+
+static bool file_exists(Cpu* cpu, uint16_t name)
+{
+	FILE* f = open_file(cpu, name, "rb");
+	if (f == NULL)
+		return false;
+	fclose(f);
+	return true;
+}
+
+/* ================================= SCREEN ================================= */
+static uint32_t cell(int page, int row, int col)
+{
+	return EMU_VRAM + (page & (PAGES - 1)) * PAGE_SIZE +
+		((row * COLS + col) % (ROWS * COLS)) * 2;
+}
+
+/* Print one row of page to standard output, without trailing spaces */
+static void print_row(Cpu* cpu, int page, int row)
+{
+	char line[COLS + 1];
+	int len = 0;
+	for (int col = 0; col < COLS; col++) {
+		uint8_t c = cpu->mem[cell(page, row, col)];
+		line[col] = (c < 0x20 || c > 0x7E) ? ' ' : c;
+		if (line[col] != ' ')
+			len = col + 1;
+	}
+	printf("%.*s\n", len, line);
+}
+
+static bool row_empty(Cpu* cpu, int page, int row)
+{
+	for (int col = 0; col < COLS; col++) {
+		uint8_t c = cpu->mem[cell(page, row, col)];
+		if (c != ' ' && c != '\0')
+			return false;
+	}
+	return true;
+}
+
+/* Output rows that are about to disappear (up to the last non-empty one) */
+static void flush_rows(Cpu* cpu, int page, int rows)
+{
+	int last = rows - 1;
+	while (last >= 0 && row_empty(cpu, page, last))
+		last--;
+	for (int row = 0; row <= last; row++)
+		print_row(cpu, page, row);
+}
+
+/* Scroll window up (INT 10h, AH = 6), zero lines clears it */
+static void scroll_up(Cpu* cpu, int page, int lines, uint8_t attr,
+	int top, int left, int bottom, int right)
+{
+	if (bottom >= ROWS)
+		bottom = ROWS - 1;
+	if (right >= COLS)
+		right = COLS - 1;
+	int height = bottom - top + 1;
+	if (lines == 0 || lines > height)
+		lines = height;
+
+	/* Whole screen is scrolled, show what goes away */
+	if (top == 0 && left == 0 && right == COLS - 1)
+		flush_rows(cpu, page, lines);
+
+	for (int row = top; row <= bottom; row++)
+		for (int col = left; col <= right; col++) {
+			uint32_t dst = cell(page, row, col);
+			if (row + lines <= bottom) {
+				uint32_t src = cell(page, row + lines, col);
+				cpu->mem[dst] = cpu->mem[src];
+				cpu->mem[dst + 1] = cpu->mem[src + 1];
+			}
+			else {
+				cpu->mem[dst] = ' ';
+				cpu->mem[dst + 1] = attr;
+			}
+		}
+}
+
+/* Scroll window down (INT 10h, AH = 7) */
+static void scroll_down(Cpu* cpu, int page, int lines, uint8_t attr,
+	int top, int left, int bottom, int right)
+{
+	if (bottom >= ROWS)
+		bottom = ROWS - 1;
+	if (right >= COLS)
+		right = COLS - 1;
+	int height = bottom - top + 1;
+	if (lines == 0 || lines > height)
+		lines = height;
+
+	for (int row = bottom; row >= top; row--)
+		for (int col = left; col <= right; col++) {
+			uint32_t dst = cell(page, row, col);
+			if (row - lines >= top) {
+				uint32_t src = cell(page, row - lines, col);
+				cpu->mem[dst] = cpu->mem[src];
+				cpu->mem[dst + 1] = cpu->mem[src + 1];
+			}
+			else {
+				cpu->mem[dst] = ' ';
+				cpu->mem[dst + 1] = attr;
+			}
+		}
+}
+
+static void clear_page(Cpu* cpu, int page)
+{
+	scroll_up(cpu, page, 0, 0x07, 0, 0, ROWS - 1, COLS - 1);
+	cursor_row[page] = 0;
+	cursor_col[page] = 0;
+}
+
+/* Teletype output (INT 10h, AH = 0x0E), used by all MikeOS printing */
+static void teletype(Cpu* cpu, int page, uint8_t c)
+{
+	page &= PAGES - 1;
+
+	switch (c) {
+		case 0x07:		/* Bell */
+			return;
+		case 0x08:		/* Backspace */
+			if (cursor_col[page] > 0)
+				cursor_col[page]--;
+			return;
+		case 0x0A:		/* Line feed */
+			cursor_row[page]++;
+			break;
+		case 0x0D:		/* Carriage return */
+			cursor_col[page] = 0;
+			return;
+		default:
+			cpu->mem[cell(page, cursor_row[page],
+				cursor_col[page])] = c;
+			if (++cursor_col[page] >= COLS) {
+				cursor_col[page] = 0;
+				cursor_row[page]++;
+			}
+			break;
+	}
+
+	if (cursor_row[page] >= ROWS) {
+		scroll_up(cpu, page, 1, 0x07, 0, 0, ROWS - 1, COLS - 1);
+		cursor_row[page] = ROWS - 1;
+	}
+}
+
+static void teletype_str(Cpu* cpu, int page, const char* str)
+{
+	while (*str)
+		teletype(cpu, page, *str++);
+}
+
+void dump_screen(Cpu* cpu)
+{
+	flush_rows(cpu, active_page, ROWS);
+}
+
+/* ================================ KEYBOARD ================================ */
+/* Translate character from standard input to BIOS key code */
+static int key_code(int c)
+{
+	switch (c) {
+		case '\n': return 0x1C0D;
+		case '\b': return 0x0E08;
+		case 0x1B: return 0x011B;
+		default: return c & 0xFF;
+	}
+}
+
+/* Look at the next key, 0 when input is over */
+static uint16_t peek_key()
+{
+	if (next_key == -1) {
+		int c = getchar();
+		if (c == '\r')
+			c = getchar();
+		next_key = c == EOF ? 0 : key_code(c);
+	}
+	return next_key;
+}
+
+static uint16_t get_key()
+{
+	uint16_t key = peek_key();
+	if (key != 0)
+		next_key = -1;
+	return key;
+}
+
+/* Wait for key, there is no one to press it after input ends */
+static uint16_t wait_key(Cpu* cpu)
+{
+	uint16_t key = get_key();
+	if (key == 0)
+		cpu->state = RUN_HALTED;
+	return key;
+}
+
+/* Read line of input into program's buffer, echoing it */
+static bool read_line(Cpu* cpu, uint16_t buf, int max, bool echo)
+{
+	int len = 0;
+	uint16_t key;
+	while ((key = get_key()) != 0 && key != 0x1C0D) {
+		char c = key & 0xFF;
+		if (c == '\b' && len > 0)
+			len--;
+		else if (c >= 0x20 && len < max)
+			write8(cpu, EMU_SEGMENT, buf + len++, c);
+		else
+			continue;
+
+		if (echo)
+			teletype(cpu, 0, c);
+	}
+	write8(cpu, EMU_SEGMENT, buf + len, 0);
+
+	return key != 0 || len > 0;
+}
+
+/* ============================= NUMBER STRINGS ============================= */
+static void number_str(char* buf, uint32_t val, int base)
+{
+	char tmp[33];
+	int len = 0;
+	do {
+		int digit = val % base;
+		tmp[len++] = digit < 10 ? '0' + digit : 'A' + digit - 10;
+		val /= base;
+	} while (val != 0);
+
+	while (len > 0)
+		*buf++ = tmp[--len];
+	*buf = '\0';
+}
+
+/* =============================== MIKEOS API =============================== */
+bool call_api(Cpu* cpu, uint16_t vector)
+{
+	uint16_t* r = cpu->regs;
+	char buf[256], tmp[256];
+
+	switch (vector) {
+		case 0x0003: {		/* os_print_string */
+			read_str(cpu, r[SI], buf, sizeof(buf));
+			teletype_str(cpu, r[BX] >> 8, buf);
+			return true;
+		}
+		case 0x0006:		/* os_move_cursor */
+			cursor_row[0] = r[DX] >> 8;
+			cursor_col[0] = r[DX] & 0xFF;
+			return true;
+		case 0x0009:		/* os_clear_screen */
+			clear_page(cpu, active_page);
+			cursor_row[0] = 0;
+			cursor_col[0] = 0;
+			return true;
+		case 0x000F:		/* os_print_newline */
+			teletype_str(cpu, r[BX] >> 8, "\r\n");
+			return true;
+		case 0x0012:		/* os_wait_for_key */
+			r[AX] = wait_key(cpu);
+			return true;
+		case 0x0015:		/* os_check_for_key */
+			r[AX] = get_key();
+			return true;
+		case 0x0018: {		/* os_int_to_string */
+			number_str(buf, r[AX], 10);
+			write_str(cpu, EMU_HLEBUF, buf);
+			r[AX] = EMU_HLEBUF;
+			return true;
+		}
+		case 0x001B:		/* os_speaker_tone */
+		case 0x001E:		/* os_speaker_off */
+		case 0x008A:		/* os_show_cursor */
+		case 0x008D:		/* os_hide_cursor */
+		case 0x00BD:		/* os_serial_port_enable */
+		case 0x00C9:		/* os_port_byte_out */
+			return true;
+		case 0x0021: {		/* os_load_file */
+			FILE* f = open_file(cpu, r[AX], "rb");
+			set_cf(cpu, f == NULL);
+			if (f == NULL)
+				return true;
+			int len = 0, c;
+			while ((c = fgetc(f)) != EOF)
+				write8(cpu, EMU_SEGMENT, r[CX] + len++, c);
+			fclose(f);
+			r[BX] = len;
+			return true;
+		}
+		case 0x0024:		/* os_pause (tenths of a second) */
+			pause_ticks += r[AX] * 182 / 100;
+			return true;
+		case 0x002D:		/* os_string_length */
+			r[AX] = str_len(cpu, r[AX]);
+			return true;
+		case 0x0030:		/* os_string_uppercase */
+		case 0x0033: {		/* os_string_lowercase */
+			for (uint16_t off = r[AX]; ; off++) {
+				uint8_t c = read8(cpu, EMU_SEGMENT, off);
+				if (c == 0)
+					break;
+				c = vector == 0x0030 ? toupper(c) : tolower(c);
+				write8(cpu, EMU_SEGMENT, off, c);
+			}
+			return true;
+		}
+		case 0x0036:		/* os_input_string */
+			read_line(cpu, r[AX], 255, true);
+			return true;
+		case 0x0039: {		/* os_string_copy */
+			int len = str_len(cpu, r[SI]);
+			for (int i = 0; i <= len; i++)
+				write8(cpu, EMU_SEGMENT, r[DI] + i,
+					read8(cpu, EMU_SEGMENT, r[SI] + i));
+			return true;
+		}
+		case 0x003C: {		/* os_dialog_box */
+			uint16_t lines[3] = { r[AX], r[BX], r[CX] };
+			for (int i = 0; i < 3; i++) {
+				if (lines[i] == 0)
+					continue;
+				read_str(cpu, lines[i], buf, sizeof(buf));
+				printf("\x1B[36mDialog\x1B[0m: %s\n", buf);
+			}
+			r[AX] = 0;
+			return true;
+		}
+		case 0x003F: {		/* os_string_join */
+			read_str(cpu, r[AX], buf, sizeof(buf));
+			read_str(cpu, r[BX], tmp, sizeof(tmp));
+			strncat(buf, tmp, sizeof(buf) - strlen(buf) - 1);
+			write_str(cpu, r[CX], buf);
+			return true;
+		}
+		case 0x0042: {		/* os_get_file_list */
+			uint16_t off = r[AX];
+			DIR* dir = opendir(".");
+			struct dirent* e;
+			bool first = true;
+			while (dir != NULL && (e = readdir(dir)) != NULL) {
+				if (e->d_name[0] == '.')
+					continue;
+				if (!first)
+					write8(cpu, EMU_SEGMENT, off++, ',');
+				for (char* c = e->d_name; *c; c++)
+					write8(cpu, EMU_SEGMENT, off++,
+						toupper(*c));
+				first = false;
+			}
+			write8(cpu, EMU_SEGMENT, off, 0);
+			if (dir != NULL)
+				closedir(dir);
+			return true;
+		}
+		case 0x0045: {		/* os_string_compare */
+			read_str(cpu, r[SI], buf, sizeof(buf));
+			read_str(cpu, r[DI], tmp, sizeof(tmp));
+			set_cf(cpu, !strcmp(buf, tmp));
+			return true;
+		}
+		case 0x005A:		/* os_file_selector */
+			r[AX] = EMU_HLEBUF;
+			set_cf(cpu, !read_line(cpu, EMU_HLEBUF, 12, false));
+			return true;
+		case 0x0060:		/* os_send_via_serial */
+			r[AX] &= 0x00FF;
+			return true;
+		case 0x0063:		/* os_get_via_serial */
+			r[AX] = 0;
+			return true;
+		case 0x0069:		/* os_get_cursor_pos */
+			r[DX] = (cursor_row[0] << 8) | cursor_col[0];
+			return true;
+		case 0x007E: {		/* os_long_int_to_string */
+			uint32_t val = ((uint32_t) r[DX] << 16) | r[AX];
+			int base = r[BX] >= 2 && r[BX] <= 36 ? r[BX] : 10;
+			number_str(buf, val, base);
+			write_str(cpu, r[DI], buf);
+			return true;
+		}
+		case 0x0096: {		/* os_write_file */
+			FILE* f = open_file(cpu, r[AX], "wb");
+			set_cf(cpu, f == NULL);
+			if (f == NULL)
+				return true;
+			for (int i = 0; i < r[CX]; i++)
+				fputc(read8(cpu, EMU_SEGMENT, r[BX] + i), f);
+			fclose(f);
+			return true;
+		}
+		case 0x0099:		/* os_file_exists */
+			set_cf(cpu, !file_exists(cpu, r[AX]));
+			return true;
+		case 0x009F:		/* os_remove_file */
+			read_str(cpu, r[AX], buf, NAME_MAX_LEN);
+			set_cf(cpu, !file_exists(cpu, r[AX]) || remove(buf));
+			return true;
+		case 0x00A2:		/* os_rename_file */
+			read_str(cpu, r[AX], buf, NAME_MAX_LEN);
+			read_str(cpu, r[BX], tmp, NAME_MAX_LEN);
+			set_cf(cpu, strchr(tmp, '/') || rename(buf, tmp));
+			return true;
+		case 0x00A5: {		/* os_get_file_size */
+			FILE* f = open_file(cpu, r[AX], "rb");
+			set_cf(cpu, f == NULL);
+			if (f == NULL)
+				return true;
+			fseek(f, 0, SEEK_END);
+			r[BX] = ftell(f);
+			fclose(f);
+			return true;
+		}
+		case 0x00AB: {		/* os_list_dialog */
+			set_cf(cpu, !read_line(cpu, EMU_HLEBUF, 5, false));
+			read_str(cpu, EMU_HLEBUF, buf, sizeof(buf));
+			r[AX] = atoi(buf);
+			return true;
+		}
+		case 0x00B1:		/* os_string_to_int */
+			read_str(cpu, r[SI], buf, sizeof(buf));
+			r[AX] = atoi(buf);
+			return true;
+		case 0x00B7: {		/* os_get_random */
+			random_state = random_state * 1103515245 + 12345;
+			uint32_t range = r[BX] - r[AX] + 1;
+			uint32_t val = (random_state >> 16) & 0x7FFF;
+			r[CX] = range ? r[AX] + val % range : r[AX];
+			return true;
+		}
+		case 0x00CC:		/* os_port_byte_in */
+			r[AX] = 0x00FF;
+			return true;
+	}
+
+	return false;
+}
+
+/* ================================== BIOS ================================== */
+static bool video(Cpu* cpu)
+{
+	uint16_t* r = cpu->regs;
+	int ah = r[AX] >> 8, al = r[AX] & 0xFF;
+	int page = (r[BX] >> 8) & (PAGES - 1);
+
+	switch (ah) {
+		case 0x00:		/* Set video mode */
+			for (int i = 0; i < PAGES; i++)
+				clear_page(cpu, i);
+			active_page = 0;
+			return true;
+		case 0x01:		/* Cursor shape */
+			return true;
+		case 0x02:		/* Set cursor position */
+			cursor_row[page] = r[DX] >> 8;
+			cursor_col[page] = r[DX] & 0xFF;
+			return true;
+		case 0x03:		/* Get cursor position */
+			r[DX] = (cursor_row[page] << 8) | cursor_col[page];
+			r[CX] = 0x0607;
+			return true;
+		case 0x05:		/* Set active page */
+			active_page = al & (PAGES - 1);
+			return true;
+		case 0x06:		/* Scroll up */
+		case 0x07:		/* Scroll down */
+			(ah == 6 ? scroll_up : scroll_down)(cpu, active_page, al,
+				r[BX] >> 8, r[CX] >> 8, r[CX] & 0xFF,
+				r[DX] >> 8, r[DX] & 0xFF);
+			return true;
+		case 0x08: {		/* Read character at cursor */
+			uint32_t c = cell(page, cursor_row[page],
+				cursor_col[page]);
+			r[AX] = (cpu->mem[c + 1] << 8) | cpu->mem[c];
+			return true;
+		}
+		case 0x09:		/* Write character and attribute */
+		case 0x0A: {		/* Write character */
+			int pos = cursor_row[page] * COLS + cursor_col[page];
+			for (int i = 0; i < r[CX] && pos + i < ROWS * COLS; i++) {
+				uint32_t c = cell(page, 0, pos + i);
+				cpu->mem[c] = al;
+				if (ah == 0x09)
+					cpu->mem[c + 1] = r[BX] & 0xFF;
+			}
+			return true;
+		}
+		case 0x0E:		/* Teletype */
+			teletype(cpu, page, al);
+			return true;
+		case 0x0F:		/* Get video mode */
+			r[AX] = (COLS << 8) | 0x03;
+			r[BX] = (active_page << 8) | (r[BX] & 0xFF);
+			return true;
+	}
+
+	return false;
+}
+
+static bool keyboard(Cpu* cpu)
+{
+	uint16_t* r = cpu->regs;
+
+	switch (r[AX] >> 8) {
+		case 0x00:		/* Wait for key */
+		case 0x10:
+			r[AX] = wait_key(cpu);
+			return true;
+		case 0x01:		/* Check for key */
+		case 0x11: {
+			r[AX] = peek_key();
+			if (r[AX] == 0)
+				cpu->flags |= FLAG_ZF;
+			else
+				cpu->flags &= ~FLAG_ZF;
+			return true;
+		}
+		case 0x02:		/* Shift flags */
+		case 0x12:
+			r[AX] &= 0xFF00;
+			return true;
+	}
+
+	return false;
+}
+
+bool interrupt(Cpu* cpu, uint8_t n)
+{
+	uint16_t* r = cpu->regs;
+
+	switch (n) {
+		case 0x10:
+			return video(cpu);
+		case 0x16:
+			return keyboard(cpu);
+		case 0x1A: {
+			if (r[AX] >> 8 != 0)
+				return false;
+
+			/* Time passes with executed instructions */
+			uint32_t ticks = cpu->instructions / TICK_INSTRS +
+				pause_ticks;
+			r[CX] = ticks >> 16;
+			r[DX] = ticks & 0xFFFF;
+			r[AX] &= 0xFF00;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void init_machine(Cpu* cpu)
+{
+	/* API vectors should never be executed, but make them returns */
+	for (int i = 0; i < EMU_APIEND; i++)
+		write8(cpu, EMU_SEGMENT, i, 0xC3);
+
+	for (int i = 0; i < PAGES; i++)
+		for (int c = 0; c < ROWS * COLS; c++) {
+			cpu->mem[cell(i, 0, c)] = ' ';
+			cpu->mem[cell(i, 0, c) + 1] = 0x07;
+		}
+
+	memset(cursor_row, 0, sizeof(cursor_row));
+	memset(cursor_col, 0, sizeof(cursor_col));
+	active_page = 0;
+	next_key = -1;
+	pause_ticks = 0;
+	random_state = 1;
+}
@@ -0,0 +1,411 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Profiler (-profile): emulator reports every executed instruction, its cost
+ * is added to the offset it came from and to the GOSUB call tree. Source lines,
+ * labels and runtime routines are found through the code map afterwards.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+/* Custom includes */
+#include <emu.h>
+#include <lexer.h>
+#include <options.h>
+
+#define PROFILE_TOP 10		/* Rows of every table */
+#define MAX_FRAMES 64		/* Deeper GOSUBs are counted in their caller */
+#define PLACE_MIKEOS 0		/* Place of time spent in MikeOS API */
+#define SOURCE_WIDTH 40		/* Characters of source line shown */
+
+typedef struct {
+	uint64_t instructions;
+	uint64_t cycles[CPU_COUNT];
+} Cost;
+
+/* Node of GOSUB call tree. Root is the main program, subroutines are its
+ * children and leaves are places (line > 0, runtime range < 0, or MikeOS) */
+typedef struct {
+	int parent;		/* -1 for root */
+	int label;		/* Called label, -1 for root and leaves */
+	int place;		/* Place of a leaf */
+	int child;		/* First child, -1 if none */
+	int sibling;		/* Next child of the parent, -1 if none */
+	uint64_t calls;		/* Times subroutine was called from here */
+	Cost cost;		/* Cost of a leaf, with children after the run */
+} CallNode;
+
+typedef struct {
+	uint16_t sp;		/* SP right after the CALL */
+	int node;		/* Node of called subroutine */
+} Frame;
+
+/* One row of a report table */
+typedef struct {
+	int id;			/* Line, label or range */
+	uint64_t calls;
+	Cost cost;
+} Row;
+
+static CompileTarget* code;
+static SymbolTable* symbols;
+static Cost* costs;		/* Cost of every offset of the program */
+static int* places;		/* Place every offset belongs to */
+static int* label_at;		/* Label starting at offset, -1 if none */
+static Cost total;
+
+static CallNode* nodes;
+static int node_len, node_cap;
+static Frame frames[MAX_FRAMES];
+static int depth;
+
+/* ============================== COLLECTING ================================ */
+static int add_node(int parent, int label, int place)
+{
+	if (node_cap < node_len + 1) {
+		node_cap = node_cap ? node_cap * 2 : 64;
+		nodes = realloc(nodes, node_cap * sizeof(CallNode));
+	}
+
+	CallNode* n = &nodes[node_len];
+	memset(n, 0, sizeof(CallNode));
+	n->parent = parent;
+	n->label = label;
+	n->place = place;
+	n->child = -1;
+	n->sibling = -1;
+	if (parent >= 0) {
+		n->sibling = nodes[parent].child;
+		nodes[parent].child = node_len;
+	}
+
+	return node_len++;
+}
+
+static int child(int parent, int label, int place)
+{
+	for (int i = nodes[parent].child; i != -1; i = nodes[i].sibling)
+		if (nodes[i].label == label && nodes[i].place == place)
+			return i;
+
+	return add_node(parent, label, place);
+}
+
+static void add_cost(Cost* c, Cost* d)
+{
+	c->instructions += d->instructions;
+	for (int i = 0; i < CPU_COUNT; i++)
+		c->cycles[i] += d->cycles[i];
+}
+
+void init_profile(CompileTarget* c, SymbolTable* sym)
+{
+	code = c;
+	symbols = sym;
+	costs = calloc(c->length, sizeof(Cost));
+	places = calloc(c->length, sizeof(int));
+	label_at = malloc(c->length * sizeof(int));
+	memset(&total, 0, sizeof(total));
+
+	for (int i = 0; i < c->length; i++) {
+		RangeTableEntry* r = find_range(c, i);
+		places[i] = r != NULL ? -1 - (int) (r - c->ranges.table) :
+				find_line(c, i);
+		label_at[i] = -1;
+	}
+
+	for (int i = 0; i < sym->len; i++)
+		if (sym->table[i].isreal && sym->table[i].addr < c->length)
+			label_at[sym->table[i].addr] = i;
+
+	node_len = 0;
+	depth = 0;
+	add_node(-1, -1, PLACE_MIKEOS);
+}
+
+void profile_step(Cpu* cpu, uint16_t ip, uint8_t op, uint64_t* cycles)
+{
+	Cost c = { 1, { 0 } };
+	for (int i = 0; i < CPU_COUNT; i++)
+		c.cycles[i] = cpu->cycles[i] - cycles[i];
+	add_cost(&total, &c);
+
+	/* Anything outside of the program is MikeOS */
+	int place = PLACE_MIKEOS;
+	bool program = cpu->sregs[CS] == EMU_SEGMENT && ip >= LOAD &&
+			ip - LOAD < code->length;
+	if (program) {
+		add_cost(&costs[ip - LOAD], &c);
+		place = places[ip - LOAD];
+	}
+
+	int frame = depth > 0 ? frames[depth - 1].node : 0;
+	add_cost(&nodes[child(frame, -1, place)].cost, &c);
+
+	/* CALL to a label is GOSUB */
+	uint16_t target = cpu->ip - LOAD;
+	if (program && op == 0xE8 && cpu->ip >= LOAD &&
+	    target < code->length && label_at[target] != -1 &&
+	    depth < MAX_FRAMES) {
+		int n = child(frame, label_at[target], PLACE_MIKEOS);
+		nodes[n].calls++;
+		frames[depth].sp = cpu->regs[SP];
+		frames[depth].node = n;
+		depth++;
+	}
+
+	/* Stack went above the return address, subroutine has returned */
+	while (depth > 0 && cpu->regs[SP] > frames[depth - 1].sp)
+		depth--;
+}
+
+/* =============================== REPORTING ================================ */
+static uint64_t metric(Cost* c)
+{
+	if (options.profile == PROFILE_INSTRUCTIONS)
+		return c->instructions;
+	return c->cycles[CPU_8086];
+}
+
+static int compare_rows(const void* a, const void* b)
+{
+	uint64_t x = metric(&((Row*) a)->cost);
+	uint64_t y = metric(&((Row*) b)->cost);
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void print_cost(Cost* c)
+{
+	uint64_t all = metric(&total);
+	printf(" %10" PRIu64 " %12" PRIu64 " %11" PRIu64 " %6.2f%%",
+		c->instructions, c->cycles[CPU_8086], c->cycles[CPU_286],
+		all ? 100.0 * metric(c) / all : 0.0);
+}
+
+static void print_header(const char* title, const char* first)
+{
+	printf("\x1B[36m%s\x1B[0m:\n", title);
+	printf("  %-20s %10s %12s %11s %7s\n", first, "Instr.", "8086 cycles",
+		"286 cycles", "Share");
+}
+
+/* Label names are kept as they were in the source */
+static int label_len(int id)
+{
+	SymbolTableEntry* s = &symbols->table[id];
+	return s->len > 0 && s->str[s->len - 1] == ':' ? s->len - 1 : s->len;
+}
+
+static void print_source_line(int line)
+{
+	int len;
+	const char* s = line_text(line, &len);
+	printf("  %.*s", len < SOURCE_WIDTH ? len : SOURCE_WIDTH, s);
+}
+
+static void report_lines()
+{
+	int max = 0;
+	for (int i = 0; i < code->lines.length; i++)
+		if (code->lines.table[i].line > max)
+			max = code->lines.table[i].line;
+
+	Row* rows = calloc(max + 1, sizeof(Row));
+	for (int i = 0; i < code->length; i++)
+		if (places[i] > 0)
+			add_cost(&rows[places[i]].cost, &costs[i]);
+	for (int i = 0; i <= max; i++)
+		rows[i].id = i;
+
+	qsort(rows, max + 1, sizeof(Row), compare_rows);
+	print_header("Hottest lines", "Line");
+	for (int i = 0; i <= max && i < PROFILE_TOP; i++) {
+		if (rows[i].cost.instructions == 0)
+			break;
+		printf("  %-20d", rows[i].id);
+		print_cost(&rows[i].cost);
+		print_source_line(rows[i].id);
+		printf("\n");
+	}
+
+	free(rows);
+}
+
+/* Code from a label up to the next one (or to the end of the program) */
+static void report_labels()
+{
+	Row* rows = calloc(symbols->len + 1, sizeof(Row));
+	int label = symbols->len;	/* Code before the first label */
+	for (int i = 0; i < code->helpers_at; i++) {
+		if (label_at[i] != -1)
+			label = label_at[i];
+		if (places[i] > 0)
+			add_cost(&rows[label].cost, &costs[i]);
+	}
+	for (int i = 0; i <= symbols->len; i++)
+		rows[i].id = i;
+
+	qsort(rows, symbols->len + 1, sizeof(Row), compare_rows);
+	print_header("Hottest labels", "Label");
+	for (int i = 0; i <= symbols->len && i < PROFILE_TOP; i++) {
+		if (rows[i].cost.instructions == 0)
+			break;
+		if (rows[i].id == symbols->len)
+			printf("  %-20s", "(start)");
+		else
+			printf("  %-20.*s", label_len(rows[i].id),
+				symbols->table[rows[i].id].str);
+		print_cost(&rows[i].cost);
+		printf("\n");
+	}
+
+	free(rows);
+}
+
+static bool called_from(int n, int label)
+{
+	for (n = nodes[n].parent; n > 0; n = nodes[n].parent)
+		if (nodes[n].label == label)
+			return true;
+	return false;
+}
+
+/* Subroutines with everything they called, recursion counted once */
+static void report_subroutines()
+{
+	/* Children always come after their parents */
+	for (int i = node_len - 1; i > 0; i--)
+		add_cost(&nodes[nodes[i].parent].cost, &nodes[i].cost);
+
+	Row* rows = calloc(symbols->len, sizeof(Row));
+	for (int i = 0; i < symbols->len; i++)
+		rows[i].id = i;
+	for (int i = 1; i < node_len; i++) {
+		int label = nodes[i].label;
+		if (label == -1)
+			continue;
+
+		rows[label].calls += nodes[i].calls;
+		if (!called_from(i, label))
+			add_cost(&rows[label].cost, &nodes[i].cost);
+	}
+
+	qsort(rows, symbols->len, sizeof(Row), compare_rows);
+	print_header("GOSUB subroutines (with what they call)", "Label (calls)");
+	for (int i = 0; i < symbols->len && i < PROFILE_TOP; i++) {
+		if (rows[i].calls == 0)
+			break;
+
+		char name[32];
+		snprintf(name, sizeof(name), "%.*s (%" PRIu64 ")",
+			label_len(rows[i].id) < 16 ? label_len(rows[i].id) : 16,
+			symbols->table[rows[i].id].str, rows[i].calls);
+		printf("  %-20s", name);
+		print_cost(&rows[i].cost);
+		printf("\n");
+	}
+
+	free(rows);
+}
+
+static void report_runtime()
+{
+	int len = code->ranges.length;
+	Row* rows = calloc(len + 1, sizeof(Row));
+	for (int i = 0; i < code->length; i++)
+		if (places[i] < 0)
+			add_cost(&rows[-1 - places[i]].cost, &costs[i]);
+	for (int i = 0; i < len; i++)
+		rows[i].id = i;
+
+	/* MikeOS is whatever didn't happen in the program */
+	rows[len].id = len;
+	rows[len].cost = total;
+	for (int i = 0; i < code->length; i++) {
+		rows[len].cost.instructions -= costs[i].instructions;
+		for (int j = 0; j < CPU_COUNT; j++)
+			rows[len].cost.cycles[j] -= costs[i].cycles[j];
+	}
+
+	qsort(rows, len + 1, sizeof(Row), compare_rows);
+	print_header("Runtime", "Routine");
+	for (int i = 0; i <= len; i++) {
+		if (rows[i].cost.instructions == 0)
+			break;
+		printf("  %-20s", rows[i].id == len ? "MikeOS API (RET only)" :
+			code->ranges.table[rows[i].id].name);
+		print_cost(&rows[i].cost);
+		printf("\n");
+	}
+
+	free(rows);
+}
+
+/* One line per leaf: "main;sub;line 12 cost", as flamegraph.pl wants it */
+static void write_folded(const char* filename)
+{
+	FILE* f = fopen(filename, "w");
+	if (f == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not write %s.\n", filename);
+		return;
+	}
+
+	int path[MAX_FRAMES + 2];
+	for (int i = 1; i < node_len; i++) {
+		if (nodes[i].label != -1 || nodes[i].cost.instructions == 0)
+			continue;
+
+		int len = 0;
+		for (int n = nodes[i].parent; n > 0; n = nodes[n].parent)
+			path[len++] = n;
+
+		fprintf(f, "main");
+		while (len > 0) {
+			int label = nodes[path[--len]].label;
+			fprintf(f, ";%.*s", label_len(label),
+				symbols->table[label].str);
+		}
+
+		int place = nodes[i].place;
+		if (place > 0)
+			fprintf(f, ";line %d", place);
+		else if (place < 0)
+			fprintf(f, ";%s", code->ranges.table[-1 - place].name);
+		else
+			fprintf(f, ";MikeOS");
+		fprintf(f, " %" PRIu64 "\n", metric(&nodes[i].cost));
+	}
+
+	fclose(f);
+}
+
+void print_profile()
+{
+	/* Folded stacks need leaf costs, so they go before the reports */
+	if (options.folded != NULL)
+		write_folded(options.folded);
+
+	printf("\x1B[36mProfile\x1B[0m (sorted by %s):\n",
+		options.profile == PROFILE_INSTRUCTIONS ? "instructions" :
+		"8086 cycles");
+	report_lines();
+	report_labels();
+	report_subroutines();
+	report_runtime();
+}
+
+void free_profile()
+{
+	free(costs);
+	free(places);
+	free(label_at);
+	free(nodes);
+	nodes = NULL;
+	node_cap = 0;
+}
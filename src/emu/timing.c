@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Custom includes */
+#include <emu.h>
+
+/* Numbers come from Intel's manuals. Times are for operands in registers and in
+ * memory (8086 adds EA calculation to the latter), unused entries are zero.
+ * 186 instructions are timed like on 80186 when 8086 is asked for.
+ */
+typedef struct {
+	uint8_t reg[CPU_COUNT];
+	uint8_t mem[CPU_COUNT];
+} Timing;
+
+#define T(r86, m86, r286, m286) { { r86, r286 }, { m86, m286 } }
+
+#define QUEUE_SIZE 6		/* Prefetch queue of both is 6 bytes */
+#define ODD_PENALTY_86 4	/* Word at odd address takes two bus cycles */
+#define ODD_PENALTY_286 2
+
+/* Cycles for a bus cycle and for fetching one byte of code */
+static const int bus_cycle[CPU_COUNT] = { 4, 2 };
+static const int byte_fetch[CPU_COUNT] = { 2, 1 };
+
+/* ================================= TABLES ================================= */
+static const Timing timing[256] = {
+	[0x00] = T(3, 16, 2, 7),	/* ADD rm8, r8 */
+	[0x01] = T(3, 16, 2, 7),	/* ADD rm16, r16 */
+	[0x02] = T(3, 9, 2, 7),		/* ADD r8, rm8 */
+	[0x03] = T(3, 9, 2, 7),		/* ADD r16, rm16 */
+	[0x04] = T(4, 0, 3, 0),		/* ADD AL, imm8 */
+	[0x05] = T(4, 0, 3, 0),		/* ADD AX, imm16 */
+	[0x06] = T(10, 0, 3, 0),	/* PUSH ES */
+	[0x07] = T(8, 0, 5, 0),		/* POP ES */
+	[0x08] = T(3, 16, 2, 7),	/* OR rm8, r8 */
+	[0x09] = T(3, 16, 2, 7),	/* OR rm16, r16 */
+	[0x0A] = T(3, 9, 2, 7),		/* OR r8, rm8 */
+	[0x0B] = T(3, 9, 2, 7),		/* OR r16, rm16 */
+	[0x0C] = T(4, 0, 3, 0),		/* OR AL, imm8 */
+	[0x0D] = T(4, 0, 3, 0),		/* OR AX, imm16 */
+	[0x0E] = T(10, 0, 3, 0),	/* PUSH CS */
+	[0x10] = T(3, 16, 2, 7),	/* ADC rm8, r8 */
+	[0x11] = T(3, 16, 2, 7),	/* ADC rm16, r16 */
+	[0x12] = T(3, 9, 2, 7),		/* ADC r8, rm8 */
+	[0x13] = T(3, 9, 2, 7),		/* ADC r16, rm16 */
+	[0x14] = T(4, 0, 3, 0),		/* ADC AL, imm8 */
+	[0x15] = T(4, 0, 3, 0),		/* ADC AX, imm16 */
+	[0x16] = T(10, 0, 3, 0),	/* PUSH SS */
+	[0x17] = T(8, 0, 5, 0),		/* POP SS */
+	[0x18] = T(3, 16, 2, 7),	/* SBB rm8, r8 */
+	[0x19] = T(3, 16, 2, 7),	/* SBB rm16, r16 */
+	[0x1A] = T(3, 9, 2, 7),		/* SBB r8, rm8 */
+	[0x1B] = T(3, 9, 2, 7),		/* SBB r16, rm16 */
+	[0x1C] = T(4, 0, 3, 0),		/* SBB AL, imm8 */
+	[0x1D] = T(4, 0, 3, 0),		/* SBB AX, imm16 */
+	[0x1E] = T(10, 0, 3, 0),	/* PUSH DS */
+	[0x1F] = T(8, 0, 5, 0),		/* POP DS */
+	[0x20] = T(3, 16, 2, 7),	/* AND rm8, r8 */
+	[0x21] = T(3, 16, 2, 7),	/* AND rm16, r16 */
+	[0x22] = T(3, 9, 2, 7),		/* AND r8, rm8 */
+	[0x23] = T(3, 9, 2, 7),		/* AND r16, rm16 */
+	[0x24] = T(4, 0, 3, 0),		/* AND AL, imm8 */
+	[0x25] = T(4, 0, 3, 0),		/* AND AX, imm16 */
+	[0x28] = T(3, 16, 2, 7),	/* SUB rm8, r8 */
+	[0x29] = T(3, 16, 2, 7),	/* SUB rm16, r16 */
+	[0x2A] = T(3, 9, 2, 7),		/* SUB r8, rm8 */
+	[0x2B] = T(3, 9, 2, 7),		/* SUB r16, rm16 */
+	[0x2C] = T(4, 0, 3, 0),		/* SUB AL, imm8 */
+	[0x2D] = T(4, 0, 3, 0),		/* SUB AX, imm16 */
+	[0x30] = T(3, 16, 2, 7),	/* XOR rm8, r8 */
+	[0x31] = T(3, 16, 2, 7),	/* XOR rm16, r16 */
+	[0x32] = T(3, 9, 2, 7),		/* XOR r8, rm8 */
+	[0x33] = T(3, 9, 2, 7),		/* XOR r16, rm16 */
+	[0x34] = T(4, 0, 3, 0),		/* XOR AL, imm8 */
+	[0x35] = T(4, 0, 3, 0),		/* XOR AX, imm16 */
+	[0x38] = T(3, 9, 2, 7),		/* CMP rm8, r8 */
+	[0x39] = T(3, 9, 2, 7),		/* CMP rm16, r16 */
+	[0x3A] = T(3, 9, 2, 7),		/* CMP r8, rm8 */
+	[0x3B] = T(3, 9, 2, 7),		/* CMP r16, rm16 */
+	[0x3C] = T(4, 0, 3, 0),		/* CMP AL, imm8 */
+	[0x3D] = T(4, 0, 3, 0),		/* CMP AX, imm16 */
+	[0x40] = T(2, 0, 2, 0),		/* INC AX */
+	[0x41] = T(2, 0, 2, 0),		/* INC CX */
+	[0x42] = T(2, 0, 2, 0),		/* INC DX */
+	[0x43] = T(2, 0, 2, 0),		/* INC BX */
+	[0x44] = T(2, 0, 2, 0),		/* INC SP */
+	[0x45] = T(2, 0, 2, 0),		/* INC BP */
+	[0x46] = T(2, 0, 2, 0),		/* INC SI */
+	[0x47] = T(2, 0, 2, 0),		/* INC DI */
+	[0x48] = T(2, 0, 2, 0),		/* DEC AX */
+	[0x49] = T(2, 0, 2, 0),		/* DEC CX */
+	[0x4A] = T(2, 0, 2, 0),		/* DEC DX */
+	[0x4B] = T(2, 0, 2, 0),		/* DEC BX */
+	[0x4C] = T(2, 0, 2, 0),		/* DEC SP */
+	[0x4D] = T(2, 0, 2, 0),		/* DEC BP */
+	[0x4E] = T(2, 0, 2, 0),		/* DEC SI */
+	[0x4F] = T(2, 0, 2, 0),		/* DEC DI */
+	[0x50] = T(11, 0, 3, 0),	/* PUSH AX */
+	[0x51] = T(11, 0, 3, 0),	/* PUSH CX */
+	[0x52] = T(11, 0, 3, 0),	/* PUSH DX */
+	[0x53] = T(11, 0, 3, 0),	/* PUSH BX */
+	[0x54] = T(11, 0, 3, 0),	/* PUSH SP */
+	[0x55] = T(11, 0, 3, 0),	/* PUSH BP */
+	[0x56] = T(11, 0, 3, 0),	/* PUSH SI */
+	[0x57] = T(11, 0, 3, 0),	/* PUSH DI */
+	[0x58] = T(8, 0, 5, 0),		/* POP AX */
+	[0x59] = T(8, 0, 5, 0),		/* POP CX */
+	[0x5A] = T(8, 0, 5, 0),		/* POP DX */
+	[0x5B] = T(8, 0, 5, 0),		/* POP BX */
+	[0x5C] = T(8, 0, 5, 0),		/* POP SP */
+	[0x5D] = T(8, 0, 5, 0),		/* POP BP */
+	[0x5E] = T(8, 0, 5, 0),		/* POP SI */
+	[0x5F] = T(8, 0, 5, 0),		/* POP DI */
+	[0x60] = T(36, 0, 17, 0),	/* PUSHA (186) */
+	[0x61] = T(51, 0, 19, 0),	/* POPA (186) */
+	[0x68] = T(10, 0, 3, 0),	/* PUSH imm16 (186) */
+	[0x69] = T(23, 29, 21, 24),	/* IMUL r16, rm16, imm16 (186) */
+	[0x6A] = T(10, 0, 3, 0),	/* PUSH imm8 (186) */
+	[0x6B] = T(23, 29, 21, 24),	/* IMUL r16, rm16, imm8 (186) */
+	[0x70] = T(4, 0, 3, 0),		/* JO rel8 (not taken) */
+	[0x71] = T(4, 0, 3, 0),		/* JNO rel8 (not taken) */
+	[0x72] = T(4, 0, 3, 0),		/* JB rel8 (not taken) */
+	[0x73] = T(4, 0, 3, 0),		/* JNB rel8 (not taken) */
+	[0x74] = T(4, 0, 3, 0),		/* JZ rel8 (not taken) */
+	[0x75] = T(4, 0, 3, 0),		/* JNZ rel8 (not taken) */
+	[0x76] = T(4, 0, 3, 0),		/* JBE rel8 (not taken) */
+	[0x77] = T(4, 0, 3, 0),		/* JA rel8 (not taken) */
+	[0x78] = T(4, 0, 3, 0),		/* JS rel8 (not taken) */
+	[0x79] = T(4, 0, 3, 0),		/* JNS rel8 (not taken) */
+	[0x7A] = T(4, 0, 3, 0),		/* JP rel8 (not taken) */
+	[0x7B] = T(4, 0, 3, 0),		/* JNP rel8 (not taken) */
+	[0x7C] = T(4, 0, 3, 0),		/* JL rel8 (not taken) */
+	[0x7D] = T(4, 0, 3, 0),		/* JGE rel8 (not taken) */
+	[0x7E] = T(4, 0, 3, 0),		/* JLE rel8 (not taken) */
+	[0x7F] = T(4, 0, 3, 0),		/* JG rel8 (not taken) */
+	[0x80] = T(4, 17, 3, 7),	/* Group 1 rm8, imm8 */
+	[0x81] = T(4, 17, 3, 7),	/* Group 1 rm16, imm16 */
+	[0x82] = T(4, 17, 3, 7),	/* Group 1 rm8, imm8 */
+	[0x83] = T(4, 17, 3, 7),	/* Group 1 rm16, imm8 */
+	[0x84] = T(3, 9, 2, 6),		/* TEST rm8, r8 */
+	[0x85] = T(3, 9, 2, 6),		/* TEST rm16, r16 */
+	[0x86] = T(4, 17, 3, 5),	/* XCHG rm8, r8 */
+	[0x87] = T(4, 17, 3, 5),	/* XCHG rm16, r16 */
+	[0x88] = T(2, 9, 2, 3),		/* MOV rm8, r8 */
+	[0x89] = T(2, 9, 2, 3),		/* MOV rm16, r16 */
+	[0x8A] = T(2, 8, 2, 5),		/* MOV r8, rm8 */
+	[0x8B] = T(2, 8, 2, 5),		/* MOV r16, rm16 */
+	[0x8C] = T(2, 9, 2, 3),		/* MOV rm16, sreg */
+	[0x8D] = T(2, 2, 3, 3),		/* LEA r16, m */
+	[0x8E] = T(2, 8, 2, 5),		/* MOV sreg, rm16 */
+	[0x8F] = T(8, 17, 5, 5),	/* POP rm16 */
+	[0x90] = T(3, 0, 3, 0),		/* NOP */
+	[0x91] = T(3, 0, 3, 0),		/* XCHG AX, CX */
+	[0x92] = T(3, 0, 3, 0),		/* XCHG AX, DX */
+	[0x93] = T(3, 0, 3, 0),		/* XCHG AX, BX */
+	[0x94] = T(3, 0, 3, 0),		/* XCHG AX, SP */
+	[0x95] = T(3, 0, 3, 0),		/* XCHG AX, BP */
+	[0x96] = T(3, 0, 3, 0),		/* XCHG AX, SI */
+	[0x97] = T(3, 0, 3, 0),		/* XCHG AX, DI */
+	[0x98] = T(2, 0, 2, 0),		/* CBW */
+	[0x99] = T(5, 0, 2, 0),		/* CWD */
+	[0x9A] = T(28, 0, 13, 0),	/* CALL far */
+	[0x9B] = T(3, 0, 3, 0),		/* WAIT */
+	[0x9C] = T(10, 0, 3, 0),	/* PUSHF */
+	[0x9D] = T(8, 0, 5, 0),		/* POPF */
+	[0x9E] = T(4, 0, 2, 0),		/* SAHF */
+	[0x9F] = T(4, 0, 2, 0),		/* LAHF */
+	[0xA0] = T(10, 0, 5, 0),	/* MOV AL, [imm16] */
+	[0xA1] = T(10, 0, 5, 0),	/* MOV AX, [imm16] */
+	[0xA2] = T(10, 0, 3, 0),	/* MOV [imm16], AL */
+	[0xA3] = T(10, 0, 3, 0),	/* MOV [imm16], AX */
+	[0xA4] = T(18, 0, 5, 0),	/* MOVSB */
+	[0xA5] = T(18, 0, 5, 0),	/* MOVSW */
+	[0xA6] = T(22, 0, 8, 0),	/* CMPSB */
+	[0xA7] = T(22, 0, 8, 0),	/* CMPSW */
+	[0xA8] = T(4, 0, 3, 0),		/* TEST AL, imm8 */
+	[0xA9] = T(4, 0, 3, 0),		/* TEST AX, imm16 */
+	[0xAA] = T(11, 0, 3, 0),	/* STOSB */
+	[0xAB] = T(11, 0, 3, 0),	/* STOSW */
+	[0xAC] = T(12, 0, 5, 0),	/* LODSB */
+	[0xAD] = T(12, 0, 5, 0),	/* LODSW */
+	[0xAE] = T(15, 0, 7, 0),	/* SCASB */
+	[0xAF] = T(15, 0, 7, 0),	/* SCASW */
+	[0xB0] = T(4, 0, 2, 0),		/* MOV AL, imm8 */
+	[0xB1] = T(4, 0, 2, 0),		/* MOV CL, imm8 */
+	[0xB2] = T(4, 0, 2, 0),		/* MOV DL, imm8 */
+	[0xB3] = T(4, 0, 2, 0),		/* MOV BL, imm8 */
+	[0xB4] = T(4, 0, 2, 0),		/* MOV AH, imm8 */
+	[0xB5] = T(4, 0, 2, 0),		/* MOV CH, imm8 */
+	[0xB6] = T(4, 0, 2, 0),		/* MOV DH, imm8 */
+	[0xB7] = T(4, 0, 2, 0),		/* MOV BH, imm8 */
+	[0xB8] = T(4, 0, 2, 0),		/* MOV AX, imm16 */
+	[0xB9] = T(4, 0, 2, 0),		/* MOV CX, imm16 */
+	[0xBA] = T(4, 0, 2, 0),		/* MOV DX, imm16 */
+	[0xBB] = T(4, 0, 2, 0),		/* MOV BX, imm16 */
+	[0xBC] = T(4, 0, 2, 0),		/* MOV SP, imm16 */
+	[0xBD] = T(4, 0, 2, 0),		/* MOV BP, imm16 */
+	[0xBE] = T(4, 0, 2, 0),		/* MOV SI, imm16 */
+	[0xBF] = T(4, 0, 2, 0),		/* MOV DI, imm16 */
+	[0xC0] = T(5, 17, 5, 8),	/* Group 2 rm8, imm8 (186) */
+	[0xC1] = T(5, 17, 5, 8),	/* Group 2 rm16, imm8 (186) */
+	[0xC2] = T(20, 0, 11, 0),	/* RET imm16 */
+	[0xC3] = T(16, 0, 11, 0),	/* RET */
+	[0xC4] = T(0, 16, 0, 7),	/* LES r16, m */
+	[0xC5] = T(0, 16, 0, 7),	/* LDS r16, m */
+	[0xC6] = T(4, 10, 2, 3),	/* MOV rm8, imm8 */
+	[0xC7] = T(4, 10, 2, 3),	/* MOV rm16, imm16 */
+	[0xC9] = T(8, 0, 5, 0),		/* LEAVE (186) */
+	[0xCA] = T(25, 0, 15, 0),	/* RETF imm16 */
+	[0xCB] = T(26, 0, 15, 0),	/* RETF */
+	[0xCC] = T(52, 0, 23, 0),	/* INT 3 */
+	[0xCD] = T(51, 0, 23, 0),	/* INT imm8 */
+	[0xCF] = T(24, 0, 17, 0),	/* IRET */
+	[0xD0] = T(2, 15, 2, 7),	/* Group 2 rm8, 1 */
+	[0xD1] = T(2, 15, 2, 7),	/* Group 2 rm16, 1 */
+	[0xD2] = T(8, 20, 5, 8),	/* Group 2 rm8, CL */
+	[0xD3] = T(8, 20, 5, 8),	/* Group 2 rm16, CL */
+	[0xD7] = T(11, 0, 5, 0),	/* XLAT */
+	[0xE0] = T(5, 0, 4, 0),		/* LOOPNE (not taken) */
+	[0xE1] = T(6, 0, 4, 0),		/* LOOPE (not taken) */
+	[0xE2] = T(5, 0, 4, 0),		/* LOOP (not taken) */
+	[0xE3] = T(6, 0, 4, 0),		/* JCXZ (not taken) */
+	[0xE4] = T(10, 0, 5, 0),	/* IN AL, imm8 */
+	[0xE5] = T(10, 0, 5, 0),	/* IN AX, imm8 */
+	[0xE6] = T(10, 0, 3, 0),	/* OUT imm8, AL */
+	[0xE7] = T(10, 0, 3, 0),	/* OUT imm8, AX */
+	[0xE8] = T(19, 0, 7, 0),	/* CALL rel16 */
+	[0xE9] = T(15, 0, 7, 0),	/* JMP rel16 */
+	[0xEA] = T(15, 0, 11, 0),	/* JMP far */
+	[0xEB] = T(15, 0, 7, 0),	/* JMP rel8 */
+	[0xEC] = T(8, 0, 5, 0),		/* IN AL, DX */
+	[0xED] = T(8, 0, 5, 0),		/* IN AX, DX */
+	[0xEE] = T(8, 0, 3, 0),		/* OUT DX, AL */
+	[0xEF] = T(8, 0, 3, 0),		/* OUT DX, AX */
+	[0xF4] = T(2, 0, 2, 0),		/* HLT */
+	[0xF5] = T(2, 0, 2, 0),		/* CMC */
+	[0xF6] = T(0, 0, 0, 0),		/* Group 3 rm8 (see group3) */
+	[0xF7] = T(0, 0, 0, 0),		/* Group 3 rm16 (see group3) */
+	[0xF8] = T(2, 0, 2, 0),		/* CLC */
+	[0xF9] = T(2, 0, 2, 0),		/* STC */
+	[0xFA] = T(2, 0, 3, 0),		/* CLI */
+	[0xFB] = T(2, 0, 2, 0),		/* STI */
+	[0xFC] = T(2, 0, 2, 0),		/* CLD */
+	[0xFD] = T(2, 0, 2, 0),		/* STD */
+	[0xFE] = T(0, 0, 0, 0),		/* Group 4 rm8 (see group5) */
+	[0xFF] = T(0, 0, 0, 0),		/* Group 5 rm16 (see group5) */
+};
+
+/* 0x80 - 0x83 (by ModRM reg) */
+static const Timing group1[8] = {
+	T(4, 17, 3, 7), T(4, 17, 3, 7), T(4, 17, 3, 7), T(4, 17, 3, 7),
+	T(4, 17, 3, 7), T(4, 17, 3, 7), T(4, 17, 3, 7), T(4, 10, 3, 6)
+};
+
+/* 0xF6 and 0xF7: TEST, TEST, NOT, NEG, MUL, IMUL, DIV, IDIV */
+static const Timing group3[2][8] = {
+	{
+		T(5, 11, 3, 6), T(5, 11, 3, 6), T(3, 16, 2, 7), T(3, 16, 2, 7),
+		T(74, 80, 13, 16), T(89, 95, 13, 16), T(85, 91, 14, 17),
+		T(107, 113, 17, 20)
+	},
+	{
+		T(5, 11, 3, 6), T(5, 11, 3, 6), T(3, 16, 2, 7), T(3, 16, 2, 7),
+		T(126, 132, 21, 24), T(141, 147, 21, 24), T(153, 159, 22, 25),
+		T(175, 181, 25, 28)
+	}
+};
+
+/* 0xFE and 0xFF: INC, DEC, CALL, CALL far, JMP, JMP far, PUSH */
+static const Timing group5[8] = {
+	T(3, 15, 2, 7), T(3, 15, 2, 7), T(16, 21, 7, 11), T(0, 37, 0, 16),
+	T(11, 18, 7, 11), T(0, 24, 0, 15), T(11, 16, 3, 5), T(0, 0, 0, 0)
+};
+
+/* ============================== CALCULATION =============================== */
+/* Conditional transfers cost more when taken */
+static int taken(uint8_t op, CpuModel model)
+{
+	bool is86 = model == CPU_8086;
+
+	switch (op) {
+		case 0xE0: return is86 ? 19 : 8;	/* LOOPNE */
+		case 0xE1: return is86 ? 18 : 8;	/* LOOPE */
+		case 0xE2: return is86 ? 17 : 8;	/* LOOP */
+		case 0xE3: return is86 ? 18 : 8;	/* JCXZ */
+		default: return is86 ? 16 : 7;		/* Jcc */
+	}
+}
+
+/* String operations with REP, base + cost of every iteration */
+static int repeated(uint8_t op, int n, CpuModel model)
+{
+	bool is86 = model == CPU_8086;
+
+	switch (op & 0xFE) {
+		case 0xA4: return is86 ? 9 + 17 * n : 5 + 4 * n;	/* MOVS */
+		case 0xA6: return is86 ? 9 + 22 * n : 5 + 9 * n;	/* CMPS */
+		case 0xAA: return is86 ? 9 + 10 * n : 4 + 3 * n;	/* STOS */
+		case 0xAC: return is86 ? 9 + 13 * n : 5 + 4 * n;	/* LODS */
+		default: return is86 ? 9 + 15 * n : 5 + 8 * n;		/* SCAS */
+	}
+}
+
+static bool is_conditional(Insn* in)
+{
+	return (in->op >= 0x70 && in->op <= 0x7F) || in->op == 0x0F ||
+		(in->op >= 0xE0 && in->op <= 0xE3);
+}
+
+/* Cycles spent executing, with everything already in prefetch queue */
+static int execute_cycles(Insn* in, int odd, CpuModel model)
+{
+	const Timing* t = &timing[in->op];
+	bool is86 = model == CPU_8086;
+
+	if (in->op >= 0x80 && in->op <= 0x83)
+		t = &group1[in->ext];
+	else if (in->op == 0xF6 || in->op == 0xF7)
+		t = &group3[in->op & 1][in->ext];
+	else if (in->op == 0xFE || in->op == 0xFF)
+		t = &group5[in->ext];
+	else if (in->op == 0x0F)
+		t = &timing[0x70 + (in->ext & 0x0F)];
+
+	int c = in->mem ? t->mem[model] : t->reg[model];
+	if (in->mem && is86)
+		c += in->ea;
+	else if (in->mem && in->ea_long)
+		c += 1;
+
+	/* Special cases */
+	if (is_conditional(in) && in->jumped)
+		c = taken(in->op, model);
+	else if (in->rep && in->op >= 0xA4 && in->op <= 0xAF)
+		c = repeated(in->op, in->count, model);
+	else if (in->op == 0xD2 || in->op == 0xD3)
+		c += in->count * (is86 ? 4 : 1);
+	else if (in->op == 0xC0 || in->op == 0xC1)
+		c += in->count;
+
+	/* Prefixes take their time on 8086 */
+	if (is86)
+		c += 2 * in->prefixes;
+
+	return c + odd * (is86 ? ODD_PENALTY_86 : ODD_PENALTY_286);
+}
+
+void count_cycles(Cpu* cpu, Insn* in)
+{
+	for (int model = 0; model < CPU_COUNT; model++) {
+		int exec = execute_cycles(in, cpu->odd, model);
+		int* queue = &cpu->queue[model];
+
+		/* Wait for bytes not yet in the queue */
+		int stall = 0;
+		if (*queue < in->len) {
+			stall = (in->len - *queue) * byte_fetch[model];
+			*queue = 0;
+		}
+		else
+			*queue -= in->len;
+
+		/* Bus is free for prefetching when instruction isn't using it */
+		int idle = exec - (cpu->bus + cpu->odd) * bus_cycle[model];
+		if (idle > 0)
+			*queue += idle / byte_fetch[model];
+		if (*queue > QUEUE_SIZE)
+			*queue = QUEUE_SIZE;
+
+		/* Jumps empty the queue (8086 times include the first word) */
+		if (in->jumped)
+			*queue = model == CPU_8086 ? 2 : 0;
+
+		cpu->cycles[model] += exec + stall;
+	}
+}
+
+int insn_cycles(Insn* in, CpuModel model)
+{
+	return execute_cycles(in, 0, model);
+}
@@ -123,6 +123,17 @@ Node* do_cls()
 	return init_keyword(t, NULL, NULL);
 }
 
+Node* do_copy()
+{
+	Token t = scan();
+	Node* src = numeric();
+	Node* dst = numeric();
+	Node* count = numeric();
+
+	Node* seq = init_node(NODE_SEQUENCE, t, 0, dst, count);
+	return init_keyword(t, src, seq);
+}
+
 Node* do_cursor()
 {
 	Token t = scan();
@@ -200,6 +211,17 @@ Node* do_files()
 	return init_keyword(t, NULL, NULL);
 }
 
+Node* do_fill()
+{
+	Token t = scan();
+	Node* addr = numeric();
+	Node* count = numeric();
+	Node* val = numeric();
+
+	Node* seq = init_node(NODE_SEQUENCE, t, 0, count, val);
+	return init_keyword(t, addr, seq);
+}
+
 Node* do_getkey()
 {
 	Token t = scan();
@@ -229,11 +251,11 @@ Node* do_goto()
 
 Node* do_include()
 {
-	/* Actually we don't need it */
+	/* Actually we don't need it, file was added by lexer */
 	scan();
 	scan();
 
-	return parse_keyword(klabels);
+	return statement();
 }
 
 Node* do_ink()
@@ -471,6 +493,14 @@ Node* do_rand()
 	return init_keyword(t, target, seq);
 }
 
+Node* do_randomize()
+{
+	Token t = scan();
+	Node* op = numeric();
+
+	return init_keyword(t, op, NULL);
+}
+
 Node* do_read()
 {
 	Token t = scan();
@@ -633,6 +663,7 @@ static FunctionPtr keywords_compilers[] = {
 	[TOKEN_CALL] = do_call,
 	[TOKEN_CASE] = do_case,
 	[TOKEN_CLS] = do_cls,
+	[TOKEN_COPY] = do_copy,
 	[TOKEN_CURSOR] = do_cursor,
 	[TOKEN_CURSCHAR] = do_curschar,
 	[TOKEN_CURSCOL] = do_curscol,
@@ -640,6 +671,7 @@ static FunctionPtr keywords_compilers[] = {
 	[TOKEN_DELETE] = do_delete,
 	[TOKEN_END] = do_end,
 	[TOKEN_FILES] = do_files,
+	[TOKEN_FILL] = do_fill,
 	[TOKEN_GETKEY] = do_getkey,
 	[TOKEN_GOSUB] = do_gosub,
 	[TOKEN_GOTO] = do_goto,
@@ -660,6 +692,7 @@ static FunctionPtr keywords_compilers[] = {
 	[TOKEN_PORT] = do_port,
 	[TOKEN_PRINT] = do_print,
 	[TOKEN_RAND] = do_rand,
+	[TOKEN_RANDOMIZE] = do_randomize,
 	[TOKEN_READ] = do_read,
 	[TOKEN_RENAME] = do_rename,
 	[TOKEN_RETURN] = do_return,
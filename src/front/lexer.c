@@ -24,6 +24,7 @@ const char* keywords_names[] = {
 	[TOKEN_CASE] = "CASE",
 	[TOKEN_CHR] = "CHR",
 	[TOKEN_CLS] = "CLS",
+	[TOKEN_COPY] = "COPY",
 	[TOKEN_CURSOR] = "CURSOR",
 	[TOKEN_CURSCHAR] = "CURSCHAR",
 	[TOKEN_CURSCOL] = "CURSCOL",
@@ -34,6 +35,7 @@ const char* keywords_names[] = {
 	[TOKEN_END] = "END",
 	[TOKEN_ENDLESS] = "ENDLESS",
 	[TOKEN_FILES] = "FILES",
+	[TOKEN_FILL] = "FILL",
 	[TOKEN_FOR] = "FOR",
 	[TOKEN_GET] = "GET",
 	[TOKEN_GOSUB] = "GOSUB",
@@ -67,6 +69,7 @@ const char* keywords_names[] = {
 	[TOKEN_PROGSTART] = "PROGSTART",
 	[TOKEN_RAMSTART] = "RAMSTART",
 	[TOKEN_RAND] = "RAND",
+	[TOKEN_RANDOMIZE] = "RANDOMIZE",
 	[TOKEN_READ] = "READ",
 	[TOKEN_REC] = "REC",
 	[TOKEN_REM] = "REM",
@@ -99,18 +102,25 @@ void include(const char* new_fname)
 {
 	/* Read source code of included file */
 	char* src = read_file(new_fname);
+	if (src == NULL)
+		return;
 
 	/* Calculate new length and allocate */
 	int len = strlen(lexer.source) + strlen(src) + 2;
-	char* new_source = malloc(len);
+	char* new_source = mem_alloc(len);
 
 	/* Copy  */
 	strcpy(new_source, lexer.source);
 	strcat(new_source, "\n");
 	strcat(new_source, src);
 
+	/* Lexer is in the middle of old source, move it to the same place */
+	lexer.beginning = new_source + (lexer.beginning - lexer.source);
+	lexer.current = new_source + (lexer.current - lexer.source);
+
 	/* Free old source and set new */
-	free((char*) lexer.source);
+	mem_free((char*) lexer.source);
+	mem_free(src);
 	lexer.source = new_source;
 }
 
@@ -150,8 +160,9 @@ Token init_token(TokenType t)
 TokenType match_keyword(const char* str)
 {
 	size_t len = lexer.current - lexer.beginning;
-	char* upper_str = malloc(len);
+	char* upper_str = mem_alloc(len + 1);
 	strncpy(upper_str, str, len);
+	upper_str[len] = '\0';
 	string_uppercase(upper_str);
 
 	TokenType ret = TOKEN_IDENTIFIER;
@@ -165,7 +176,7 @@ TokenType match_keyword(const char* str)
 			ret = i;
 	}
 
-	free(upper_str);
+	mem_free(upper_str);
 	return ret;
 }
 
@@ -173,9 +184,7 @@ TokenType match_keyword(const char* str)
 void init_lexer(const char* source)
 {
 	lexer.source = source;
-	lexer.beginning = source;
-	lexer.current = source;
-	lexer.line = 1;
+	reset_lexer();
 
 	/* First pass is for INCLUDE */
 	while (lookahead().type != TOKEN_EOF) {
@@ -183,16 +192,21 @@ void init_lexer(const char* source)
 		if (t.type == TOKEN_INCLUDE) {
 			t = get_token();
 			if (t.type == TOKEN_STRING_LITERAL) {
-				char* str = malloc(t.length + 1);
+				char* str = mem_alloc(t.length + 1);
 				strncpy(str, t.text, t.length);
 				str[t.length] = '\0';
 
 				include(str);
+				mem_free(str);
 			}
 		}
 	}
 
-	/* Reset lexer */
+	reset_lexer();
+}
+
+void reset_lexer()
+{
 	lexer.beginning = lexer.source;
 	lexer.current = lexer.source;
 	lexer.line = 1;
@@ -358,3 +372,20 @@ Token lookahead()
 
 	return pending;
 }
+
+const char* line_text(int line, int* len)
+{
+	const char* s = lexer.source;
+	*len = 0;
+	if (s == NULL)
+		return "";
+
+	for (int i = 1; i < line && *s; s++)
+		if (*s == '\n')
+			i++;
+
+	while (*s == ' ' || *s == '\t')
+		s++;
+	*len = strcspn(s, "\r\n");
+	return s;
+}
@@ -49,7 +49,7 @@ Token scan()
 
 Node* init_node(NodeType t, Token token, int v, Node* op1, Node *op2)
 {
-	Node* ret = malloc(sizeof(Node));
+	Node* ret = mem_alloc(sizeof(Node));
 	ret->type = t;
 	ret->attribute = token.type;
 	ret->line = token.line;
@@ -61,14 +61,35 @@ Node* init_node(NodeType t, Token token, int v, Node* op1, Node *op2)
 }
 
 void free_node(Node* n)
+{
+	/* Walk op2 in a loop, sequences of long programs are deep */
+	while (n != NULL) {
+		Node* next = n->op2;
+		free_node(n->op1);
+		mem_free(n);
+		n = next;
+	}
+}
+
+long count_nodes(Node* n)
+{
+	long ret = 0;
+	for (; n != NULL; n = n->op2)
+		ret += 1 + count_nodes(n->op1);
+	return ret;
+}
+
+Node* copy_node(Node* n)
 {
 	if (n == NULL)
-		return;
+		return NULL;
 
-	free_node(n->op1);
-	free_node(n->op2);
+	Node* ret = mem_alloc(sizeof(Node));
+	*ret = *n;
+	ret->op1 = copy_node(n->op1);
+	ret->op2 = copy_node(n->op2);
 
-	free(n);
+	return ret;
 }
 
 /* Recursively "pretty" prints node */
@@ -431,9 +452,15 @@ Node* parse(SymbolTable* t, StringTable* s)
 	Token empty = {0, NULL, 0, 0};
 	labels = t;
 	strings = s;
+
+	/* Every statement gets its own sequence node, chained through op2 */
 	Node* ret = init_node(NODE_SEQUENCE, empty, 0, statement(), NULL);
-	if (!match(TOKEN_EOF))
-		ret->op2 = parse(t, s);
+	Node* last = ret;
+	while (!match(TOKEN_EOF)) {
+		last->op2 = init_node(NODE_SEQUENCE, empty, 0, statement(),
+					NULL);
+		last = last->op2;
+	}
 
 	return ret;
 }
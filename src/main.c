@@ -4,7 +4,6 @@
  */
 
 /* Standard library includes */
-#include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -13,77 +12,25 @@
 #include <parser.h>
 #include <table.h>
 #include <codegen.h>
+#include <options.h>
+#include <optimize.h>
 #include <util.h>
+#include <emu.h>
+#include <stats.h>
 
 extern Lexer lexer;
 
-char* read_file(const char* filename)
-{
-	FILE* f = fopen(filename, "rb");
-	if (f == NULL) {
-		printf("\x1B[31mError\x1B[0m: Could not open source file.\n");
-		raise_error();
-		return NULL;
-	}
-
-	fseek(f, 0, SEEK_END);
-	int len = ftell(f);
-	rewind(f);
-
-	char* source = malloc(len + 1);		/* One more for NUL */
-	if (source == NULL) {
-		printf("\x1B[31mError\x1B[0m: Could not allocate to read.\n");
-		raise_error();
-		return NULL;
-	}
-
-	int read = fread(source, sizeof(char), len, f);
-	if (read != len) {
-		printf("\x1B[31mError\x1B[0m: Could not read source file.\n");
-		raise_error();
-		return NULL;
-	}
-
-	source[len] = '\0';			/* Zero terminate string */
-	fclose(f);
-	return source;
-}
-
-void write_file(const char* filename, CompileTarget* ct)
-{
-	FILE* f = fopen(filename, "wb");
-	if (f == NULL) {
-		printf("\x1B[31mError\x1B[0m: Could not open output file.\n");
-		raise_error();
-		return;
-	}
-
-	int len = fwrite(ct->code, sizeof(char), ct->length, f);
-
-	if (len != ct->length) {
-		printf("\x1B[31mError\x1B[0m: Could not write output file.\n");
-		raise_error();
-		return;
-	}
-
-	fclose(f);
-}
-
 int main(int argc, char** argv)
 {
-	if (argc < 3) {
-		printf("----- \x1B[33mMikeOS Basic Compiler\x1B[0m -----\n"
-			"Usage: mosbc \x1B[35msrc\x1B[0m \x1B[36mout\x1B[0m "
-			"\x1B[33m[-debug]\x1B[0m\n"
-			"  \x1B[35msrc\x1B[0m - Name of the source file\n"
-			"  \x1B[36mout\x1B[0m - Name of output file\n"
-			"  \x1B[33m-debug\x1B[0m - Print compiler data "
-			"structures.\n");
+	if (!parse_options(argc, argv)) {
+		print_usage();
 		return -1;
 	}
 
 	/* Read */
-	char* src = read_file(argv[1]);
+	stat_begin(STAT_READ);
+	char* src = read_file(options.src);
+	stat_end(STAT_READ);
 	check_for_error();
 
 	/* Now we read the source, initialize all data structures */
@@ -94,30 +41,80 @@ int main(int argc, char** argv)
 	init_str_table(&s);
 	init_code(&ct);
 
-	/* Parse */
+	/* Include other files */
+	stat_begin(STAT_INCLUDE);
 	init_lexer(src);
+	stat_end(STAT_INCLUDE);
+
+	/* Parser lexes as it goes, so tokens are counted by separate pass */
+	if (options.stats) {
+		stat_begin(STAT_LEX);
+		while (get_token().type != TOKEN_EOF)
+			stats.tokens++;
+		reset_lexer();
+		stat_end(STAT_LEX);
+	}
+
+	/* Parse */
+	stat_begin(STAT_PARSE);
 	Node* ast = parse(&t, &s);
+	stat_end(STAT_PARSE);
 	check_for_error();
+	stats.nodes = count_nodes(ast);
 
 	/* Compile */
+	stat_begin(STAT_CODEGEN);
 	compile(ast, &ct, &s, &t);
+	stat_end(STAT_CODEGEN);
 	check_for_error();
 
+	if (options.time_passes)
+		print_pass_times();
+
 	/* Output debug info, if needed */
-	if (argc == 4 && strcmp(argv[3], "-debug") == 0) {
+	if (options.debug) {
 		printf("\x1B[32mSource:\x1B[0m\n%s\n\n", lexer.source);
 		printf("\x1B[36mAST\x1B[0m:\n");
 		print_node(ast, 0);
 		printf("\n\x1B[34mASM:\x1B[0m\n");
-		disassemble(&ct);
+		disassemble(&ct, &t);
+	}
+
+	/* Program over its budget is not written out */
+	bool over = options.max_size > 0 && ct.length > options.max_size;
+	if (options.size_report || over)
+		print_size_report(&ct);
+	if (over) {
+		printf("\x1B[31mError\x1B[0m: Program is %d bytes long, over "
+			"the limit of %d bytes.\n", ct.length, options.max_size);
+		raise_error();
+		check_for_error();
 	}
 
 	/* Finally, write out our compiled code to file */
-	write_file(argv[2], &ct);
+	if (options.out != NULL) {
+		stat_begin(STAT_WRITE);
+		write_file(options.out, &ct);
+		stat_end(STAT_WRITE);
+
+		/* Please be reassuring: */
+		printf("\x1B[32mCompilation successful\x1B[0m: written file "
+			"%s (%d bytes long)\n", options.out, ct.length);
+	}
+
+	/* Maps are needed even if program is only run */
+	if (options.counter_map != NULL)
+		write_counter_map(options.counter_map, &ct);
+	if (options.map != NULL)
+		write_map(options.map, &ct, &t);
+
+	if (options.stats) {
+		collect_stats(&t, &s, &ct);
+		print_stats(options.stats == STATS_JSON);
+	}
 
-	/* Please be reassuring: */
-	printf("\x1B[32mCompilation successful\x1B[0m: written file %s "
-		"(%d bytes long)\n", argv[2], ct.length);
+	/* Try it out, if asked to */
+	bool ran = !options.run || run_program(&ct, &t);
 
 	/* Clean up */
 	free_node(ast);
@@ -125,5 +122,5 @@ int main(int argc, char** argv)
 	free_sym_table(&t);
 	free_str_table(&s);
 
-	return 0;
+	return ran ? 0 : -1;
 }
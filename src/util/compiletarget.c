@@ -10,18 +10,20 @@
 
 /* Custom includes */
 #include <codegen.h>
+#include <options.h>
+#include <util.h>
 
 /* ============================== PATCH TABLES ============================== */
 void init_patch(PatchTable* p)
 {
 	p->length = 0;
 	p->capacity = 8;
-	p->table = malloc(p->capacity * sizeof(PatchTableEntry));
+	p->table = mem_alloc(p->capacity * sizeof(PatchTableEntry));
 }
 
 void free_patch(PatchTable* p)
 {
-	free(p->table);
+	mem_free(p->table);
 	p->table = NULL;
 	p->length = 0;
 	p->capacity = 0;
@@ -31,7 +33,7 @@ void add_patch(PatchTable* p, int id, uint16_t addr)
 {
 	if (p->capacity < p->length + 1) {
 		p->capacity *= 2;
-		p->table = realloc(p->table, p->capacity *
+		p->table = mem_realloc(p->table, p->capacity *
 				sizeof(PatchTableEntry));
 	}
 
@@ -40,20 +42,164 @@ void add_patch(PatchTable* p, int id, uint16_t addr)
 	p->length++;
 }
 
+/* ============================ RELOCATION TABLE ============================ */
+static void add_reloc(RelocTable* r, DataArea area, uint16_t addr)
+{
+	if (r->capacity < r->length + 1) {
+		r->capacity *= 2;
+		r->table = mem_realloc(r->table, r->capacity *
+				sizeof(RelocTableEntry));
+	}
+
+	r->table[r->length].area = area;
+	r->table[r->length].addr = addr;
+	r->length++;
+}
+
+void relocate(CompileTarget* c)
+{
+	for (int i = 0; i < c->relocs.length; i++) {
+		uint16_t a = c->relocs.table[i].addr;
+		uint16_t base = c->areas[c->relocs.table[i].area];
+
+		/* Emitted word is an offset into the area */
+		uint16_t offset = (uint8_t) c->code[a] |
+				((uint8_t) c->code[a + 1] << 8);
+		uint16_t addr = base + offset;
+		c->code[a] = (uint8_t) addr & 0xFF;
+		c->code[a + 1] = (uint8_t) (addr >> 8) & 0xFF;
+	}
+}
+
+/* ================================ CODE MAP ================================ */
+void add_line(CompileTarget* c, int line, const char* kind)
+{
+	LineTable* l = &c->lines;
+
+	/* Statement without any code gives its place to the next one */
+	if (l->length > 0 && l->table[l->length - 1].addr == c->length)
+		l->length--;
+	if (l->length > 0 && l->table[l->length - 1].line == line &&
+	    l->table[l->length - 1].kind == kind)
+		return;
+
+	if (l->capacity < l->length + 1) {
+		l->capacity = l->capacity ? l->capacity * 2 : 16;
+		l->table = mem_realloc(l->table, l->capacity *
+				sizeof(LineTableEntry));
+	}
+
+	l->table[l->length].addr = c->length;
+	l->table[l->length].line = line;
+	l->table[l->length].kind = kind;
+	l->length++;
+}
+
+void add_range(CompileTarget* c, const char* name, uint16_t start)
+{
+	RangeTable* r = &c->ranges;
+	if (r->capacity < r->length + 1) {
+		r->capacity = r->capacity ? r->capacity * 2 : 16;
+		r->table = mem_realloc(r->table, r->capacity *
+				sizeof(RangeTableEntry));
+	}
+
+	r->table[r->length].name = name;
+	r->table[r->length].start = start;
+	r->table[r->length].end = c->length;
+	r->length++;
+}
+
+int find_line(CompileTarget* c, uint16_t offset)
+{
+	if (find_range(c, offset) != NULL)
+		return 0;
+
+	/* Last entry starting at or before offset */
+	int lo = 0, hi = c->lines.length - 1, ret = 0;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (c->lines.table[mid].addr <= offset) {
+			ret = c->lines.table[mid].line;
+			lo = mid + 1;
+		}
+		else
+			hi = mid - 1;
+	}
+
+	return ret;
+}
+
+/* Code of a line ends where the next line or range starts */
+uint16_t line_end(CompileTarget* c, int i)
+{
+	uint16_t start = c->lines.table[i].addr;
+	uint16_t end = i + 1 < c->lines.length ?
+		c->lines.table[i + 1].addr : c->length;
+
+	for (int j = 0; j < c->ranges.length; j++) {
+		uint16_t r = c->ranges.table[j].start;
+		if (r > start && r < end)
+			end = r;
+	}
+	return end;
+}
+
+RangeTableEntry* find_range(CompileTarget* c, uint16_t offset)
+{
+	for (int i = 0; i < c->ranges.length; i++)
+		if (offset >= c->ranges.table[i].start &&
+		    offset < c->ranges.table[i].end)
+			return &c->ranges.table[i];
+
+	return NULL;
+}
+
 /* ============================= INITIALIZATION ============================= */
 void init_code(CompileTarget* c)
 {
 	c->length = 0;
 	c->capacity = 8;
-	c->code = malloc(c->capacity);
+	c->code = mem_alloc(c->capacity);
+
+	c->relocs.length = 0;
+	c->relocs.capacity = 8;
+	c->relocs.table = mem_alloc(c->relocs.capacity *
+				sizeof(RelocTableEntry));
+
+	for (int i = 0; i < AREA_COUNT; i++) {
+		c->areas[i] = 0;
+		c->area_sizes[i] = 0;
+	}
+	c->ramstart = 0;
+	c->helpers_at = 0;
+
+	init_patch(&c->helpers);
+	c->lines = (LineTable) { NULL, 0, 0 };
+	c->ranges = (RangeTable) { NULL, 0, 0 };
+	c->counters = (LineTable) { NULL, 0, 0 };
+	c->printed = false;
 }
 
 void free_code(CompileTarget* c)
 {
-	free(c->code);
+	mem_free(c->code);
 	c->code = NULL;
 	c->length = 0;
 	c->capacity = 0;
+
+	mem_free(c->relocs.table);
+	c->relocs.table = NULL;
+	c->relocs.length = 0;
+	c->relocs.capacity = 0;
+
+	free_patch(&c->helpers);
+	mem_free(c->lines.table);
+	c->lines = (LineTable) { NULL, 0, 0 };
+	mem_free(c->ranges.table);
+	c->ranges = (RangeTable) { NULL, 0, 0 };
+	mem_free(c->counters.table);
+	c->counters = (LineTable) { NULL, 0, 0 };
 }
 
 void patch_jumps(CompileTarget* c, PatchTable* p, SymbolTable* sym, Node* n)
@@ -83,7 +229,7 @@ void emit_byte(CompileTarget* c, uint8_t byte)
 	/* If there is no room, make some */
 	if (c->capacity < c->length + 1) {
 		c->capacity *= 2;
-		c->code = realloc(c->code, c->capacity);
+		c->code = mem_realloc(c->code, c->capacity);
 	}
 
 	/* Put our byte in place */
@@ -113,6 +259,53 @@ void emit_jump(CompileTarget* c, uint16_t target)
 	emit_word(c, rel);		/* rel16 */
 }
 
+void emit_helper_call(CompileTarget* c, int helper)
+{
+	emit_byte(c, 0xE8);		/* CALL */
+	add_patch(&c->helpers, helper, c->length);
+	emit_word(c, 0x0000);		/* Patched in emit_helpers() */
+}
+
+void emit_data(CompileTarget* c, DataArea area, uint16_t offset)
+{
+	add_reloc(&c->relocs, area, c->length);
+	emit_word(c, offset);
+}
+
+void emit_var(CompileTarget* c, int var)
+{
+	emit_data(c, AREA_VARS, var * 2);
+}
+
+void emit_strvar(CompileTarget* c, int var)
+{
+	emit_data(c, AREA_STRVARS, var * 128);
+}
+
+void emit_strlen(CompileTarget* c, int var)
+{
+	emit_data(c, AREA_STRLENS, var * 2);
+}
+
+void emit_counter(CompileTarget* c, int line)
+{
+	LineTable* l = &c->counters;
+	if (l->capacity < l->length + 1) {
+		l->capacity = l->capacity ? l->capacity * 2 : 16;
+		l->table = mem_realloc(l->table, l->capacity *
+				sizeof(LineTableEntry));
+	}
+
+	l->table[l->length].addr = c->length;
+	l->table[l->length].line = line;
+	l->table[l->length].kind = NULL;
+
+	emit_byte(c, 0xFF);			/* INC WORD */
+	emit_byte(c, 0x06);			/* [imm16] */
+	emit_data(c, AREA_COUNTERS, l->length * 2);
+	l->length++;
+}
+
 void emit_string(CompileTarget* c, const char* str)
 {
 	for (unsigned int i = 0; i < strlen(str); i++)
@@ -120,3 +313,99 @@ void emit_string(CompileTarget* c, const char* str)
 
 	emit_byte(c, 0x00);	/* NUL terminate */
 }
+
+/* ================================= OUTPUT ================================= */
+void write_file(const char* filename, CompileTarget* ct)
+{
+	FILE* f = fopen(filename, "wb");
+	if (f == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not open output file.\n");
+		raise_error();
+		return;
+	}
+
+	int len = fwrite(ct->code, sizeof(char), ct->length, f);
+
+	if (len != ct->length) {
+		printf("\x1B[31mError\x1B[0m: Could not write output file.\n");
+		raise_error();
+		return;
+	}
+
+	fclose(f);
+}
+
+void write_counter_map(const char* filename, CompileTarget* ct)
+{
+	FILE* f = fopen(filename, "w");
+	if (f == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not open counter map file.\n");
+		raise_error();
+		return;
+	}
+
+	/* Table is an array of words, one for every statement */
+	fprintf(f, "# mosbc counter map\n");
+	fprintf(f, "source %s\n", options.src);
+	fprintf(f, "table 0x%04X %d\n", ct->areas[AREA_COUNTERS],
+		ct->counters.length);
+	for (int i = 0; i < ct->counters.length; i++)
+		fprintf(f, "counter %d line %d addr 0x%04X\n", i,
+			ct->counters.table[i].line,
+			LOAD + ct->counters.table[i].addr);
+
+	fclose(f);
+}
+
+void write_map(const char* filename, CompileTarget* ct, SymbolTable* sym)
+{
+	static const char* area_name[] = {
+		[AREA_VARS] = "vars",
+		[AREA_STRVARS] = "strvars",
+		[AREA_TEMPS] = "temps",
+		[AREA_STRLENS] = "strlens",
+		[AREA_COUNTERS] = "counters"
+	};
+
+	FILE* f = fopen(filename, "w");
+	if (f == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not open map file.\n");
+		raise_error();
+		return;
+	}
+
+	/* One record per line, addresses are absolute and ends exclusive */
+	fprintf(f, "# mosbc map\n");
+	fprintf(f, "source %s\n", options.src);
+	fprintf(f, "load 0x%04X %d\n", LOAD, ct->length);
+	fprintf(f, "ramstart 0x%04X\n", ct->ramstart);
+
+	for (int i = 0; i < ct->ranges.length; i++) {
+		RangeTableEntry* r = &ct->ranges.table[i];
+		fprintf(f, "range 0x%04X 0x%04X %s\n", LOAD + r->start,
+			LOAD + r->end, r->name);
+	}
+
+	for (int i = 0; i < AREA_COUNT; i++)
+		if (ct->area_sizes[i] > 0)
+			fprintf(f, "data 0x%04X 0x%04X %s\n", ct->areas[i],
+				ct->areas[i] + ct->area_sizes[i], area_name[i]);
+
+	/* Labels keep their colon in the symbol table */
+	for (int i = 0; i < sym->len; i++) {
+		SymbolTableEntry* s = &sym->table[i];
+		if (!s->isreal)
+			continue;
+
+		int len = s->len > 0 && s->str[s->len - 1] == ':' ?
+			s->len - 1 : s->len;
+		fprintf(f, "label 0x%04X %.*s\n", LOAD + s->addr, len, s->str);
+	}
+
+	for (int i = 0; i < ct->lines.length; i++)
+		fprintf(f, "line 0x%04X 0x%04X %d\n",
+			LOAD + ct->lines.table[i].addr, LOAD + line_end(ct, i),
+			ct->lines.table[i].line);
+
+	fclose(f);
+}
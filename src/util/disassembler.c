@@ -5,9 +5,18 @@
 
 /* Standard library includes */
 #include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
 
 /* Custom includes */
 #include <codegen.h>
+#include <lexer.h>
+#include <emu.h>
+
+#define HEX_WIDTH 16		/* Room for 7 bytes of an instruction */
+#define TEXT_WIDTH 36		/* Room for mnemonic and operands */
+#define SOURCE_WIDTH 50		/* Source shown above code of a line */
+#define DATA_WIDTH 32		/* Characters of a string shown */
 
 static const char* regs[8] = {
 	"AX",	/* 0 */
@@ -22,447 +31,680 @@ static const char* regs[8] = {
 
 static const char* byte_regs[8] = {
 	"AL",	/* 0 */
-	"BL",	/* 1 */
-	"CL",	/* 2 */
-	"DL",	/* 3 */
+	"CL",	/* 1 */
+	"DL",	/* 2 */
+	"BL",	/* 3 */
 	"AH",	/* 4 */
-	"BH",	/* 5 */
-	"CH",	/* 6 */
-	"DH"	/* 7 */
+	"CH",	/* 5 */
+	"DH",	/* 6 */
+	"BH"	/* 7 */
+};
+
+static const char* sregs[4] = { "ES", "CS", "SS", "DS" };
+
+/* Memory operands by ModRM r/m */
+static const char* bases[8] = {
+	"BX+SI", "BX+DI", "BP+SI", "BP+DI", "SI", "DI", "BP", "BX"
+};
+
+/* ================================= TABLES ================================= */
+/* How operands of an instruction are encoded */
+typedef enum {
+	OPS_NONE = 0,	/* None, or implied by the mnemonic */
+	OPS_RM_REG,	/* ModRM, r/m is the first operand */
+	OPS_REG_RM,	/* ModRM, reg is the first operand */
+	OPS_RM,		/* ModRM, r/m alone (group in reg), maybe immediate */
+	OPS_RM_SREG,	/* ModRM, r/m and segment register */
+	OPS_SREG_RM,	/* ModRM, segment register and r/m */
+	OPS_ACC_IMM,	/* AL or AX and immediate */
+	OPS_ACC_MEM,	/* AL or AX and [imm16] */
+	OPS_MEM_ACC,	/* [imm16] and AL or AX */
+	OPS_REG,	/* Register in low 3 bits of opcode */
+	OPS_REG_IMM,	/* Register in low 3 bits of opcode and immediate */
+	OPS_ACC_REG,	/* AX and register in low 3 bits of opcode */
+	OPS_IMM,	/* Immediate alone */
+	OPS_REL,	/* Relative target (short or near by size) */
+	OPS_FAR,	/* Segment and offset */
+	OPS_IMUL,	/* reg, r/m and immediate */
+	OPS_PREFIX	/* REP, segment override or LOCK */
+} Operands;
+
+typedef struct {
+	const char* name;	/* Mnemonic (NULL for groups, by ModRM reg) */
+	uint8_t ops;		/* One of Operands */
+	bool wide;		/* Operands are words */
+	uint8_t imm;		/* Bytes of immediate or relative target */
+} Opcode;
+
+#define OP(name, ops, wide, imm) { name, ops, wide, imm }
+
+/* ADD, OR, ADC, SBB, AND, SUB, XOR and CMP share the encoding */
+#define ALU(b, name) \
+	[b] = OP(name, OPS_RM_REG, false, 0), \
+	[b + 1] = OP(name, OPS_RM_REG, true, 0), \
+	[b + 2] = OP(name, OPS_REG_RM, false, 0), \
+	[b + 3] = OP(name, OPS_REG_RM, true, 0), \
+	[b + 4] = OP(name, OPS_ACC_IMM, false, 1), \
+	[b + 5] = OP(name, OPS_ACC_IMM, true, 2)
+
+/* Eight opcodes with register in low 3 bits */
+#define REGS(b, name, ops, wide, imm) \
+	[b] = OP(name, ops, wide, imm), [b + 1] = OP(name, ops, wide, imm), \
+	[b + 2] = OP(name, ops, wide, imm), [b + 3] = OP(name, ops, wide, imm), \
+	[b + 4] = OP(name, ops, wide, imm), [b + 5] = OP(name, ops, wide, imm), \
+	[b + 6] = OP(name, ops, wide, imm), [b + 7] = OP(name, ops, wide, imm)
+
+/* Every 8086 and 186 instruction codegen or runtime could emit */
+static const Opcode opcodes[256] = {
+	ALU(0x00, "ADD"),
+	[0x06] = OP("PUSH ES", OPS_NONE, true, 0),
+	[0x07] = OP("POP ES", OPS_NONE, true, 0),
+	ALU(0x08, "OR"),
+	[0x0E] = OP("PUSH CS", OPS_NONE, true, 0),
+	ALU(0x10, "ADC"),
+	[0x16] = OP("PUSH SS", OPS_NONE, true, 0),
+	[0x17] = OP("POP SS", OPS_NONE, true, 0),
+	ALU(0x18, "SBB"),
+	[0x1E] = OP("PUSH DS", OPS_NONE, true, 0),
+	[0x1F] = OP("POP DS", OPS_NONE, true, 0),
+	ALU(0x20, "AND"),
+	[0x26] = OP("ES:", OPS_PREFIX, false, 0),
+	[0x27] = OP("DAA", OPS_NONE, false, 0),
+	ALU(0x28, "SUB"),
+	[0x2E] = OP("CS:", OPS_PREFIX, false, 0),
+	[0x2F] = OP("DAS", OPS_NONE, false, 0),
+	ALU(0x30, "XOR"),
+	[0x36] = OP("SS:", OPS_PREFIX, false, 0),
+	[0x37] = OP("AAA", OPS_NONE, false, 0),
+	ALU(0x38, "CMP"),
+	[0x3E] = OP("DS:", OPS_PREFIX, false, 0),
+	[0x3F] = OP("AAS", OPS_NONE, false, 0),
+	REGS(0x40, "INC", OPS_REG, true, 0),
+	REGS(0x48, "DEC", OPS_REG, true, 0),
+	REGS(0x50, "PUSH", OPS_REG, true, 0),
+	REGS(0x58, "POP", OPS_REG, true, 0),
+	[0x60] = OP("PUSHA", OPS_NONE, true, 0),
+	[0x61] = OP("POPA", OPS_NONE, true, 0),
+	[0x68] = OP("PUSH", OPS_IMM, true, 2),
+	[0x69] = OP("IMUL", OPS_IMUL, true, 2),
+	[0x6A] = OP("PUSH", OPS_IMM, true, 1),
+	[0x6B] = OP("IMUL", OPS_IMUL, true, 1),
+	[0x70] = OP("JO", OPS_REL, false, 1),
+	[0x71] = OP("JNO", OPS_REL, false, 1),
+	[0x72] = OP("JC", OPS_REL, false, 1),
+	[0x73] = OP("JNC", OPS_REL, false, 1),
+	[0x74] = OP("JZ", OPS_REL, false, 1),
+	[0x75] = OP("JNZ", OPS_REL, false, 1),
+	[0x76] = OP("JBE", OPS_REL, false, 1),
+	[0x77] = OP("JA", OPS_REL, false, 1),
+	[0x78] = OP("JS", OPS_REL, false, 1),
+	[0x79] = OP("JNS", OPS_REL, false, 1),
+	[0x7A] = OP("JP", OPS_REL, false, 1),
+	[0x7B] = OP("JNP", OPS_REL, false, 1),
+	[0x7C] = OP("JL", OPS_REL, false, 1),
+	[0x7D] = OP("JGE", OPS_REL, false, 1),
+	[0x7E] = OP("JLE", OPS_REL, false, 1),
+	[0x7F] = OP("JG", OPS_REL, false, 1),
+	[0x80] = OP(NULL, OPS_RM, false, 1),	/* Group 1 */
+	[0x81] = OP(NULL, OPS_RM, true, 2),
+	[0x82] = OP(NULL, OPS_RM, false, 1),
+	[0x83] = OP(NULL, OPS_RM, true, 1),	/* Sign extended imm8 */
+	[0x84] = OP("TEST", OPS_RM_REG, false, 0),
+	[0x85] = OP("TEST", OPS_RM_REG, true, 0),
+	[0x86] = OP("XCHG", OPS_RM_REG, false, 0),
+	[0x87] = OP("XCHG", OPS_RM_REG, true, 0),
+	[0x88] = OP("MOV", OPS_RM_REG, false, 0),
+	[0x89] = OP("MOV", OPS_RM_REG, true, 0),
+	[0x8A] = OP("MOV", OPS_REG_RM, false, 0),
+	[0x8B] = OP("MOV", OPS_REG_RM, true, 0),
+	[0x8C] = OP("MOV", OPS_RM_SREG, true, 0),
+	[0x8D] = OP("LEA", OPS_REG_RM, true, 0),
+	[0x8E] = OP("MOV", OPS_SREG_RM, true, 0),
+	[0x8F] = OP("POP", OPS_RM, true, 0),
+	[0x90] = OP("NOP", OPS_NONE, false, 0),
+	[0x91] = OP("XCHG", OPS_ACC_REG, true, 0),
+	[0x92] = OP("XCHG", OPS_ACC_REG, true, 0),
+	[0x93] = OP("XCHG", OPS_ACC_REG, true, 0),
+	[0x94] = OP("XCHG", OPS_ACC_REG, true, 0),
+	[0x95] = OP("XCHG", OPS_ACC_REG, true, 0),
+	[0x96] = OP("XCHG", OPS_ACC_REG, true, 0),
+	[0x97] = OP("XCHG", OPS_ACC_REG, true, 0),
+	[0x98] = OP("CBW", OPS_NONE, false, 0),
+	[0x99] = OP("CWD", OPS_NONE, true, 0),
+	[0x9A] = OP("CALL FAR", OPS_FAR, true, 4),
+	[0x9B] = OP("WAIT", OPS_NONE, false, 0),
+	[0x9C] = OP("PUSHF", OPS_NONE, true, 0),
+	[0x9D] = OP("POPF", OPS_NONE, true, 0),
+	[0x9E] = OP("SAHF", OPS_NONE, false, 0),
+	[0x9F] = OP("LAHF", OPS_NONE, false, 0),
+	[0xA0] = OP("MOV", OPS_ACC_MEM, false, 2),
+	[0xA1] = OP("MOV", OPS_ACC_MEM, true, 2),
+	[0xA2] = OP("MOV", OPS_MEM_ACC, false, 2),
+	[0xA3] = OP("MOV", OPS_MEM_ACC, true, 2),
+	[0xA4] = OP("MOVSB", OPS_NONE, false, 0),
+	[0xA5] = OP("MOVSW", OPS_NONE, true, 0),
+	[0xA6] = OP("CMPSB", OPS_NONE, false, 0),
+	[0xA7] = OP("CMPSW", OPS_NONE, true, 0),
+	[0xA8] = OP("TEST", OPS_ACC_IMM, false, 1),
+	[0xA9] = OP("TEST", OPS_ACC_IMM, true, 2),
+	[0xAA] = OP("STOSB", OPS_NONE, false, 0),
+	[0xAB] = OP("STOSW", OPS_NONE, true, 0),
+	[0xAC] = OP("LODSB", OPS_NONE, false, 0),
+	[0xAD] = OP("LODSW", OPS_NONE, true, 0),
+	[0xAE] = OP("SCASB", OPS_NONE, false, 0),
+	[0xAF] = OP("SCASW", OPS_NONE, true, 0),
+	REGS(0xB0, "MOV", OPS_REG_IMM, false, 1),
+	REGS(0xB8, "MOV", OPS_REG_IMM, true, 2),
+	[0xC0] = OP(NULL, OPS_RM, false, 1),	/* Group 2 */
+	[0xC1] = OP(NULL, OPS_RM, true, 1),
+	[0xC2] = OP("RET", OPS_IMM, true, 2),
+	[0xC3] = OP("RET", OPS_NONE, false, 0),
+	[0xC4] = OP("LES", OPS_REG_RM, true, 0),
+	[0xC5] = OP("LDS", OPS_REG_RM, true, 0),
+	[0xC6] = OP("MOV", OPS_RM, false, 1),
+	[0xC7] = OP("MOV", OPS_RM, true, 2),
+	[0xC9] = OP("LEAVE", OPS_NONE, false, 0),
+	[0xCA] = OP("RETF", OPS_IMM, true, 2),
+	[0xCB] = OP("RETF", OPS_NONE, false, 0),
+	[0xCC] = OP("INT 3", OPS_NONE, false, 0),
+	[0xCD] = OP("INT", OPS_IMM, false, 1),
+	[0xCF] = OP("IRET", OPS_NONE, false, 0),
+	[0xD0] = OP(NULL, OPS_RM, false, 0),	/* Group 2, by 1 */
+	[0xD1] = OP(NULL, OPS_RM, true, 0),
+	[0xD2] = OP(NULL, OPS_RM, false, 0),	/* Group 2, by CL */
+	[0xD3] = OP(NULL, OPS_RM, true, 0),
+	[0xD7] = OP("XLAT", OPS_NONE, false, 0),
+	[0xE0] = OP("LOOPNZ", OPS_REL, false, 1),
+	[0xE1] = OP("LOOPZ", OPS_REL, false, 1),
+	[0xE2] = OP("LOOP", OPS_REL, false, 1),
+	[0xE3] = OP("JCXZ", OPS_REL, false, 1),
+	[0xE8] = OP("CALL", OPS_REL, true, 2),
+	[0xE9] = OP("JMP", OPS_REL, true, 2),
+	[0xEA] = OP("JMP FAR", OPS_FAR, true, 4),
+	[0xEB] = OP("JMP", OPS_REL, false, 1),
+	[0xEC] = OP("IN AL, DX", OPS_NONE, false, 0),
+	[0xED] = OP("IN AX, DX", OPS_NONE, true, 0),
+	[0xEE] = OP("OUT DX, AL", OPS_NONE, false, 0),
+	[0xEF] = OP("OUT DX, AX", OPS_NONE, true, 0),
+	[0xF0] = OP("LOCK", OPS_PREFIX, false, 0),
+	[0xF2] = OP("REPNZ", OPS_PREFIX, false, 0),
+	[0xF3] = OP("REP", OPS_PREFIX, false, 0),
+	[0xF4] = OP("HLT", OPS_NONE, false, 0),
+	[0xF5] = OP("CMC", OPS_NONE, false, 0),
+	[0xF6] = OP(NULL, OPS_RM, false, 0),	/* Group 3 */
+	[0xF7] = OP(NULL, OPS_RM, true, 0),
+	[0xF8] = OP("CLC", OPS_NONE, false, 0),
+	[0xF9] = OP("STC", OPS_NONE, false, 0),
+	[0xFA] = OP("CLI", OPS_NONE, false, 0),
+	[0xFB] = OP("STI", OPS_NONE, false, 0),
+	[0xFC] = OP("CLD", OPS_NONE, false, 0),
+	[0xFD] = OP("STD", OPS_NONE, false, 0),
+	[0xFE] = OP(NULL, OPS_RM, false, 0),	/* Group 4 */
+	[0xFF] = OP(NULL, OPS_RM, true, 0)	/* Group 5 */
 };
 
-/* Swap endianness */
-uint16_t swap(uint16_t word)
+/* Groups, by ModRM reg */
+static const char* group1[8] = {
+	"ADD", "OR", "ADC", "SBB", "AND", "SUB", "XOR", "CMP"
+};
+static const char* group2[8] = {
+	"ROL", "ROR", "RCL", "RCR", "SHL", "SHR", "SAL", "SAR"
+};
+static const char* group3[8] = {
+	"TEST", "TEST", "NOT", "NEG", "MUL", "IMUL", "DIV", "IDIV"
+};
+static const char* group5[8] = {
+	"INC", "DEC", "CALL", "CALL FAR", "JMP", "JMP FAR", "PUSH", NULL
+};
+
+/* Jcc near (0x0F 0x80 - 0x8F), same order as short ones */
+#define JCC_NEAR 0x80
+
+/* ================================ DECODING ================================ */
+static CompileTarget* target;
+static SymbolTable* symbols;
+
+static uint8_t byte_at(int offset)
 {
-	return (word >> 8) | (word << 8);
+	return offset < target->length ? (uint8_t) target->code[offset] : 0;
 }
 
-uint16_t read_word(CompileTarget* c, int offset)
+static uint16_t word_at(int offset)
 {
-	uint8_t low = c->code[offset + 1] & 0xFF;
-	uint8_t high = c->code[offset] & 0xFF;
-	uint16_t swapped = ((high << 8) + low) & 0xFFFF;
-	return swap(swapped);
+	return byte_at(offset) | (byte_at(offset + 1) << 8);
 }
 
-int disassemble_instruction(CompileTarget* c, int offset)
+/* Append to text of decoded instruction */
+static void put(char* text, const char* fmt, ...)
 {
-	printf("0x%04X  ", offset + LOAD);	/* Print our current offset */
+	int len = strlen(text);
 
-	uint8_t byte = c->code[offset];
-	switch (byte) {
-		case 0x03: {	/* ADD r16, r16 */
-			uint8_t modrm = c->code[offset + 1];
-			printf("%02X%02X          ", byte, modrm);
-			int dst = (modrm & 0x38) >> 3;
-			int src = modrm & 7;
-			printf("ADD %s, %s\n", regs[dst], regs[src]);
-			offset += 2;
-			break;
-		}
-		case 0x0B: {	/* OR r16, [imm16] */
-			uint8_t modrm = c->code[offset + 1];
-			uint16_t addr = read_word(c, offset + 2);
-			printf("%02X%02X%04X      ", byte, modrm, swap(addr));
-			int dst = (modrm & 0x38) >> 3;
-			printf("OR %s, [0x%04X]\n", regs[dst], addr);
-			offset += 4;
-			break;
-		}
-		case 0x0F: {	/* Various Jcc rel16 */
-			uint8_t op = c->code[offset + 1];
-			uint16_t rel = read_word(c, offset + 2);
-			uint16_t addr = offset + 4 + rel + LOAD;
-			printf("%02X%02X%04X      ", byte, op, swap(rel));
-			switch (op) {
-				case 0x84: {
-					printf("JZ  near  0x%04X\n", addr);
-					break;
-				}
-				case 0x85: {
-					printf("JNE near  0x%04X\n", addr);
-					break;
-				}
-				case 0x8D: {
-					printf("JGE near  0x%04X\n", addr);
-				}
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(text + len, TEXT_WIDTH * 2 - len, fmt, args);
+	va_end(args);
+}
+
+static void put_imm(char* text, uint16_t imm, int size)
+{
+	if (size == 1)
+		put(text, "%d (0x%02X)", imm, imm);
+	else
+		put(text, "%d (0x%04X)", imm, imm);
+}
+
+/* Name of code at offset: label, runtime routine or MikeOS API */
+static void put_target(char* text, uint16_t addr)
+{
+	put(text, "0x%04X", addr);
+	if (addr < EMU_APIEND) {
+		put(text, " (MikeOS API)");
+		return;
+	}
+
+	uint16_t offset = addr - LOAD;
+	for (int i = 0; symbols != NULL && i < symbols->len; i++) {
+		SymbolTableEntry* s = &symbols->table[i];
+		if (!s->isreal || s->addr != offset)
+			continue;
+
+		int len = s->len > 0 && s->str[s->len - 1] == ':' ?
+			s->len - 1 : s->len;
+		put(text, " (%.*s)", len, s->str);
+		return;
+	}
+
+	RangeTableEntry* r = find_range(target, offset);
+	if (r != NULL && r->start == offset)
+		put(text, " (%s)", r->name);
+}
+
+/* Operand described by ModRM at offset, returns its length */
+static int put_modrm(char* text, int offset, bool wide, Insn* in)
+{
+	uint8_t modrm = byte_at(offset);
+	int mod = modrm >> 6, rm = modrm & 7;
+
+	if (mod == 3) {
+		put(text, "%s", wide ? regs[rm] : byte_regs[rm]);
+		return 1;
+	}
+
+	/* Timed like emulator does it */
+	static const uint8_t ea[8] = { 7, 8, 8, 7, 5, 5, 5, 5 };
+	in->mem = true;
+	in->ea = mod == 0 && rm == 6 ? 6 : ea[rm] + (mod != 0 ? 4 : 0);
+	in->ea_long = mod != 0 && rm < 4;
+
+	if (mod == 0 && rm == 6) {
+		put(text, "[0x%04X]", word_at(offset + 1));
+		return 3;
+	}
+
+	put(text, "[%s", bases[rm]);
+	if (mod == 1) {
+		int8_t disp = byte_at(offset + 1);
+		put(text, "%c%d]", disp < 0 ? '-' : '+', disp < 0 ? -disp : disp);
+		return 2;
+	}
+	if (mod == 2) {
+		put(text, "+0x%04X]", word_at(offset + 1));
+		return 3;
+	}
+
+	put(text, "]");
+	return 1;
+}
+
+/* Size has to be spelled out when no register tells it */
+static void put_size(char* text, int offset, bool wide)
+{
+	if ((byte_at(offset) >> 6) != 3)
+		put(text, wide ? "WORD " : "BYTE ");
+}
+
+static bool is_string_op(uint8_t op)
+{
+	return op >= 0xA4 && op <= 0xAF && op != 0xA8 && op != 0xA9;
+}
+
+/* Decode instruction into text, returns its length (0 if it is unknown) */
+static int decode(int offset, char* text, Insn* in)
+{
+	int at = offset;
+	uint8_t op = byte_at(at);
+	text[0] = '\0';
+
+	/* Prefixes are a part of the instruction */
+	while (opcodes[op].ops == OPS_PREFIX && at - offset < 4) {
+		if (op == 0xF2 || op == 0xF3)
+			in->rep = true;
+		else
+			in->prefixes++;
+
+		uint8_t next = byte_at(at + 1);
+		if (op == 0xF3 && (next == 0xA6 || next == 0xA7 ||
+		    next == 0xAE || next == 0xAF))
+			put(text, "REPE ");
+		else
+			put(text, "%s ", opcodes[op].name);
+		op = byte_at(++at);
+	}
+	at++;
+	in->op = op;
+
+	/* Jcc near (386) is the only two byte opcode codegen uses */
+	if (op == 0x0F) {
+		uint8_t ext = byte_at(at++);
+		if ((ext & 0xF0) != JCC_NEAR)
+			return 0;
+
+		in->ext = ext;
+		put(text, "%s near ", opcodes[0x70 + (ext & 0x0F)].name);
+		put_target(text, LOAD + at + 2 + word_at(at));
+		return at + 2 - offset;
+	}
+
+	const Opcode* o = &opcodes[op];
+	uint8_t reg = (byte_at(at) >> 3) & 7;
+	const char* name = o->name;
+	int imm = o->imm;
+
+	/* Groups take their mnemonic from ModRM */
+	if (name == NULL && o->ops == OPS_RM) {
+		in->ext = reg;
+		if (op >= 0x80 && op <= 0x83)
+			name = group1[reg];
+		else if (op == 0xC0 || op == 0xC1 || (op >= 0xD0 && op <= 0xD3))
+			name = group2[reg];
+		else if (op == 0xF6 || op == 0xF7) {
+			name = group3[reg];
+			imm = reg < 2 ? (o->wide ? 2 : 1) : 0;	/* TEST */
+		}
+		else if (op == 0xFF || reg < 2)
+			name = group5[reg];
+	}
+	if (name == NULL || o->ops == OPS_PREFIX)
+		return 0;
+
+	put(text, "%s", name);
+	if (o->ops != OPS_NONE)
+		put(text, " ");
+
+	const char** r = o->wide ? regs : byte_regs;
+	switch (o->ops) {
+		case OPS_NONE:
+			break;
+		case OPS_RM_REG:
+			at += put_modrm(text, at, o->wide, in);
+			put(text, ", %s", r[reg]);
+			break;
+		case OPS_REG_RM:
+		case OPS_IMUL:
+			put(text, "%s, ", r[reg]);
+			at += put_modrm(text, at, o->wide, in);
+			if (o->ops == OPS_IMUL) {
+				put(text, ", ");
+				put_imm(text, imm == 1 ? byte_at(at) : word_at(at),
+					imm);
+				at += imm;
 			}
-			offset += 4;
-			break;
-		}
-		case 0x25: {	/* AND AX, imm16 */
-			uint16_t imm = read_word(c, offset + 1);
-			printf("%02X%04X        ", byte, swap(imm));
-			printf("AND AX, %d (0x%04X)\n", imm, imm);
-			offset += 3;
 			break;
-		}
-		case 0x2B: {	/* SUB r16, r16 */
-			uint8_t modrm = c->code[offset + 1];
-			printf("%02X%02X          ", byte, modrm);
-			int dst = (modrm & 0x38) >> 3;
-			int src = modrm & 7;
-			printf("SUB %s, %s\n", regs[dst], regs[src]);
-			offset += 2;
+		case OPS_RM: {
+			put_size(text, at, o->wide);
+			at += put_modrm(text, at, o->wide, in);
+			if (op == 0xD0 || op == 0xD1)
+				put(text, ", 1");
+			else if (op == 0xD2 || op == 0xD3)
+				put(text, ", CL");
+			else if (op == 0x83) {
+				int8_t val = byte_at(at);
+				put(text, ", %d", val);
+			}
+			else if (op == 0xC0 || op == 0xC1) {
+				in->count = byte_at(at);
+				put(text, ", %d", in->count);
+			}
+			else if (imm > 0) {
+				put(text, ", ");
+				put_imm(text, imm == 1 ? byte_at(at) : word_at(at),
+					imm);
+			}
+			at += imm;
 			break;
 		}
-		case 0x33: {	/* XOR r16, r16 */
-			uint8_t modrm = c->code[offset + 1];
-			printf("%02X%02X          ", byte, modrm);
-			int dst = (modrm & 0x38) >> 3;
-			int src = modrm & 7;
-			printf("XOR %s, %s\n", regs[dst], regs[src]);
-			offset += 2;
+		case OPS_RM_SREG:
+			at += put_modrm(text, at, true, in);
+			put(text, ", %s", sregs[reg & 3]);
 			break;
-		}
-		case 0x3B: {	/* CMP r16, r16 */
-			uint8_t modrm = c->code[offset + 1];
-			printf("%02X%02X          ", byte, modrm);
-			int dst = (modrm & 0x38) >> 3;
-			int src = modrm & 7;
-			printf("CMP %s, %s\n", regs[dst], regs[src]);
-			offset += 2;
+		case OPS_SREG_RM:
+			put(text, "%s, ", sregs[reg & 3]);
+			at += put_modrm(text, at, true, in);
 			break;
-		}
-		case 0x3D: {	/* CMP AX, imm16 */
-			uint16_t imm = read_word(c, offset + 1);
-			printf("%02X%04X        ", byte, swap(imm));
-			printf("CMP AX, %d (0x%04X)\n", imm, imm);
-			offset += 3;
+		case OPS_ACC_IMM:
+			put(text, "%s, ", r[AX]);
+			put_imm(text, imm == 1 ? byte_at(at) : word_at(at), imm);
+			at += imm;
 			break;
-		}
-		/* Man I love C */
-		case 0x50:
-		case 0x51:
-		case 0x52:
-		case 0x53:
-		case 0x54:
-		case 0x55:
-		case 0x56:
-		case 0x57: {	/* PUSH r16 */
-			printf("%02X            ", byte);
-			printf("PUSH %s\n", regs[byte - 0x50]);
-			offset += 1;
+		case OPS_ACC_MEM:
+			put(text, "%s, [0x%04X]", r[AX], word_at(at));
+			at += imm;
 			break;
-		}
-		case 0x58:
-		case 0x59:
-		case 0x5A:
-		case 0x5B:
-		case 0x5C:
-		case 0x5D:
-		case 0x5E:
-		case 0x5F: {	/* POP r16 */
-			printf("%02X            ", byte);
-			printf("POP %s\n", regs[byte - 0x58]);
-			offset += 1;
+		case OPS_MEM_ACC:
+			put(text, "[0x%04X], %s", word_at(at), r[AX]);
+			at += imm;
 			break;
-		}
-		case 0x72: {	/* JC rel8 */
-			int8_t rel = c->code[offset + 1];
-			uint16_t target = offset + 2 + rel + LOAD;
-			printf("%02X%02X          ", byte, (uint8_t)rel);
-			printf("JC  short 0x%04X\n", target);
-			offset += 2;
+		case OPS_REG:
+			put(text, "%s", r[op & 7]);
 			break;
-		}
-		case 0x74: {	/* JZ rel8 */
-			int8_t rel = c->code[offset + 1];
-			uint16_t target = offset + 2 + rel + LOAD;
-			printf("%02X%02X          ", byte, (uint8_t)rel);
-			printf("JZ  short 0x%04X\n", target);
-			offset += 2;
+		case OPS_REG_IMM:
+			put(text, "%s, ", r[op & 7]);
+			put_imm(text, imm == 1 ? byte_at(at) : word_at(at), imm);
+			at += imm;
 			break;
-		}
-		case 0x75: {	/* JNE rel8 */
-			int8_t rel = c->code[offset + 1];
-			uint16_t target = offset + 2 + rel + LOAD;
-			printf("%02X%02X          ", byte, (uint8_t)rel);
-			printf("JNE short 0x%04X\n", target);
-			offset += 2;
+		case OPS_ACC_REG:
+			put(text, "AX, %s", regs[op & 7]);
 			break;
-		}
-		case 0x7F: {	/* JG rel8 */
-			int8_t rel = c->code[offset + 1];
-			uint16_t target = offset + 2 + rel + LOAD;
-			printf("%02X%02X          ", byte, (uint8_t)rel);
-			printf("JG  short 0x%04X\n", target);
-			offset += 2;
+		case OPS_IMM:
+			if (op == 0xCD)
+				put(text, "0x%02X", byte_at(at));
+			else
+				put_imm(text, imm == 1 ? byte_at(at) : word_at(at),
+					imm);
+			at += imm;
 			break;
-		}
-		case 0x85: {	/* TEST r16, r16 */
-			uint8_t modrm = c->code[offset + 1];
-			printf("%02X%02X          ", byte, modrm);
-			int dst = (modrm & 0x38) >> 3;
-			int src = modrm & 7;
-			printf("TEST %s, %s\n", regs[dst], regs[src]);
-			offset += 2;
+		case OPS_REL: {
+			int16_t rel = imm == 1 ? (int8_t) byte_at(at) :
+				(int16_t) word_at(at);
+			at += imm;
+			if (op != 0xE8)
+				put(text, imm == 1 ? "short " : "near ");
+			put_target(text, LOAD + at + rel);
 			break;
 		}
-		case 0x87: {	/* XCHG r16, r16 */
-			uint8_t modrm = c->code[offset + 1];
-			printf("%02X%02X          ", byte, modrm);
-			int dst = (modrm & 0x38) >> 3;
-			int src = modrm & 7;
-			printf("XCHG %s, %s\n", regs[dst], regs[src]);
-			offset += 2;
+		case OPS_FAR:
+			put(text, "0x%04X:0x%04X", word_at(at + 2), word_at(at));
+			at += imm;
 			break;
-		}
-		case 0x89: {	/* MOV [r/m16], r16 */
-			uint8_t modrm = c->code[offset + 1];
-			int src = (modrm & 0x38) >> 3;
-
-			/* Loading into [BX] */
-			if ((modrm & 0xC0) == 0 && (modrm & 7) == 7) {
-				printf("%02X%02X          ", byte, modrm);
-				printf("MOV [BX], %s\n", regs[src]);
-				offset += 2;
-				break;
-			}
+	}
 
-			/* We are loading into immediate address */
-			uint16_t addr = read_word(c, offset + 2);
-			printf("%02X%02X%04X      ", byte, modrm, swap(addr));
-			printf("MOV [0x%04X], %s\n", addr, regs[src]);
-			offset += 4;
-			break;
-		}
-		case 0x8B: {	/* MOV r16, r16 or MOV r16, [r/m16] */
-			uint8_t modrm = c->code[offset + 1];
-			int dst = (modrm & 0x38) >> 3;
-
-			/* It is reg to reg */
-			if (modrm & 0xC0) {
-				printf("%02X%02X          ", byte, modrm);
-				int src = modrm & 7;
-				printf("MOV %s, %s\n", regs[dst], regs[src]);
-				offset += 2;
-				break;
-			}
+	return at - offset;
+}
 
-			/* It is loading from [BX] */
-			if ((modrm & 7) == 7) {
-				printf("%02X%02X          ", byte, modrm);
-				printf("MOV %s, [BX]\n", regs[dst]);
-				offset += 2;
-				break;
-			}
+/* ================================ PRINTING ================================ */
+static bool is_conditional(uint8_t op)
+{
+	return (op >= 0x70 && op <= 0x7F) || op == 0x0F ||
+		(op >= 0xE0 && op <= 0xE3);
+}
 
-			/* Or from immediate value */
-			uint16_t addr = read_word(c, offset + 2);
-			printf("%02X%02X%04X      ", byte, modrm, swap(addr));
-			printf("MOV %s, [0x%04X]\n", regs[dst], addr);
+/* Cycles, "a+bn" when they depend on count and "a/b" for not taken/taken */
+static void print_cycles(Insn* in, CpuModel model)
+{
+	char buf[16];
+	if ((in->rep && is_string_op(in->op)) ||
+	    in->op == 0xD2 || in->op == 0xD3) {
+		in->count = 0;
+		int base = insn_cycles(in, model);
+		in->count = 1;
+		snprintf(buf, sizeof(buf), "%d+%dn", base,
+			insn_cycles(in, model) - base);
+	}
+	else if (is_conditional(in->op)) {
+		in->jumped = false;
+		int not_taken = insn_cycles(in, model);
+		in->jumped = true;
+		snprintf(buf, sizeof(buf), "%d/%d", not_taken,
+			insn_cycles(in, model));
+	}
+	else
+		snprintf(buf, sizeof(buf), "%d", insn_cycles(in, model));
 
-			offset += 4;
-			break;
-		}
-		case 0x90: {	/* NOP */
-			printf("%02X            ", byte);
-			printf("NOP\n");
-			offset += 1;
-			break;
-		}
-		case 0x91:
-		case 0x92:
-		case 0x93:
-		case 0x94:
-		case 0x95:
-		case 0x96:
-		case 0x97: {	/* XCHG AX, r16 */
-			printf("%02X            ", byte);
-			printf("XCHG AX, %s\n", regs[byte - 0x90]);
-			offset += 1;
-			break;
-		}
-		case 0xAA: {	/* STOSB */
-			printf("%02X            ", byte);
-			printf("STOSB\n");
-			offset += 1;
-			break;
-		}
-		case 0xAB: {	/* STOSW */
-			printf("%02X            ", byte);
-			printf("STOSW\n");
-			offset += 1;
-			break;
-		}
-		case 0xB0:
-		case 0xB1:
-		case 0xB2:
-		case 0xB3:
-		case 0xB4:
-		case 0xB5:
-		case 0xB6:
-		case 0xB7: {	/* MOV r/m8, imm8 */
-			int reg = byte - 0xB0;
-			uint8_t imm = c->code[offset + 1];
-			printf("%02X%02X          ", byte, imm);
-			printf("MOV %s, %d (0x%02X)\n", byte_regs[reg],
-				imm, imm);
-			offset += 2;
-			break;
-		}
-		case 0xAC: {	/* LODSB */
-			printf("%02X            ", byte);
-			printf("LODSB\n");
-			offset += 1;
-			break;
-		}
-		case 0xC1: {	/* SHR r16, imm8 or SHL r16, imm8 */
-			uint8_t modrm = c->code[offset + 1];
-			uint8_t imm = c->code[offset + 2];
-			int dst = modrm & 7;
-			printf("%02X%02X%04X      ", byte, modrm, swap(imm));
-			if ((modrm & 0x38) >> 3 == 4)
-				printf("SHL %s, %d\n", regs[dst], imm);
-			else
-				printf("SHR %s, %d\n", regs[dst], imm);
-			offset += 3;
-			break;
-		}
-		case 0xC3: {	/* RET */
-			printf("%02X            ", byte);
-			printf("RET\n");
-			offset += 1;
-			break;
-		}
-		case 0xC7: {	/* MOV r/m16, imm16 */
-			uint8_t modrm = c->code[offset + 1];
-			int dst = modrm & 7;
-			uint16_t imm = read_word(c, offset + 2);
-			if ((modrm & 0xC0) == 0) {
-				uint16_t val = read_word(c, offset + 4);
-				printf("%02X%02X%04X%04X  ", byte, modrm,
-					swap(imm), swap(val));
-				printf("MOV [0x%04X], %d (0x%04X)\n", imm,
-					val, val);
-				offset += 6;
-				break;
-			}
-			printf("%02X%02X%04X      ", byte, modrm, swap(imm));
-			printf("MOV %s, %d (0x%04X)\n", regs[dst], imm, imm);
-			offset += 4;
-			break;
-		}
-		case 0xCD: {	/* INT n */
-			uint8_t imm = c->code[offset + 1];
-			printf("%02X%02X          ", byte, imm);
-			printf("INT 0x%02X\n", imm);
-			offset += 2;
-			break;
-		}
-		case 0xE8: {	/* CALL rel16 */
-			int16_t rel = read_word(c, offset + 1);
-			uint16_t target = offset + 3 + rel + LOAD;
-			printf("%02X%04X        ", byte, swap(rel));
-			printf("CALL 0x%04X\n", target);
-			offset += 3;
-			break;
-		}
-		case 0xE9: {	/* JMP NEAR */
-			int16_t rel = read_word(c, offset + 1);
-			uint16_t target = offset + 3 + rel + LOAD;
-			printf("%02X%04X        ", byte, swap(rel));
-			printf("JMP near  0x%04X\n", target);
-			offset += 3;
-			break;
-		}
-		case 0xEB: {	/* JMP SHORT */
-			int8_t rel = c->code[offset + 1];
-			uint16_t target = offset + 2 + rel + LOAD;
-			printf("%02X%02X          ", byte, (uint8_t)rel);
-			printf("JMP short 0x%04X\n", target);
-			offset += 2;
-			break;
-		}
-		case 0xF3: {	/* REP prefix */
-			printf("%02X            REP Prefix\n", byte);
-			offset += 1;
-			break;
-		}
-		case 0xF7: {	/* MUL r16 or DIV r16 */
-			uint8_t modrm = c->code[offset + 1];
-			printf("%02X%02X          ", byte, modrm);
-			int src = modrm & 7;
-			if ((modrm & 0x38) >> 3 == 4)
-				printf("MUL %s\n", regs[src]);
-			else
-				printf("DIV %s\n", regs[src]);
-			offset += 2;
-			break;
-		}
-		case 0xFE: {	/* INC r/m8 */
-			uint8_t modrm = c->code[offset + 1];
+	printf(" %8s", buf);
+}
 
-			int src = modrm & 7;
-			printf("%02X%02X          ", byte, modrm);
-			printf("INC %s\n", byte_regs[src]);
+static void print_hex(int offset, int len)
+{
+	char hex[HEX_WIDTH + 1] = "";
+	for (int i = 0; i < len && i * 2 < HEX_WIDTH - 2; i++)
+		sprintf(hex + i * 2, "%02X", byte_at(offset + i));
+	printf("%-*s", HEX_WIDTH, hex);
+}
 
-			offset += 2;
-			break;
-		}
-		case 0xFF: {	/* INC r/m16 or DEC r/m16 or CALL r16 */
-			uint8_t modrm = c->code[offset + 1];
-
-			/* CALL r16 */
-			if ((modrm & 0x38) >> 3 == 2) {
-				int src = modrm & 7;
-				printf("%02X%02X          ", byte, modrm);
-				printf("CALL %s\n", regs[src]);
-				offset += 2;
-				break;
-			}
+/* Print instruction, it must not go past end (then it is shown as a byte) */
+static int print_instruction(int offset, int end)
+{
+	char text[TEXT_WIDTH * 2];
+	Insn in;
+	memset(&in, 0, sizeof(in));
 
-			/* DEC r16 */
-			if ((modrm & 0x38) >> 3 == 1) {
-				int src = modrm & 7;
-				printf("%02X%02X          ", byte, modrm);
-				printf("DEC %s\n", regs[src]);
-				offset += 2;
-				break;
-			}
+	int len = decode(offset, text, &in);
+	if (len == 0 || offset + len > end) {
+		len = 1;
+		snprintf(text, sizeof(text), "DB 0x%02X", byte_at(offset));
+	}
+	in.len = len;
 
-			/* INC r16 */
-			if ((modrm & 0xC0) != 0) {
-				int src = modrm & 7;
-				printf("%02X%02X          ", byte, modrm);
-				printf("INC %s\n", regs[src]);
-				offset += 2;
-				break;
-			}
+	printf("0x%04X  ", offset + LOAD);	/* Print our current offset */
+	print_hex(offset, len);
+	printf("%-*s %3d", TEXT_WIDTH, text, len);
+	if (strncmp(text, "DB ", 3)) {
+		print_cycles(&in, CPU_8086);
+		print_cycles(&in, CPU_286);
+	}
+	printf("\n");
 
-			/* INC [mem16] */
-			uint16_t addr = read_word(c, offset + 2);
-			printf("%02X%02X%04X      ", byte, modrm, swap(addr));
-			printf("INC [0x%04X]\n", addr);
-			offset += 4;
-			break;
+	return offset + len;
+}
+
+int disassemble_instruction(CompileTarget* c, int offset)
+{
+	target = c;
+	return print_instruction(offset, c->length);
+}
+
+/* Next place where a routine or line starts */
+static int next_boundary(int offset, int line)
+{
+	CompileTarget* c = target;
+	int end = c->length;
+	for (int i = 0; i < c->ranges.length; i++)
+		if (c->ranges.table[i].start > offset &&
+		    c->ranges.table[i].start < end)
+			end = c->ranges.table[i].start;
+
+	while (line < c->lines.length && c->lines.table[line].addr <= offset)
+		line++;
+	if (line < c->lines.length && c->lines.table[line].addr < end)
+		end = c->lines.table[line].addr;
+	return end;
+}
+
+static bool is_data(RangeTableEntry* r)
+{
+	return !strcmp(r->name, "runtime_data") ||
+		!strcmp(r->name, "string_table") ||
+		!strcmp(r->name, "zero_divide_msg");
+}
+
+/* Runtime data are words, string table NUL terminated strings */
+static int print_data(RangeTableEntry* r, int offset)
+{
+	char text[TEXT_WIDTH * 2];
+	int len = 2;
+	if (!strcmp(r->name, "runtime_data"))
+		snprintf(text, sizeof(text), "DW %d", word_at(offset));
+	else {
+		len = 0;
+		while (offset + len < r->end && byte_at(offset + len) != 0)
+			len++;
+
+		snprintf(text, sizeof(text), "DB \"");
+		for (int i = 0; i < len && i < DATA_WIDTH; i++) {
+			uint8_t ch = byte_at(offset + i);
+			put(text, "%c", ch >= 0x20 && ch < 0x7F ? ch : '.');
 		}
-		default:
-			printf("%02X            <Unknown instruction>\n", byte);
-			offset++;
+		put(text, len > DATA_WIDTH ? "...\", 0" : "\", 0");
+		len++;
+	}
+
+	printf("0x%04X  ", offset + LOAD);
+	print_hex(offset, len);
+	printf("%-*s %3d\n", TEXT_WIDTH, text, len);
+	return offset + len;
+}
+
+static void print_source_line(int line)
+{
+	int len;
+	const char* s = line_text(line, &len);
+	printf(": %.*s", len < SOURCE_WIDTH ? len : SOURCE_WIDTH, s);
+}
+
+/* Say what starts at offset: routine, label or source line */
+static void print_headers(int offset, int* line)
+{
+	CompileTarget* c = target;
+	for (int i = 0; i < c->ranges.length; i++) {
+		RangeTableEntry* r = &c->ranges.table[i];
+		if (r->start == offset && r->end > r->start)
+			printf("\x1B[36m(* ==== %s (%d bytes) ==== *)\x1B[0m\n",
+				r->name, r->end - r->start);
+	}
+
+	for (int i = 0; symbols != NULL && i < symbols->len; i++) {
+		SymbolTableEntry* s = &symbols->table[i];
+		if (s->isreal && s->addr == offset)
+			printf("\x1B[32m%.*s\x1B[0m\n", s->len, s->str);
 	}
 
-	return offset;
+	while (*line < c->lines.length && c->lines.table[*line].addr < offset)
+		(*line)++;
+	if (*line < c->lines.length && c->lines.table[*line].addr == offset) {
+		LineTableEntry* l = &c->lines.table[*line];
+		printf("\x1B[33m(* line %d %s, %d bytes", l->line,
+			l->kind != NULL ? l->kind : "", line_end(c, *line) - offset);
+		print_source_line(l->line);
+		printf(" *)\x1B[0m\n");
+	}
 }
 
-void disassemble(CompileTarget* c)
+void disassemble(CompileTarget* c, SymbolTable* sym)
 {
-	int strings_len = read_word(c, 1) + 3 - RUNTIMELEN;
+	target = c;
+	symbols = sym;
+	printf("%-8s%-*s%-*s %3s %8s %8s\n", "Address", HEX_WIDTH, "Bytes",
+		TEXT_WIDTH, "Instruction", "Len", "8086", "286");
+
 	/* Instructions in x86 are variable length so we do it this way */
+	int line = 0;
 	for (int i = 0; i < c->length; /* nothing */) {
-		if (i == 3) {	/* Runtime! Don't disassemble */
-			printf("0x%04X  ", i + LOAD);
-			printf("(* ==== BASIC RUNTIME ==== *)\n");
-			i = RUNTIMELEN;
-			continue;
-		}
-		if (i == RUNTIMELEN && strings_len != 0) { /* String table */
-			printf("0x%04X  ", i + LOAD);
-			printf("(* ==== STRINGS TABLE ==== *)\n");
-			i = RUNTIMELEN + strings_len;	/* Where we jump */
-			continue;
-		}
-		i = disassemble_instruction(c, i);
+		print_headers(i, &line);
+
+		RangeTableEntry* r = find_range(c, i);
+		if (r != NULL && is_data(r))
+			i = print_data(r, i);
+		else
+			i = print_instruction(i, next_boundary(i, line));
 	}
 }
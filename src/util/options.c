@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Custom includes */
+#include <options.h>
+#include <optimize.h>
+
+Options options = {
+	.src = NULL,
+	.out = NULL,
+	.debug = false,
+	.compat_vars = false,
+	.compat_print = false,
+	.string_lengths = false,
+	.var_align = 2,
+	.opt_level = OPT_O1,
+	.time_passes = false,
+	.outline_min = 1,
+	.run = false,
+	.run_limit = 100000000,
+	.stats = STATS_OFF,
+	.profile = PROFILE_OFF,
+	.folded = NULL,
+	.instrument = false,
+	.counter_map = NULL,
+	.counter_dump = NULL,
+	.map = NULL,
+	.size_report = false,
+	.max_size = 0
+};
+
+static void option_error(const char* msg, const char* arg)
+{
+	printf("\x1B[31mError\x1B[0m: %s: \"%s\".\n", msg, arg);
+}
+
+/* Parse non-negative number, -1 if it is invalid */
+static int number_value(const char* str)
+{
+	if (*str == '\0')
+		return -1;
+
+	char* end;
+	long ret = strtol(str, &end, 0);
+	if (*end != '\0' || ret < 0)
+		return -1;
+
+	return (int) ret;
+}
+
+/* Parse numeric value of "-name=N" style option, -1 if it is invalid */
+static int option_value(const char* arg, const char* name)
+{
+	const char* val = arg + strlen(name);
+	if (*val != '=')
+		return -1;
+
+	return number_value(val + 1);
+}
+
+void print_usage()
+{
+	printf("----- \x1B[33mMikeOS Basic Compiler\x1B[0m -----\n"
+		"Usage: mosbc \x1B[35msrc\x1B[0m \x1B[36mout\x1B[0m "
+		"\x1B[33m[options]\x1B[0m\n"
+		"  \x1B[35msrc\x1B[0m - Name of the source file\n"
+		"  \x1B[36mout\x1B[0m - Name of output file (optional with "
+		"-run)\n"
+		"Options:\n"
+		"  \x1B[33m-debug\x1B[0m - Print compiler data "
+		"structures.\n"
+		"  \x1B[33m-var-align=N\x1B[0m - Align variables to N bytes "
+		"(power of 2, default 2).\n"
+		"  \x1B[33m-compat-vars\x1B[0m - Keep variables at MikeOS' "
+		"addresses (VARIABLES = 0x4941).\n"
+		"  \x1B[33m-compat-print\x1B[0m - Print through BIOS instead "
+		"of writing to video memory.\n"
+		"  \x1B[33m-string-lengths\x1B[0m - Keep lengths of string "
+		"variables (fast LEN, + and =).\n"
+		"  \x1B[33m-O0\x1B[0m, \x1B[33m-O1\x1B[0m, \x1B[33m-O2\x1B[0m, "
+		"\x1B[33m-Os\x1B[0m - No passes, cheap passes (default),\n"
+		"    passes for speed or passes for size.\n"
+		"  \x1B[33m-f<pass>\x1B[0m, \x1B[33m-fno-<pass>\x1B[0m - Enable "
+		"or disable a single pass: inline,\n"
+		"    fold-strings, elide-copies, cse or outline.\n"
+		"  \x1B[33m-time-passes\x1B[0m - Print time of every pass "
+		"and bytes it saved.\n"
+		"  \x1B[33m-outline-min=N\x1B[0m - Outline a keyword used more "
+		"than N times (default 1).\n"
+		"  \x1B[33m-run\x1B[0m - Run the program in built-in "
+		"emulator.\n"
+		"  \x1B[33m-run-limit=N\x1B[0m - Stop emulator after N "
+		"instructions.\n"
+		"  \x1B[33m-stats\x1B[0m, \x1B[33m-stats=json\x1B[0m - Print "
+		"time of phases and sizes of tables.\n"
+		"  \x1B[33m-profile\x1B[0m, \x1B[33m-profile=instructions"
+		"\x1B[0m - Run and print hottest lines\n"
+		"    and subroutines (by 8086 cycles or by instructions).\n"
+		"  \x1B[33m-profile-folded=file\x1B[0m - Write GOSUB stacks "
+		"of -profile for flame graphs.\n"
+		"  \x1B[33m-instrument\x1B[0m - Count executions of every "
+		"statement in a table after RAMSTART.\n"
+		"  \x1B[33m-instrument-map=file\x1B[0m - Write which line "
+		"every counter belongs to.\n"
+		"  \x1B[33m-instrument-dump=file\x1B[0m - Save counters "
+		"after running in the emulator.\n"
+		"  \x1B[33m-map file\x1B[0m - Write addresses of labels, "
+		"routines, data and lines.\n"
+		"  \x1B[33m-size-report\x1B[0m - Print bytes taken by lines, "
+		"statements and runtime.\n"
+		"  \x1B[33m-max-size=N\x1B[0m - Fail (with size report) if "
+		"output is over N bytes.\n");
+}
+
+bool parse_options(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+
+		/* Positional arguments: first source, then output */
+		if (arg[0] != '-') {
+			if (options.src == NULL)
+				options.src = arg;
+			else if (options.out == NULL)
+				options.out = arg;
+			else {
+				option_error("Unexpected argument", arg);
+				return false;
+			}
+			continue;
+		}
+
+		if (!strcmp(arg, "-debug"))
+			options.debug = true;
+		else if (!strcmp(arg, "-compat-vars"))
+			options.compat_vars = true;
+		else if (!strcmp(arg, "-compat-print"))
+			options.compat_print = true;
+		else if (!strcmp(arg, "-string-lengths"))
+			options.string_lengths = true;
+		else if (!strncmp(arg, "-var-align", 10)) {
+			int align = option_value(arg, "-var-align");
+
+			/* Only powers of two make sense */
+			if (align < 1 || align > 256 || (align & (align - 1))) {
+				option_error("Invalid alignment", arg);
+				return false;
+			}
+			options.var_align = align;
+		}
+		else if (!strcmp(arg, "-O0"))
+			options.opt_level = OPT_O0;
+		else if (!strcmp(arg, "-O1"))
+			options.opt_level = OPT_O1;
+		else if (!strcmp(arg, "-O2"))
+			options.opt_level = OPT_O2;
+		else if (!strcmp(arg, "-Os"))
+			options.opt_level = OPT_OS;
+		else if (!strcmp(arg, "-time-passes"))
+			options.time_passes = true;
+		else if (!strncmp(arg, "-outline-min", 12)) {
+			int min = option_value(arg, "-outline-min");
+			if (min < 1) {
+				option_error("Invalid number of uses", arg);
+				return false;
+			}
+			options.outline_min = min;
+		}
+		else if (!strcmp(arg, "-run"))
+			options.run = true;
+		else if (!strncmp(arg, "-run-limit", 10)) {
+			int limit = option_value(arg, "-run-limit");
+			if (limit < 1) {
+				option_error("Invalid instruction limit", arg);
+				return false;
+			}
+			options.run_limit = limit;
+		}
+		else if (!strcmp(arg, "-stats"))
+			options.stats = STATS_TEXT;
+		else if (!strcmp(arg, "-stats=json"))
+			options.stats = STATS_JSON;
+		else if (!strcmp(arg, "-profile") ||
+			 !strcmp(arg, "-profile=cycles"))
+			options.profile = PROFILE_CYCLES;
+		else if (!strcmp(arg, "-profile=instructions"))
+			options.profile = PROFILE_INSTRUCTIONS;
+		else if (!strncmp(arg, "-profile-folded=", 16)) {
+			options.folded = arg + 16;
+			if (options.profile == PROFILE_OFF)
+				options.profile = PROFILE_CYCLES;
+		}
+		else if (!strcmp(arg, "-instrument"))
+			options.instrument = true;
+		else if (!strncmp(arg, "-instrument-map=", 16)) {
+			options.counter_map = arg + 16;
+			options.instrument = true;
+		}
+		else if (!strncmp(arg, "-instrument-dump=", 17)) {
+			options.counter_dump = arg + 17;
+			options.instrument = true;
+			options.run = true;
+		}
+		else if (!strcmp(arg, "-map") && i + 1 < argc)
+			options.map = argv[++i];
+		else if (!strncmp(arg, "-map=", 5))
+			options.map = arg + 5;
+		else if (!strcmp(arg, "-size-report"))
+			options.size_report = true;
+		else if (!strncmp(arg, "-max-size", 9)) {
+			int max;
+			if (!strcmp(arg, "-max-size") && i + 1 < argc) {
+				arg = argv[++i];
+				max = number_value(arg);
+			}
+			else
+				max = option_value(arg, "-max-size");
+			if (max < 1) {
+				option_error("Invalid size", arg);
+				return false;
+			}
+			options.max_size = max;
+		}
+		else if (!strncmp(arg, "-f", 2))
+			continue;	/* Passes are toggled after the level */
+		else {
+			option_error("Unknown option", arg);
+			return false;
+		}
+	}
+
+	/* Now level is known, single passes can override it */
+	set_opt_level(options.opt_level);
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+
+		/* Skip values of options, a file may be named "-f..." too */
+		if ((!strcmp(arg, "-map") || !strcmp(arg, "-max-size")) &&
+		    i + 1 < argc) {
+			i++;
+			continue;
+		}
+		if (strncmp(arg, "-f", 2))
+			continue;
+
+		bool enable = strncmp(arg, "-fno-", 5) != 0;
+		if (!set_pass(arg + (enable ? 2 : 5), enable)) {
+			option_error("Unknown pass", arg);
+			return false;
+		}
+	}
+
+	/* Profiling means running */
+	if (options.profile != PROFILE_OFF)
+		options.run = true;
+
+	/* Both files are required, unless program is only run */
+	return options.src != NULL && (options.out != NULL || options.run);
+}
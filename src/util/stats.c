@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* Custom includes */
+#include <stats.h>
+#include <lexer.h>
+#include <options.h>
+#include <util.h>
+
+#define LOAD_WINDOW (0x10000 - LOAD)	/* Program has to fit below 64 KB */
+#define REPORT_TOP 10		/* Rows of tables in size report */
+#define SOURCE_WIDTH 40		/* Characters of source line shown */
+
+Stats stats;
+
+static const char* phase_name[] = {
+	[STAT_READ] = "read",
+	[STAT_INCLUDE] = "include",
+	[STAT_LEX] = "lex",
+	[STAT_PARSE] = "parse",
+	[STAT_CODEGEN] = "codegen",
+	[STAT_WRITE] = "write"
+};
+
+static double start[STAT_COUNT];
+
+void stat_begin(StatPhase phase)
+{
+	start[phase] = wall_time();
+}
+
+void stat_end(StatPhase phase)
+{
+	stats.time[phase] += wall_time() - start[phase];
+}
+
+void collect_stats(SymbolTable* sym, StringTable* str, CompileTarget* code)
+{
+	stats.symbols = sym->len;
+	stats.strings = str->len;
+	stats.string_bytes = str->blob_len;
+	stats.relocs = code->relocs.length;
+	mem_usage(&stats.heap_peak, &stats.allocs);
+
+	/* Output is runtime, string table, program and helpers */
+	stats.runtime = RUNTIMELEN;
+	stats.program = code->helpers_at - RUNTIMELEN - str->blob_len;
+	stats.helpers = code->length - code->helpers_at;
+	stats.total = code->length;
+	stats.data = code->ramstart - (LOAD + code->length);
+}
+
+static double total_time()
+{
+	double ret = 0;
+	for (int i = 0; i < STAT_COUNT; i++)
+		ret += stats.time[i];
+	return ret;
+}
+
+/* Path can have backslashes (or quotes) in it */
+static void print_json_string(const char* str)
+{
+	putchar('"');
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			putchar('\\');
+		putchar(*str);
+	}
+	putchar('"');
+}
+
+static void print_json()
+{
+	printf("{\"source\": ");
+	print_json_string(options.src);
+	printf(", \"time_ms\": {");
+	for (int i = 0; i < STAT_COUNT; i++)
+		printf("\"%s\": %.3f, ", phase_name[i], stats.time[i] * 1000);
+	printf("\"total\": %.3f}, ", total_time() * 1000);
+
+	printf("\"tokens\": %ld, \"nodes\": %ld, \"symbols\": %d, "
+		"\"strings\": %d, \"string_bytes\": %d, \"patches\": %d, "
+		"\"relocations\": %d, \"heap_peak\": %zu, \"allocations\": %ld, ",
+		stats.tokens, stats.nodes, stats.symbols, stats.strings,
+		stats.string_bytes, stats.patches, stats.relocs,
+		stats.heap_peak, stats.allocs);
+
+	printf("\"regions\": {\"runtime\": %d, \"string_table\": %d, "
+		"\"program\": %d, \"helpers\": %d, \"variables\": %d}, "
+		"\"total\": %d}\n", stats.runtime, stats.string_bytes,
+		stats.program, stats.helpers, stats.data, stats.total);
+}
+
+static void print_text()
+{
+	printf("\x1B[36mStatistics\x1B[0m:\n");
+	for (int i = 0; i < STAT_COUNT; i++)
+		printf("  %-14s %10.3f ms\n", phase_name[i],
+			stats.time[i] * 1000);
+	printf("  %-14s %10.3f ms\n", "total", total_time() * 1000);
+
+	printf("  %-14s %10ld\n", "tokens", stats.tokens);
+	printf("  %-14s %10ld\n", "AST nodes", stats.nodes);
+	printf("  %-14s %10d\n", "symbols", stats.symbols);
+	printf("  %-14s %10d (%d bytes)\n", "strings", stats.strings,
+		stats.string_bytes);
+	printf("  %-14s %10d\n", "patches", stats.patches);
+	printf("  %-14s %10d\n", "relocations", stats.relocs);
+	printf("  %-14s %10zu bytes in %ld allocations\n", "peak heap",
+		stats.heap_peak, stats.allocs);
+
+	printf("\x1B[36mOutput\x1B[0m:\n");
+	printf("  %-14s %10d bytes\n", "runtime", stats.runtime);
+	printf("  %-14s %10d bytes\n", "string table", stats.string_bytes);
+	printf("  %-14s %10d bytes\n", "program", stats.program);
+	printf("  %-14s %10d bytes\n", "helpers", stats.helpers);
+	printf("  %-14s %10d bytes (+ %d bytes of variables)\n", "total",
+		stats.total, stats.data);
+}
+
+void print_stats(bool json)
+{
+	if (json)
+		print_json();
+	else
+		print_text();
+}
+
+/* ============================== SIZE REPORT =============================== */
+typedef struct {
+	const char* name;	/* Kind or routine (NULL for lines) */
+	int line;
+	int bytes;
+} SizeRow;
+
+static int by_bytes(const void* a, const void* b)
+{
+	const SizeRow* x = a;
+	const SizeRow* y = b;
+	if (x->bytes != y->bytes)
+		return y->bytes - x->bytes;
+	return x->line - y->line;
+}
+
+static void print_share(const char* name, int bytes, int total)
+{
+	printf("  %-18s %7d %6.1f%%\n", name, bytes,
+		total ? 100.0 * bytes / total : 0.0);
+}
+
+/* Add bytes to row of kind, rows are few so they are searched */
+static void add_kind(SizeRow* rows, int* len, const char* name, int bytes)
+{
+	for (int i = 0; i < *len; i++) {
+		if (rows[i].name == name || !strcmp(rows[i].name, name)) {
+			rows[i].bytes += bytes;
+			return;
+		}
+	}
+	rows[(*len)++] = (SizeRow) { name, 0, bytes };
+}
+
+void print_size_report(CompileTarget* code)
+{
+	int total = code->length;
+	printf("\x1B[36mSize report\x1B[0m: %d bytes, %.1f%% of %d bytes "
+		"program can take\n", total, 100.0 * total / LOAD_WINDOW,
+		LOAD_WINDOW);
+
+	/* Statements, by kind and by line */
+	LineTable* l = &code->lines;
+	SizeRow* kinds = mem_alloc((l->length + 1) * sizeof(SizeRow));
+	int nkinds = 0, max = 0, program = 0;
+	for (int i = 0; i < l->length; i++)
+		if (l->table[i].line > max)
+			max = l->table[i].line;
+
+	SizeRow* lines = mem_alloc((max + 1) * sizeof(SizeRow));
+	for (int i = 0; i <= max; i++)
+		lines[i] = (SizeRow) { NULL, i, 0 };
+
+	for (int i = 0; i < l->length; i++) {
+		int bytes = line_end(code, i) - l->table[i].addr;
+		const char* kind = l->table[i].kind;
+		add_kind(kinds, &nkinds, kind != NULL ? kind : "other", bytes);
+		lines[l->table[i].line].bytes += bytes;
+		program += bytes;
+	}
+
+	/* Everything else is runtime, data and helpers */
+	RangeTable* r = &code->ranges;
+	SizeRow* ranges = mem_alloc((r->length + 1) * sizeof(SizeRow));
+	int nranges = 0, runtime = 0;
+	for (int i = 0; i < r->length; i++) {
+		int bytes = r->table[i].end - r->table[i].start;
+		if (bytes > 0)
+			ranges[nranges++] = (SizeRow) { r->table[i].name, 0,
+				bytes };
+		runtime += bytes;
+	}
+
+	printf("  %-18s %7s %7s\n", "Region", "Bytes", "Share");
+	print_share("statements", program, total);
+	print_share("runtime and data", runtime, total);
+	if (program + runtime != total)
+		print_share("unattributed", total - program - runtime, total);
+
+	qsort(kinds, nkinds, sizeof(SizeRow), by_bytes);
+	printf("\x1B[36mStatements by kind\x1B[0m:\n");
+	for (int i = 0; i < nkinds; i++)
+		print_share(kinds[i].name, kinds[i].bytes, total);
+
+	qsort(ranges, nranges, sizeof(SizeRow), by_bytes);
+	printf("\x1B[36mRuntime, string table and helpers\x1B[0m:\n");
+	for (int i = 0; i < nranges; i++)
+		print_share(ranges[i].name, ranges[i].bytes, total);
+
+	qsort(lines, max + 1, sizeof(SizeRow), by_bytes);
+	printf("\x1B[36mLargest lines\x1B[0m:\n");
+	printf("  %-18s %7s %7s  %s\n", "Line", "Bytes", "Share", "Source");
+	for (int i = 0; i <= max && i < REPORT_TOP && lines[i].bytes > 0;
+	     i++) {
+		int len;
+		const char* text = line_text(lines[i].line, &len);
+		printf("  %-18d %7d %6.1f%%  %.*s\n", lines[i].line,
+			lines[i].bytes, 100.0 * lines[i].bytes / total,
+			len < SOURCE_WIDTH ? len : SOURCE_WIDTH, text);
+	}
+
+	mem_free(kinds);
+	mem_free(lines);
+	mem_free(ranges);
+}
@@ -9,18 +9,19 @@
 
 /* Custom includes */
 #include <table.h>
+#include <util.h>
 
 /* ============================== SYMBOL TABLE ============================== */
 void init_sym_table(SymbolTable* t)
 {
 	t->len = 0;
 	t->capacity = 8;
-	t->table = malloc(t->capacity * sizeof(SymbolTableEntry));
+	t->table = mem_alloc(t->capacity * sizeof(SymbolTableEntry));
 }
 
 void free_sym_table(SymbolTable* t)
 {
-	free(t->table);
+	mem_free(t->table);
 	t->table = NULL;
 	t->len = 0;
 	t->capacity = 0;
@@ -38,7 +39,7 @@ int add_unreal_symbol(SymbolTable* t, char* str, int len)
 	if (t->capacity < t->len + 1) {
 		t->capacity *= 2;
 
-		t->table = realloc(t->table, t->capacity *
+		t->table = mem_realloc(t->table, t->capacity *
 					sizeof(SymbolTableEntry));
 	}
 
@@ -99,15 +100,15 @@ void init_str_table(StringTable* t)
 {
 	t->len = 0;
 	t->capacity = 8;
-	t->table = malloc(t->capacity * sizeof(StringTableEntry));
+	t->table = mem_alloc(t->capacity * sizeof(StringTableEntry));
 	t->blob = NULL;
 	t->blob_len = 0;
 }
 
 void free_str_table(StringTable* t)
 {
-	free(t->table);
-	free(t->blob);
+	mem_free(t->table);
+	mem_free(t->blob);
 	t->table = NULL;
 	t->len = 0;
 	t->capacity = 0;
@@ -120,7 +121,7 @@ int add_string(StringTable* t, const char* str, int len)
 	/* If entry is already present, just return its index */
 	for (int i = 0; i < t->len; i++) {
 		const char* entry_str = t->blob + t->table[i].offset;
-		if (!strcmp(entry_str, str))
+		if (t->table[i].len == len && !strncmp(entry_str, str, len))
 			return i;
 	}
 
@@ -128,7 +129,7 @@ int add_string(StringTable* t, const char* str, int len)
 	if (t->capacity < t->len + 1) {
 		t->capacity *= 2;
 
-		t->table = realloc(t->table, t->capacity *
+		t->table = mem_realloc(t->table, t->capacity *
 					sizeof(StringTableEntry));
 	}
 
@@ -139,7 +140,7 @@ int add_string(StringTable* t, const char* str, int len)
 	t->len++;
 
 	/* Append string to blob */
-	t->blob = realloc(t->blob, t->blob_len + len + 1);
+	t->blob = mem_realloc(t->blob, t->blob_len + len + 1);
 	strncpy(t->blob + t->blob_len, str, len);
 	t->blob_len += len + 1;
 	t->blob[t->blob_len - 1] = '\0';
@@ -8,12 +8,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
 
 /* Custom includes */
 #include <util.h>
 
 bool had_error = false;
 
+/* Every allocated block starts with its size */
+typedef union {
+	size_t size;
+	max_align_t align;
+} BlockHeader;
+
+static size_t heap_now;		/* Bytes allocated right now */
+static size_t heap_peak;	/* Most bytes allocated at once */
+static long allocs;		/* Calls to mem_alloc() and mem_realloc() */
+
 void string_uppercase(char* str)
 {
 	while (*str) {
@@ -35,3 +47,81 @@ void check_for_error()
 		exit(-1);
 	}
 }
+
+double wall_time()
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+char* read_file(const char* filename)
+{
+	FILE* f = fopen(filename, "rb");
+	if (f == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not open source file.\n");
+		raise_error();
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	int len = ftell(f);
+	rewind(f);
+
+	char* source = mem_alloc(len + 1);		/* One more for NUL */
+	if (source == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not allocate to read.\n");
+		raise_error();
+		return NULL;
+	}
+
+	int read = fread(source, sizeof(char), len, f);
+	if (read != len) {
+		printf("\x1B[31mError\x1B[0m: Could not read source file.\n");
+		raise_error();
+		return NULL;
+	}
+
+	source[len] = '\0';			/* Zero terminate string */
+	fclose(f);
+	return source;
+}
+
+void* mem_alloc(size_t size)
+{
+	return mem_realloc(NULL, size);
+}
+
+void* mem_realloc(void* ptr, size_t size)
+{
+	BlockHeader* old = ptr != NULL ? (BlockHeader*) ptr - 1 : NULL;
+	size_t old_size = old != NULL ? old->size : 0;
+
+	BlockHeader* block = realloc(old, sizeof(BlockHeader) + size);
+	if (block == NULL)
+		return NULL;
+
+	block->size = size;
+	heap_now = heap_now - old_size + size;
+	if (heap_now > heap_peak)
+		heap_peak = heap_now;
+	allocs++;
+
+	return block + 1;
+}
+
+void mem_free(void* ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	BlockHeader* block = (BlockHeader*) ptr - 1;
+	heap_now -= block->size;
+	free(block);
+}
+
+void mem_usage(size_t* peak, long* count)
+{
+	*peak = heap_peak;
+	*count = allocs;
+}
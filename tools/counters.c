@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2022, Wojciech Grzela <grzela.wojciech@gmail.com>
+ * Licensed under GNU General Public License version 3.
+ */
+
+/* Coverage report of -instrument (make counters): reads counter map written by
+ * -instrument-map and the counter table, either saved by the program itself,
+ * by -instrument-dump or as a part of memory dump of the whole segment.
+ */
+
+/* Standard library includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_LINE 256
+
+typedef struct {
+	int line;		/* Source line of the statement */
+	long addr;		/* Address of its INC */
+	long count;		/* Executions (modulo 65536) */
+} Counter;
+
+typedef struct {
+	int line;
+	long count;		/* Most executed statement of the line */
+	int statements;
+} Line;
+
+/* Settings from the command line */
+static const char* map_name = NULL;
+static const char* dump_name = NULL;
+static long base = -1;		/* Offset of the table in the dump */
+static int top = 10;		/* Hottest lines to show */
+
+/* What the map says */
+static char source[MAX_LINE] = "";
+static long table = 0;
+static Counter* counters = NULL;
+static int len = 0;
+
+/* ================================== INPUT ================================= */
+static bool read_map()
+{
+	FILE* f = fopen(map_name, "r");
+	if (f == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not open %s.\n", map_name);
+		return false;
+	}
+
+	char line[MAX_LINE];
+	int index, n = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "source %255[^\n]", source) == 1)
+			continue;
+		if (sscanf(line, "table %li %d", &table, &len) == 2) {
+			counters = calloc(len, sizeof(Counter));
+			continue;
+		}
+
+		Counter c = { 0, 0, 0 };
+		if (sscanf(line, "counter %d line %d addr %li", &index, &c.line,
+		    &c.addr) != 3 || counters == NULL || index < 0 ||
+		    index >= len)
+			continue;
+		counters[index] = c;
+		n++;
+	}
+
+	fclose(f);
+	if (counters == NULL || n != len) {
+		printf("\x1B[31mError\x1B[0m: %s is not a complete counter "
+			"map.\n", map_name);
+		return false;
+	}
+	return true;
+}
+
+static bool read_dump()
+{
+	FILE* f = fopen(dump_name, "rb");
+	if (f == NULL) {
+		printf("\x1B[31mError\x1B[0m: Could not open %s.\n", dump_name);
+		return false;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+
+	/* Saved table alone, or dump of the segment program runs in */
+	if (base < 0)
+		base = size == len * 2 ? 0 : table;
+	if (base + len * 2 > size) {
+		printf("\x1B[31mError\x1B[0m: %s is neither the counter table "
+			"nor a dump of the segment\n(%ld bytes, table is %d bytes "
+			"at 0x%04lX), try -base=N.\n", dump_name, size, len * 2,
+			table);
+		fclose(f);
+		return false;
+	}
+
+	uint8_t* raw = malloc(len * 2 + 1);
+	fseek(f, base, SEEK_SET);
+	long got = fread(raw, 1, len * 2, f);
+	fclose(f);
+
+	for (int i = 0; i < len && i * 2 + 1 < got; i++)
+		counters[i].count = raw[i * 2] | (raw[i * 2 + 1] << 8);
+
+	free(raw);
+	return true;
+}
+
+/* Text of source line n (without newline), empty if it can't be found */
+static const char* source_line(FILE* f, int n)
+{
+	static char text[MAX_LINE];
+	text[0] = '\0';
+	if (f == NULL)
+		return text;
+
+	rewind(f);
+	for (int i = 1; i <= n; i++)
+		if (fgets(text, sizeof(text), f) == NULL)
+			return "";
+
+	char* s = text;
+	while (*s == ' ' || *s == '\t')
+		s++;
+	s[strcspn(s, "\r\n")] = '\0';
+	return s;
+}
+
+/* ================================ REPORTING =============================== */
+static int by_count(const void* a, const void* b)
+{
+	const Line* x = a;
+	const Line* y = b;
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return x->line - y->line;
+}
+
+static int by_line(const void* a, const void* b)
+{
+	return ((const Line*) a)->line - ((const Line*) b)->line;
+}
+
+static void report()
+{
+	/* Several statements can share a line (IF ... THEN ...) */
+	Line* lines = calloc(len + 1, sizeof(Line));
+	int nlines = 0, executed = 0, covered = 0;
+	long total = 0;
+	for (int i = 0; i < len; i++) {
+		Counter* c = &counters[i];
+		executed += c->count > 0;
+		total += c->count;
+
+		int j = 0;
+		while (j < nlines && lines[j].line != c->line)
+			j++;
+		if (j == nlines)
+			lines[nlines++] = (Line) { c->line, 0, 0 };
+		if (c->count > lines[j].count)
+			lines[j].count = c->count;
+		lines[j].statements++;
+	}
+	for (int i = 0; i < nlines; i++)
+		covered += lines[i].count > 0;
+
+	printf("\x1B[36mCoverage\x1B[0m of %s:\n", source);
+	printf("  Statements: %d of %d executed (%.1f%%)\n", executed, len,
+		len ? 100.0 * executed / len : 0.0);
+	printf("  Lines:      %d of %d executed (%.1f%%)\n", covered, nlines,
+		nlines ? 100.0 * covered / nlines : 0.0);
+	printf("  Executions: %ld (counters wrap at 65536)\n", total);
+
+	FILE* src = fopen(source, "r");
+	qsort(lines, nlines, sizeof(Line), by_count);
+	printf("\n\x1B[36mHottest lines\x1B[0m:\n");
+	printf("%6s %8s %7s  %s\n", "Line", "Count", "Share", "Source");
+	for (int i = 0; i < nlines && i < top && lines[i].count > 0; i++)
+		printf("%6d %8ld %6.1f%%  %s\n", lines[i].line, lines[i].count,
+			total ? 100.0 * lines[i].count / total : 0.0,
+			source_line(src, lines[i].line));
+
+	qsort(lines, nlines, sizeof(Line), by_line);
+	if (covered < nlines) {
+		printf("\n\x1B[33mNever executed\x1B[0m:\n");
+		for (int i = 0; i < nlines; i++)
+			if (lines[i].count == 0)
+				printf("%6d  %s\n", lines[i].line,
+					source_line(src, lines[i].line));
+	}
+
+	if (src != NULL)
+		fclose(src);
+	free(lines);
+}
+
+static bool parse_args(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		if (!strncmp(arg, "-base=", 6))
+			base = strtol(arg + 6, NULL, 0);
+		else if (!strncmp(arg, "-top=", 5))
+			top = atoi(arg + 5);
+		else if (arg[0] != '-' && map_name == NULL)
+			map_name = arg;
+		else if (arg[0] != '-' && dump_name == NULL)
+			dump_name = arg;
+		else
+			map_name = NULL;
+	}
+
+	if (map_name == NULL || dump_name == NULL) {
+		printf("Usage: counters map dump [-base=N] [-top=N]\n"
+			"  map - Written by mosbc -instrument-map=file\n"
+			"  dump - Counter table, or memory dump of program's "
+			"segment\n");
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (!parse_args(argc, argv) || !read_map() || !read_dump())
+		return -1;
+
+	report();
+	free(counters);
+	return 0;
+}